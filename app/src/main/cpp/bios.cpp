@@ -1,7 +1,15 @@
 #include <cmath>
+#include <cstring>
 
 #include "bios.h"
 #include "core.h"
+#include "crc16.h"
+
+// Offsets of the functions in a decompression callback structure
+#define CALLBACK_OPEN 0x00
+#define CALLBACK_CLOSE 0x04
+#define CALLBACK_GET8 0x08
+#define CALLBACK_GET32 0x10
 
 // HLE ARM9 BIOS SWI lookup table
 int (Bios9::*Bios9::swiTable9[])(bool, uint32_t **) =
@@ -14,9 +22,9 @@ int (Bios9::*Bios9::swiTable9[])(bool, uint32_t **) =
                 &Bios::swiCpuSet,     // 0x08-0x0B
                 &Bios::swiCpuFastSet, &Bios::swiSquareRoot, &Bios::swiGetCrc16,
                 &Bios::swiIsDebugger, // 0x0C-0x0F
-                &Bios::swiBitUnpack, &Bios::swiLz77Uncomp, &Bios::swiLz77Uncomp,
-                &Bios::swiUnknown,    // 0x10-0x13
-                &Bios::swiRunlenUncomp, &Bios::swiRunlenUncomp, &Bios9::swiDiffUnfilt8,
+                &Bios::swiBitUnpack, &Bios::swiLz77Uncomp, &Bios::swiLz77UncompVram,
+                &Bios::swiHuffUncomp, // 0x10-0x13
+                &Bios::swiRunlenUncomp, &Bios::swiRunlenUncompVram, &Bios9::swiDiffUnfilt8,
                 &Bios::swiUnknown,    // 0x14-0x17
                 &Bios9::swiDiffUnfilt16, &Bios::swiUnknown, &Bios::swiUnknown,
                 &Bios::swiUnknown,    // 0x18-0x1B
@@ -36,9 +44,9 @@ int (Bios7::*Bios7::swiTable7[])(bool, uint32_t **) =
                 &Bios::swiCpuSet,         // 0x08-0x0B
                 &Bios::swiCpuFastSet, &Bios::swiSquareRoot, &Bios::swiGetCrc16,
                 &Bios::swiIsDebugger,     // 0x0C-0x0F
-                &Bios::swiBitUnpack, &Bios::swiLz77Uncomp, &Bios::swiLz77Uncomp,
-                &Bios::swiUnknown,        // 0x10-0x13
-                &Bios::swiRunlenUncomp, &Bios::swiRunlenUncomp, &Bios::swiUnknown,
+                &Bios::swiBitUnpack, &Bios::swiLz77Uncomp, &Bios::swiLz77UncompVram,
+                &Bios::swiHuffUncomp,     // 0x10-0x13
+                &Bios::swiRunlenUncomp, &Bios::swiRunlenUncompVram, &Bios::swiUnknown,
                 &Bios::swiUnknown,        // 0x14-0x17
                 &Bios::swiUnknown, &Bios::swiUnknown, &Bios7::swiGetSineTable,
                 &Bios7::swiGetPitchTable, // 0x18-0x1B
@@ -47,6 +55,11 @@ int (Bios7::*Bios7::swiTable7[])(bool, uint32_t **) =
                 &Bios::swiUnknown                                                                                       // 0x20
         };
 
+void Bios::syncState(State &state) {
+    // Sync the flags of an HLE IntrWait function in progress
+    state.var(waitFlags);
+}
+
 int Bios::execute(uint8_t vector, bool cpu, uint32_t **registers) {
     // Execute the HLE version of the given exception vector
     switch (vector) {
@@ -147,6 +160,22 @@ int Bios::swiCpuSet(bool cpu, uint32_t **registers) {
     bool word = (*registers[2] & BIT(26));
     bool fixed = (*registers[2] & BIT(24));
     uint32_t size = (*registers[2] & 0xFFFFF) << (1 + word);
+    uint32_t unit = word ? 4 : 2;
+
+    // Copy/fill memory directly on the host if the source and destination are separate plain memory
+    uint32_t src = *registers[0] & ~(unit - 1);
+    uint32_t dst = *registers[1] & ~(unit - 1);
+    uint8_t *srcData = core->memory.getReadBlock(cpu, src, fixed ? unit : size);
+    uint8_t *dstData = core->memory.getWriteBlock(cpu, dst, size);
+    if (srcData && dstData && (srcData + (fixed ? unit : size) <= dstData || dstData + size <= srcData)) {
+        if (!fixed) {
+            memcpy(dstData, srcData, size);
+        } else {
+            for (uint32_t i = 0; i < size; i += unit)
+                memcpy(&dstData[i], srcData, unit);
+        }
+        return 3;
+    }
 
     if (word) {
         // Copy/fill memory from the source to the destination (32-bit)
@@ -172,6 +201,21 @@ int Bios::swiCpuFastSet(bool cpu, uint32_t **registers) {
     bool fixed = (*registers[2] & BIT(24));
     uint32_t size = (*registers[2] & 0xFFFFF) << 2;
 
+    // Copy/fill memory directly on the host if the source and destination are separate plain memory
+    uint32_t src = *registers[0] & ~3;
+    uint32_t dst = *registers[1] & ~3;
+    uint8_t *srcData = core->memory.getReadBlock(cpu, src, fixed ? 4 : size);
+    uint8_t *dstData = core->memory.getWriteBlock(cpu, dst, size);
+    if (srcData && dstData && (srcData + (fixed ? 4 : size) <= dstData || dstData + size <= srcData)) {
+        if (!fixed) {
+            memcpy(dstData, srcData, size);
+        } else {
+            for (uint32_t i = 0; i < size; i += 4)
+                memcpy(&dstData[i], srcData, 4);
+        }
+        return 3;
+    }
+
     // Copy/fill memory from the source to the destination
     for (uint32_t i = 0; i < size; i += 4) {
         uint32_t address = *registers[0] + (fixed ? 0 : i);
@@ -189,15 +233,21 @@ int Bios::swiSquareRoot(bool cpu, uint32_t **registers) {
 }
 
 int Bios::swiGetCrc16(bool cpu, uint32_t **registers) {
-    static const uint16_t table[] = {0xC0C1, 0xC181, 0xC301, 0xC601, 0xCC01, 0xD801, 0xF001,
-                                     0xA001};
-
-    // Calculate a CRC16 value for the given data
-    for (size_t i = 0; i < *registers[2]; i++) {
-        *registers[0] ^= core->memory.read<uint8_t>(cpu, *registers[1] + i);
-        for (size_t j = 0; j < 8; j++)
-            *registers[0] =
-                    (*registers[0] >> 1) ^ ((*registers[0] & 1) ? (table[j] << (7 - j)) : 0);
+    // Calculate a CRC16 value for the given data, in chunks that don't cross a 4KB memory block
+    for (uint32_t i = 0; i < *registers[2];) {
+        uint32_t address = *registers[1] + i;
+        uint32_t size = std::min(*registers[2] - i, 0x1000 - (address & 0xFFF));
+
+        if (uint8_t *data = core->memory.getReadPointer(cpu, address)) {
+            // Read plain memory directly
+            *registers[0] = Crc16::calculate(*registers[0], data, size);
+        } else {
+            // Read special memory one byte at a time
+            for (uint32_t j = 0; j < size; j++)
+                *registers[0] = Crc16::update(*registers[0], core->memory.read<uint8_t>(cpu, address + j));
+        }
+
+        i += size;
     }
 
     return 3;
@@ -216,6 +266,19 @@ int Bios::swiBitUnpack(bool cpu, uint32_t **registers) {
     uint8_t dstWidth = core->memory.read<uint8_t>(cpu, *registers[2] + 3);
     uint32_t offset = core->memory.read<uint32_t>(cpu, *registers[2] + 4);
 
+    // Unpack directly on the host if the source and destination are plain memory and the widths are valid
+    if ((srcWidth == 1 || srcWidth == 2 || srcWidth == 4 || srcWidth == 8) &&
+        (dstWidth == 1 || dstWidth == 2 || dstWidth == 4 || dstWidth == 8 || dstWidth == 16) &&
+        srcWidth <= dstWidth) {
+        uint32_t dstSize = ((size * 8 / srcWidth) * dstWidth / 32) * 4;
+        uint8_t *srcData = core->memory.getReadBlock(cpu, *registers[0], size);
+        uint8_t *dstData = core->memory.getWriteBlock(cpu, *registers[1] & ~3, dstSize);
+        if (srcData && dstData) {
+            bitUnpack(srcData, dstData, size, srcWidth, dstWidth, offset);
+            return 3;
+        }
+    }
+
     uint32_t dst = 0;
     uint32_t dstValue = 0;
     uint8_t dstBits = 0;
@@ -260,6 +323,15 @@ int Bios::swiLz77Uncomp(bool cpu, uint32_t **registers) {
     uint32_t src = 4;
     uint32_t dst = 0;
 
+    // Decompress directly on the host if the worst-case source and destination ranges are plain memory
+    // The destination can overshoot by up to 17 bytes, and each flag byte covers up to 8 source bytes
+    uint8_t *srcData = core->memory.getReadBlock(cpu, *registers[0], 6 + size + (size >> 3));
+    uint8_t *dstData = core->memory.getWriteBlock(cpu, *registers[1], size + 18);
+    if (srcData && dstData && dstData == core->memory.getReadBlock(cpu, *registers[1], size + 18)) {
+        lz77Uncomp(cpu, srcData, dstData, *registers[1], size);
+        return 3;
+    }
+
     while (true) {
         // Read the flags for the next 8 sections
         uint16_t flags = core->memory.read<uint8_t>(cpu, *registers[0] + src++);
@@ -297,6 +369,15 @@ int Bios::swiRunlenUncomp(bool cpu, uint32_t **registers) {
     uint32_t src = 4;
     uint32_t dst = 0;
 
+    // Decompress directly on the host if the worst-case source and destination ranges are plain memory
+    // The destination can overshoot by up to 129 bytes, and each output byte takes at most 2 source bytes
+    uint8_t *srcData = core->memory.getReadBlock(cpu, *registers[0], 4 + size * 2);
+    uint8_t *dstData = core->memory.getWriteBlock(cpu, *registers[1], size + 130);
+    if (srcData && dstData) {
+        runlenUncomp(srcData, dstData, size);
+        return 3;
+    }
+
     while (dst < size) {
         // Read the flags for the next section
         uint8_t flags = core->memory.read<uint8_t>(cpu, *registers[0] + src++);
@@ -319,6 +400,326 @@ int Bios::swiRunlenUncomp(bool cpu, uint32_t **registers) {
     return 3;
 }
 
+int Bios::swiLz77UncompVram(bool cpu, uint32_t **registers) {
+    // Get the size from the header and set the initial addresses, stopping if opening the source failed
+    uint32_t header = openSource(cpu, registers, false);
+    if ((int32_t)header < 0) {
+        *registers[0] = header;
+        return 3;
+    }
+    uint32_t size = header >> 8;
+    uint32_t dst = 0;
+    uint16_t buffer = 0;
+
+    // Use the normal version if the source is in memory and the destination is plain memory
+    // 16-bit writes make no difference there, and the host pointers can be used
+    if (!useCallbacks && core->memory.getWriteBlock(cpu, *registers[1], size + 18)) {
+        swiLz77Uncomp(cpu, registers);
+        closeSource(cpu, registers, size);
+        return 3;
+    }
+
+    while (true) {
+        // Read the flags for the next 8 sections
+        uint16_t flags = readSource8(cpu);
+
+        for (uint32_t i = 0; i < 8; i++) {
+            // Finish once the destination size is reached
+            if (dst >= size) {
+                closeSource(cpu, registers, size);
+                return 3;
+            }
+
+            if ((flags <<= 1) & BIT(8)) // Next flag
+            {
+                // Decode some parameters
+                uint8_t val1 = readSource8(cpu);
+                uint8_t val2 = readSource8(cpu);
+                uint8_t size = 3 + ((val1 >> 4) & 0xF);
+                uint16_t offset = 1 + ((val1 & 0xF) << 8) + val2;
+
+                // Repeat a group of bytes from a previous offset in the destination (16-bit writes)
+                for (uint32_t j = 0; j < size; j++) {
+                    uint8_t value = core->memory.read<uint8_t>(cpu, *registers[1] + dst - offset);
+                    writeByte16(cpu, *registers[1] + dst++, value, buffer);
+                }
+            } else {
+                // Copy a new byte from the source to the destination (16-bit writes)
+                writeByte16(cpu, *registers[1] + dst++, readSource8(cpu), buffer);
+            }
+        }
+    }
+}
+
+int Bios::swiHuffUncomp(bool cpu, uint32_t **registers) {
+    // Get the size and data width from the header, stopping if opening the source failed
+    uint32_t header = openSource(cpu, registers, true);
+    if ((int32_t)header < 0) {
+        *registers[0] = header;
+        return 3;
+    }
+    uint32_t size = header >> 8;
+    uint8_t width = ((header & 0xF) == 4) ? 4 : 8;
+
+    // Copy the tree into a local buffer, starting with the tree size byte
+    uint8_t tree[0x200];
+    tree[0] = readSource8(cpu);
+    uint32_t treeSize = (tree[0] + 1) * 2;
+    for (uint32_t i = 1; i < treeSize; i++)
+        tree[i] = readSource8(cpu);
+
+    uint32_t dst = 0;
+    uint32_t dstValue = 0;
+    uint8_t dstBits = 0;
+    uint32_t node = 1;
+    uint32_t depth = 0;
+
+    while (dst < size) {
+        // Read the next 32 bits of the bitstream
+        uint32_t bits = readSource32(cpu);
+
+        for (int i = 31; i >= 0 && dst < size; i--) {
+            // Move to the next child node; node 0 is taken for a 0 bit and node 1 for a 1 bit
+            bool right = (bits >> i) & 1;
+            uint32_t child = (node & ~1) + (tree[node] & 0x3F) * 2 + 2 + right;
+            bool leaf = tree[node] & (right ? BIT(6) : BIT(7));
+            if (child >= treeSize) child = treeSize - 1;
+
+            if (!leaf) {
+                // Give up on malformed trees that never reach a leaf
+                if (++depth > treeSize) {
+                    closeSource(cpu, registers, dst);
+                    return 3;
+                }
+                node = child;
+                continue;
+            }
+
+            // Add the leaf data to the destination and return to the root
+            dstValue |= (tree[child] & ((1 << width) - 1)) << dstBits;
+            dstBits += width;
+            node = 1;
+            depth = 0;
+
+            // Flush the destination data once there are 32 bits
+            if (dstBits == 32) {
+                core->memory.write<uint32_t>(cpu, *registers[1] + dst, dstValue);
+                dst += 4;
+                dstValue = 0;
+                dstBits = 0;
+            }
+        }
+    }
+
+    closeSource(cpu, registers, size);
+    return 3;
+}
+
+int Bios::swiRunlenUncompVram(bool cpu, uint32_t **registers) {
+    // Get the size from the header and set the initial addresses, stopping if opening the source failed
+    uint32_t header = openSource(cpu, registers, false);
+    if ((int32_t)header < 0) {
+        *registers[0] = header;
+        return 3;
+    }
+    uint32_t size = header >> 8;
+    uint32_t dst = 0;
+    uint16_t buffer = 0;
+
+    // Use the normal version if the source is in memory and the destination is plain memory
+    // 16-bit writes make no difference there, and the host pointers can be used
+    if (!useCallbacks && core->memory.getWriteBlock(cpu, *registers[1], size + 130)) {
+        swiRunlenUncomp(cpu, registers);
+        closeSource(cpu, registers, size);
+        return 3;
+    }
+
+    while (dst < size) {
+        // Read the flags for the next section
+        uint8_t flags = readSource8(cpu);
+
+        if (flags & BIT(7)) // Compressed
+        {
+            // Fill a length of destination data with the same source value (16-bit writes)
+            uint8_t value = readSource8(cpu);
+            for (int j = 0; j < (flags & 0x7F) + 3; j++)
+                writeByte16(cpu, *registers[1] + dst++, value, buffer);
+        } else {
+            // Copy a length of uncompressed data from the source to the destination (16-bit writes)
+            for (int j = 0; j < (flags & 0x7F) + 1; j++)
+                writeByte16(cpu, *registers[1] + dst++, readSource8(cpu), buffer);
+        }
+    }
+
+    closeSource(cpu, registers, size);
+    return 3;
+}
+
+void Bios::writeByte16(bool cpu, uint32_t address, uint8_t value, uint16_t &buffer) {
+    // Hold even bytes and write them together with the following odd byte, as 8-bit VRAM writes are unreliable
+    if (address & 1)
+        core->memory.write<uint16_t>(cpu, address - 1, buffer | (value << 8));
+    else
+        buffer = value;
+}
+
+bool Bios::isPlainCallback(bool cpu, uint32_t address, uint32_t armLoad, uint16_t thumbLoad) {
+    // Check if a callback only loads from the source address in r0 and returns
+    if (address & 1)
+        return core->memory.read<uint16_t>(cpu, address - 1) == thumbLoad &&
+               core->memory.read<uint16_t>(cpu, address + 1) == 0x4770; // BX LR
+    return core->memory.read<uint32_t>(cpu, address) == armLoad &&
+           core->memory.read<uint32_t>(cpu, address + 4) == 0xE12FFF1E; // BX LR
+}
+
+uint32_t Bios::openSource(bool cpu, uint32_t **registers, bool words) {
+    // Look up the callbacks in the structure pointed to by r3
+    uint32_t open = core->memory.read<uint32_t>(cpu, *registers[3] + CALLBACK_OPEN);
+    closeCallback = core->memory.read<uint32_t>(cpu, *registers[3] + CALLBACK_CLOSE);
+    get8Callback = core->memory.read<uint32_t>(cpu, *registers[3] + CALLBACK_GET8);
+    get32Callback = core->memory.read<uint32_t>(cpu, *registers[3] + CALLBACK_GET32);
+    source = *registers[0];
+
+    // Read the source from memory directly if the callbacks only do that, which is how games usually set them up
+    // Otherwise, the source could be anything, like a file or another decompressor, so the callbacks are run
+    useCallbacks = !isPlainCallback(cpu, open, 0xE5900000, 0x6800) || closeCallback != 0 || // LDR R0,[R0]
+                   !isPlainCallback(cpu, get8Callback, 0xE5D00000, 0x7800) || // LDRB R0,[R0]
+                   (words && !isPlainCallback(cpu, get32Callback, 0xE5900000, 0x6800)); // LDR R0,[R0]
+
+    // Get the header, passing the destination and user parameter to the open callback
+    uint32_t header = useCallbacks ? core->interpreter[cpu].callGuest(open, source, *registers[1], *registers[2])
+                                   : core->memory.read<uint32_t>(cpu, source);
+    source += 4;
+    return header;
+}
+
+uint8_t Bios::readSource8(bool cpu) {
+    // Read the next source byte and move past it
+    uint8_t value = useCallbacks ? core->interpreter[cpu].callGuest(get8Callback, source)
+                                 : core->memory.read<uint8_t>(cpu, source);
+    source += 1;
+    return value;
+}
+
+uint32_t Bios::readSource32(bool cpu) {
+    // Read the next source word and move past it
+    uint32_t value = useCallbacks ? core->interpreter[cpu].callGuest(get32Callback, source)
+                                  : core->memory.read<uint32_t>(cpu, source);
+    source += 4;
+    return value;
+}
+
+void Bios::closeSource(bool cpu, uint32_t **registers, uint32_t size) {
+    // Return the decompressed size, or an error from the close callback if there is one
+    int32_t result = size;
+    if (useCallbacks && closeCallback) {
+        int32_t value = core->interpreter[cpu].callGuest(closeCallback, source);
+        if (value < 0) result = value;
+    }
+    *registers[0] = result;
+}
+
+void Bios::bitUnpack(uint8_t *src, uint8_t *dst, uint32_t size, uint8_t srcWidth, uint8_t dstWidth,
+                     uint32_t offset) {
+    uint32_t mask = (1 << dstWidth) - 1;
+    uint32_t dstValue = 0;
+    uint8_t dstBits = 0;
+
+    for (uint32_t i = 0; i < size; i++) {
+        // Split each source byte into values, applying the offset to non-zero values or all if the zero flag is set
+        uint8_t srcValue = src[i];
+        for (uint8_t srcBits = 0; srcBits < 8; srcBits += srcWidth) {
+            uint32_t value = (srcValue << (dstWidth - srcWidth)) & mask;
+            if (value || (offset & BIT(31)))
+                value = (value + offset) & mask;
+            dstValue |= value << dstBits;
+            srcValue >>= srcWidth;
+
+            // Flush the destination data once there are 32 bits
+            if ((dstBits += dstWidth) == 32) {
+                U32TO8(dst, 0, dstValue);
+                dst += 4;
+                dstValue = 0;
+                dstBits = 0;
+            }
+        }
+    }
+}
+
+void Bios::lz77Uncomp(bool cpu, uint8_t *src, uint8_t *dst, uint32_t address, uint32_t size) {
+    uint32_t s = 4, d = 0;
+
+    while (true) {
+        // Read the flags for the next 8 sections
+        uint16_t flags = src[s++];
+
+        for (uint32_t i = 0; i < 8; i++) {
+            // Finish once the destination size is reached
+            if (d >= size)
+                return;
+
+            if ((flags <<= 1) & BIT(8)) // Next flag
+            {
+                // Decode some parameters
+                uint8_t val1 = src[s++];
+                uint8_t val2 = src[s++];
+                uint8_t length = 3 + ((val1 >> 4) & 0xF);
+                uint16_t offset = 1 + ((val1 & 0xF) << 8) + val2;
+
+                if (offset > d) {
+                    // Repeat bytes from before the destination using normal memory access
+                    for (uint32_t j = 0; j < length; j++, d++)
+                        core->memory.write<uint8_t>(cpu, address + d,
+                                                    core->memory.read<uint8_t>(cpu, address + d - offset));
+                } else if (offset >= length) {
+                    // Copy a group of bytes that doesn't overlap itself in one go
+                    memcpy(&dst[d], &dst[d - offset], length);
+                    d += length;
+                } else if (offset == 1) {
+                    // Repeat a single byte
+                    memset(&dst[d], dst[d - 1], length);
+                    d += length;
+                } else {
+                    // Repeat a short pattern one byte at a time
+                    for (uint32_t j = 0; j < length; j++, d++)
+                        dst[d] = dst[d - offset];
+                }
+            } else {
+                // Copy a new byte from the source to the destination
+                dst[d++] = src[s++];
+            }
+        }
+    }
+}
+
+void Bios::runlenUncomp(uint8_t *src, uint8_t *dst, uint32_t size) {
+    uint32_t s = 4, d = 0;
+
+    while (d < size) {
+        // Read the flags for the next section
+        uint8_t flags = src[s++];
+
+        if (flags & BIT(7)) // Compressed
+        {
+            // Fill a length of destination data with the same source value
+            uint32_t length = (flags & 0x7F) + 3;
+            memset(&dst[d], src[s++], length);
+            d += length;
+        } else {
+            // Copy a length of uncompressed data, one byte at a time if it overlaps with the destination
+            uint32_t length = (flags & 0x7F) + 1;
+            if (&src[s] + length <= &dst[d] || &dst[d] + length <= &src[s]) {
+                memcpy(&dst[d], &src[s], length);
+                s += length;
+                d += length;
+            } else {
+                for (uint32_t j = 0; j < length; j++)
+                    dst[d++] = src[s++];
+            }
+        }
+    }
+}
+
 int Bios::swiUnknown(bool cpu, uint32_t **registers) {
     // Handle an unknown SWI comment
     uint32_t address = *registers[15] - (core->interpreter[cpu].isThumb() ? 4 : 6);
@@ -573,6 +974,15 @@ int Bios9::swiDiffUnfilt8(bool cpu, uint32_t **registers) {
     uint32_t size = core->memory.read<uint32_t>(0, *registers[0]) >> 8;
     uint8_t value = 0;
 
+    // Accumulate directly on the host if the source and destination are plain memory
+    uint8_t *srcData = core->memory.getReadBlock(0, *registers[0] + 4, size);
+    uint8_t *dstData = core->memory.getWriteBlock(0, *registers[1], size);
+    if (srcData && dstData) {
+        for (uint32_t i = 0; i < size; i++)
+            dstData[i] = (value += srcData[i]);
+        return 3;
+    }
+
     // Accumulate the source values and write them to the destination (8-bit)
     for (uint32_t i = 0; i < size; i++) {
         uint32_t address = *registers[0] + 4 + i;
@@ -588,6 +998,18 @@ int Bios9::swiDiffUnfilt16(bool cpu, uint32_t **registers) {
     uint32_t size = core->memory.read<uint32_t>(0, *registers[0]) >> 8;
     uint16_t value = 0;
 
+    // Accumulate directly on the host if the source and destination are plain memory
+    uint8_t *srcData = core->memory.getReadBlock(0, (*registers[0] + 4) & ~1, (size + 1) & ~1);
+    uint8_t *dstData = core->memory.getWriteBlock(0, *registers[1] & ~1, (size + 1) & ~1);
+    if (srcData && dstData) {
+        for (uint32_t i = 0; i < size; i += 2) {
+            value += U8TO16(srcData, i);
+            dstData[i + 0] = value >> 0;
+            dstData[i + 1] = value >> 8;
+        }
+        return 3;
+    }
+
     // Accumulate the source values and write them to the destination (16-bit)
     for (uint32_t i = 0; i < size; i += 2) {
         uint32_t address = *registers[0] + 4 + i;
@@ -6,11 +6,15 @@
 
 class Core;
 
+class State;
+
 class Bios {
 public:
     Bios(Core *core, int (Bios::* *swiTable)(bool, uint32_t **)) :
             core(core), swiTable(swiTable) {}
 
+    void syncState(State &state);
+
     int execute(uint8_t vector, bool cpu, uint32_t **registers);
 
     void checkWaitFlags(bool cpu);
@@ -41,8 +45,14 @@ public:
 
     int swiLz77Uncomp(bool cpu, uint32_t **registers);
 
+    int swiLz77UncompVram(bool cpu, uint32_t **registers);
+
+    int swiHuffUncomp(bool cpu, uint32_t **registers);
+
     int swiRunlenUncomp(bool cpu, uint32_t **registers);
 
+    int swiRunlenUncompVram(bool cpu, uint32_t **registers);
+
     int swiUnknown(bool cpu, uint32_t **registers);
 
 protected:
@@ -51,7 +61,29 @@ protected:
 private:
     int (Bios::* *swiTable)(bool, uint32_t **);
 
+    void writeByte16(bool cpu, uint32_t address, uint8_t value, uint16_t &buffer);
+
+    bool isPlainCallback(bool cpu, uint32_t address, uint32_t armLoad, uint16_t thumbLoad);
+
+    uint32_t openSource(bool cpu, uint32_t **registers, bool words);
+
+    uint8_t readSource8(bool cpu);
+
+    uint32_t readSource32(bool cpu);
+
+    void closeSource(bool cpu, uint32_t **registers, uint32_t size);
+
+    void bitUnpack(uint8_t *src, uint8_t *dst, uint32_t size, uint8_t srcWidth, uint8_t dstWidth, uint32_t offset);
+
+    void lz77Uncomp(bool cpu, uint8_t *src, uint8_t *dst, uint32_t address, uint32_t size);
+
+    void runlenUncomp(uint8_t *src, uint8_t *dst, uint32_t size);
+
     uint32_t waitFlags = 0;
+
+    bool useCallbacks = false;
+    uint32_t source = 0;
+    uint32_t closeCallback = 0, get8Callback = 0, get32Callback = 0;
 };
 
 class Bios9 : public Bios {
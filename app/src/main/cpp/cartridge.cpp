@@ -2,6 +2,7 @@
 
 #include "cartridge.h"
 #include "core.h"
+#include "file_cache.h"
 #include "settings.h"
 
 Cartridge::~Cartridge() {
@@ -10,7 +11,6 @@ Cartridge::~Cartridge() {
 
     // Free the ROM and save memory
     if (romFile) fclose(romFile);
-    delete[] rom;
     delete[] save;
 }
 
@@ -44,14 +44,28 @@ bool Cartridge::loadRom(std::string path) {
 
 void Cartridge::loadRomSection(size_t offset, size_t size) {
     // Load a section of the current ROM file into memory
-    delete[] rom;
-
-    rom = new uint8_t[size];
+    romData.reset(new uint8_t[size]);
+    rom = romData.get();
     fseek(romFile, offset, SEEK_SET);
     fread(rom, sizeof(uint8_t), size, romFile);
     core->dldi.patchRom(rom, offset, size);
 }
 
+void Cartridge::loadRomShared() {
+    // Load the whole ROM into memory, sharing it with other instances that use the same file
+    // The first instance to load it patches DLDI drivers; the rest only detect them
+    size_t size = romSize;
+    romData = FileCache::load(romName, size, [this](uint8_t *data, size_t size) {
+        core->dldi.patchRom(data, 0, size);
+    });
+
+    // Fall back to a private copy if the file can't be shared
+    if (!romData)
+        return loadRomSection(0, romSize);
+    rom = romData.get();
+    core->dldi.patchRom(rom, 0, size);
+}
+
 void Cartridge::writeSave() {
     // Update the save file if the data changed
     mutex.lock();
@@ -67,6 +81,12 @@ void Cartridge::writeSave() {
 }
 
 void Cartridge::trimRom() {
+    // Skip trimming a ROM shared with other instances, since rewriting the file would pull it out from under them
+    if (romData.use_count() > 1) {
+        LOG("Not trimming ROM shared with another instance\n");
+        return;
+    }
+
     // Starting from the end, reduce the ROM size until a non-filler word is found
     int newSize;
     for (newSize = romSize & ~3; newSize > 0; newSize -= 4) {
@@ -75,12 +95,12 @@ void Cartridge::trimRom() {
     }
 
     if (newSize < romSize) {
-        // Update the ROM in memory
+        // Update the ROM in memory, releasing any mapping of the file before it's rewritten
         romSize = newSize;
-        auto *newRom = new uint8_t[newSize];
-        memcpy(newRom, rom, newSize * sizeof(uint8_t));
-        delete[] rom;
-        rom = newRom;
+        std::shared_ptr<uint8_t[]> newRom(new uint8_t[newSize]);
+        memcpy(newRom.get(), rom, newSize * sizeof(uint8_t));
+        romData = newRom;
+        rom = romData.get();
 
         // Update the ROM file
         FILE *romFile = fopen(romName.c_str(), "wb");
@@ -117,6 +137,43 @@ void Cartridge::resizeSave(int newSize, bool dirty) {
     mutex.unlock();
 }
 
+void Cartridge::syncState(State &state) {
+    // Sync the save size and contents, leaving out the ROM since it never changes
+    mutex.lock();
+    int size = saveSize;
+    state.var(size);
+
+    if (state.isSaving()) {
+        if (size > 0) state.block(save, size);
+    } else if (state.isValid()) {
+        // Find the loaded contents first, so the save is left alone if they're missing
+        uint8_t *data = (size > 0) ? state.skip(size) : nullptr;
+        if (size > 0 && !data) {
+            state.invalidate();
+            mutex.unlock();
+            return;
+        }
+
+        // Reallocate the save if the loaded size is different
+        bool resized = (size != saveSize);
+        if (resized) {
+            delete[] save;
+            save = (size > 0) ? new uint8_t[size] : nullptr;
+            saveSize = size;
+            saveDirty = true;
+        }
+
+        // Copy the loaded contents, only marking the save dirty if they changed
+        // This avoids rewriting the save file when states are loaded often, like when rewinding
+        if (data && (resized || memcmp(save, data, size))) {
+            memcpy(save, data, size);
+            saveDirty = true;
+        }
+    }
+
+    mutex.unlock();
+}
+
 CartridgeNds::CartridgeNds(Core *core) : Cartridge(core) {
     // Prepare tasks to be used with the scheduler
     wordReadyTasks[0] = std::bind(&CartridgeNds::wordReady, this, 0);
@@ -130,7 +187,7 @@ bool CartridgeNds::loadRom(std::string path) {
     if (romSize <= 0x20000000) // 512MB
     {
         try {
-            loadRomSection(0, romSize);
+            loadRomShared();
             fclose(romFile);
             romFile = nullptr;
         }
@@ -173,6 +230,27 @@ bool CartridgeNds::loadRom(std::string path) {
     return res;
 }
 
+void CartridgeNds::syncState(State &state) {
+    // Sync the save and the transfer state
+    Cartridge::syncState(state);
+    state.var(cmdMode);
+    state.var(encTable);
+    state.var(encCode);
+    state.var(romAddrReal);
+    state.var(romAddrVirt);
+    state.var(blockSize);
+    state.var(readCount);
+    state.var(wordCycles);
+    state.var(encrypted);
+    state.var(auxCommand);
+    state.var(auxAddress);
+    state.var(auxWriteCount);
+    state.var(auxSpiCnt);
+    state.var(auxSpiData);
+    state.var(romCtrl);
+    state.var(romCmdOut);
+}
+
 void CartridgeNds::directBoot() {
     // Load the ROM header from file if needed
     if (romFile)
@@ -836,11 +914,23 @@ bool CartridgeGba::findString(std::string string) {
     return false;
 }
 
+void CartridgeGba::syncState(State &state) {
+    // Sync the save and the EEPROM and FLASH state
+    Cartridge::syncState(state);
+    state.var(eepromCount);
+    state.var(eepromCmd);
+    state.var(eepromData);
+    state.var(eepromDone);
+    state.var(flashCmd);
+    state.var(bankSwap);
+    state.var(flashErase);
+}
+
 bool CartridgeGba::loadRom(std::string path) {
     bool res = Cartridge::loadRom(path);
 
     // Load the ROM into memory
-    loadRomSection(0, romSize);
+    loadRomShared();
     fclose(romFile);
     romFile = nullptr;
 
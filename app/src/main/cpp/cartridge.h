@@ -3,6 +3,7 @@
 
 #include <cstdint>
 #include <functional>
+#include <memory>
 #include <mutex>
 #include <string>
 
@@ -10,6 +11,8 @@
 
 class Core;
 
+class State;
+
 enum NdsCmdMode {
     CMD_NONE = 0,
     CMD_HEADER,
@@ -26,6 +29,8 @@ public:
 
     virtual bool loadRom(std::string path);
 
+    virtual void syncState(State &state);
+
     void writeSave();
 
     void trimRom();
@@ -41,6 +46,7 @@ protected:
 
     FILE *romFile = nullptr;
     uint8_t *rom = nullptr, *save = nullptr;
+    std::shared_ptr<uint8_t[]> romData;
     int romSize = 0, saveSize = 0;
     bool saveDirty = false;
     std::mutex mutex;
@@ -49,6 +55,8 @@ protected:
 
     void loadRomSection(size_t offset, size_t size);
 
+    void loadRomShared();
+
 private:
     std::string romName, saveName;
 };
@@ -59,6 +67,8 @@ public:
 
     bool loadRom(std::string path);
 
+    void syncState(State &state);
+
     void directBoot();
 
     uint16_t readAuxSpiCnt(bool cpu) { return auxSpiCnt[cpu]; }
@@ -120,6 +130,8 @@ public:
 
     bool loadRom(std::string path);
 
+    void syncState(State &state);
+
     uint8_t *getRom(uint32_t address);
 
     bool isEeprom(uint32_t address);
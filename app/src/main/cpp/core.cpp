@@ -1,10 +1,16 @@
 #include <algorithm>
 #include <cstring>
 #include <thread>
+#include <sys/mman.h>
 
 #include "core.h"
 #include "settings.h"
 
+#define HUGE_PAGE_SIZE 0x200000
+#define STATE_MAGIC 0x54534453 // "DSST"
+#define STATE_VERSION 2
+#define MAX_GUEST_OPCODES 0x100000
+
 Core::Core(const std::string& ndsPath, const std::string& gbaPath, int id) :
         id(id),
         bios9(this),
@@ -23,11 +29,13 @@ Core::Core(const std::string& ndsPath, const std::string& gbaPath, int id) :
         interpreter{Interpreter(this, false), Interpreter(this, 1)},
         ipc(this),
         memory(this),
+        rewind(this),
         rtc(this),
         spi(this),
         spu(this),
+        stats(this),
         timers{Timers(this, false), Timers(this, true)},
-        wifi(this) {
+        wifi(this, id) {
     // Try to load the ARM9 BIOS; require it when not direct booting
     if (!memory.loadBios9() && (!Settings::getDirectBoot() || (ndsPath.empty() && gbaPath.empty())))
         throw ERROR_BIOS;
@@ -51,11 +59,14 @@ Core::Core(const std::string& ndsPath, const std::string& gbaPath, int id) :
     spu.scheduleInit();
 
     // Initialize the memory and CPUs
-    memory.updateMap9(0x00000000, 0xFFFFFFFF);
-    memory.updateMap7(0x00000000, 0xFFFFFFFF);
+    memory.initMaps();
     interpreter[0].init();
     interpreter[1].init();
 
+    // Use the run loop that records opcodes if instruction tracing is enabled
+    if (instrTrace.isEnabled())
+        runFunc = &Core::runNdsFrame<true>;
+
     if (!gbaPath.empty()) {
         // Load a GBA ROM
         if (!cartridgeGba.loadRom(gbaPath))
@@ -107,49 +118,146 @@ Core::Core(const std::string& ndsPath, const std::string& gbaPath, int id) :
     running.store(true);
 }
 
+void *Core::operator new(size_t size) {
+    // Allocate cores from anonymous mappings, which come from fresh zero pages without touching them
+    // This lets the memory maps skip explicit initialization, so their pages are only faulted in once used
+    size = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    uint8_t *mapping = (uint8_t*)mmap(nullptr, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED)
+        throw std::bad_alloc();
+
+    // Trim the mapping so the core starts on a huge page boundary
+    uint8_t *pointer = (uint8_t*)(((uintptr_t)mapping + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+    if (pointer > mapping)
+        munmap(mapping, pointer - mapping);
+    munmap(pointer + size, mapping + HUGE_PAGE_SIZE - pointer);
+
+#ifdef MADV_HUGEPAGE
+    // Request transparent huge pages for memory, page tables, and renderer buffers, which are accessed randomly
+    // This is only a hint, so regular pages are used if the host doesn't support or allow them
+    madvise(pointer, size, MADV_HUGEPAGE);
+#endif
+    return pointer;
+}
+
+void Core::operator delete(void *pointer, size_t size) {
+    // Unmap a core using the same rounded size it was mapped with
+    munmap(pointer, (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+}
+
 void Core::resetCycles() {
     // Reset the global cycle count periodically to prevent overflow
     for (auto & task : tasks)
         task.cycles -= globalCycles;
     arm9Cycles -= std::min(globalCycles, arm9Cycles);
     arm7Cycles -= std::min(globalCycles, arm7Cycles);
-    timers[0].resetCycles();
-    timers[1].resetCycles();
+    cycleBase += globalCycles;
     globalCycles -= globalCycles;
     schedule(Task(&resetCyclesTask, 0x7FFFFFFF));
 }
 
+void Core::runFrame() {
+    // Run a frame, then let rewind capture it between frames
+    // With run-ahead, the frame is still played but not shown, since a frame from further ahead will be
+    // Run-ahead is skipped while linked or with an SD image mounted, since loading the state afterward can't take
+    // back packets sent or received, or SD writes
+    TRACE_THREAD("Emulation");
+    int ahead = (wifi.isLinked() || dldi.isMounted()) ? 0 : std::max(Settings::getRunAhead(), 0);
+    gpu.setHidden(ahead > 0);
+    (this->*runFunc)();
+    rewind.update();
+    if (ahead > 0)
+        runAhead(ahead);
+}
+
+void Core::runAhead(int frames) {
+    TRACE_SCOPE("Core::runAhead");
+
+    // Save the state to return to, since frames run ahead are replayed for real later
+    saveState(aheadState);
+    runningAhead = true;
+    stats.setPaused(true);
+    spu.setMuted(true);
+    input.setFrozen(true);
+
+    // Run frames ahead with the latest input, only showing the last one
+    // Stop early if the frames link up or mount an SD image, for the same reasons run-ahead is skipped for them
+    for (int i = 1; i <= frames && !wifi.isLinked() && !dldi.isMounted(); i++) {
+        gpu.setHidden(i < frames);
+        (this->*runFunc)();
+    }
+
+    // Return to the saved state and resume normal output
+    runningAhead = false;
+    spu.setMuted(false);
+    input.setFrozen(false);
+
+    // Keep the main RAM blocks marked as written across the load, since the saved RAM only differs in ones written
+    // ahead, which are marked too; otherwise every rewind capture would have to compare all of it
+    // The stats stay paused through the load, since the 3D redraw it causes only exists for run-ahead
+    memory.setRamWrittenKept(true);
+    loadState(aheadState, true);
+    memory.setRamWrittenKept(false);
+    stats.setPaused(false);
+}
+
+template<bool traced>
 void Core::runGbaFrame() {
     // Run a frame in GBA mode
     while (running.exchange(true)) {
-        // Run the ARM7 until the next scheduled task
+        perfCounters.enter(PHASE_CPU);
+        TRACE_ENTER("CPU");
+
+        // Run the ARM7 until the next scheduled task, counting opcodes locally for the stats
+        uint32_t opcodes = 0;
         if (arm7Cycles > globalCycles) globalCycles = arm7Cycles;
-        while (interpreter[1].shouldRun() && tasks[0].cycles > arm7Cycles)
-            arm7Cycles = (globalCycles += interpreter[1].runOpcode());
+        while (interpreter[1].shouldRun() && tasks[0].cycles > arm7Cycles) {
+            arm7Cycles = (globalCycles += interpreter[1].runOpcode<traced>());
+            opcodes++;
+        }
 
         // Jump to the next scheduled task
         globalCycles = tasks[0].cycles;
+        perfCounters.enter(PHASE_SCHEDULER);
+        TRACE_ENTER("Tasks");
+        if (!runningAhead)
+            stats.countSlice(getTotalCycles(), false, !interpreter[1].shouldRun(), 0, opcodes);
 
         // Run all tasks that are scheduled now
         while (tasks[0].cycles <= globalCycles) {
             (*tasks[0].task)();
             tasks.erase(tasks.begin());
+            if (!runningAhead)
+                stats.countTask();
         }
     }
+
+    perfCounters.enter(PHASE_NONE);
+    TRACE_ENTER(nullptr);
 }
 
+template<bool traced>
 void Core::runNdsFrame() {
     // Run a frame in NDS mode
     while (running.exchange(true)) {
-        // Run the CPUs until the next scheduled task
+        perfCounters.enter(PHASE_CPU);
+        TRACE_ENTER("CPU");
+
+        // Run the CPUs until the next scheduled task, counting opcodes locally for the stats
+        uint32_t opcodes9 = 0, opcodes7 = 0;
         while (tasks[0].cycles > globalCycles) {
             // Run the ARM9
-            if (interpreter[0].shouldRun() && globalCycles >= arm9Cycles)
-                arm9Cycles = globalCycles + interpreter[0].runOpcode();
+            if (interpreter[0].shouldRun() && globalCycles >= arm9Cycles) {
+                arm9Cycles = globalCycles + interpreter[0].runOpcode<traced>();
+                opcodes9++;
+            }
 
             // Run the ARM7 at half the speed of the ARM9
-            if (interpreter[1].shouldRun() && globalCycles >= arm7Cycles)
-                arm7Cycles = globalCycles + (interpreter[1].runOpcode() << 1);
+            if (interpreter[1].shouldRun() && globalCycles >= arm7Cycles) {
+                arm7Cycles = globalCycles + (interpreter[1].runOpcode<traced>() << 1);
+                opcodes7++;
+            }
 
             // Count cycles up to the next soonest event
             globalCycles = std::min<uint32_t>((interpreter[0].shouldRun() ? arm9Cycles : -1),
@@ -158,13 +266,23 @@ void Core::runNdsFrame() {
 
         // Jump to the next scheduled task
         globalCycles = tasks[0].cycles;
+        perfCounters.enter(PHASE_SCHEDULER);
+        TRACE_ENTER("Tasks");
+        if (!runningAhead)
+            stats.countSlice(getTotalCycles(), !interpreter[0].shouldRun(), !interpreter[1].shouldRun(),
+                             opcodes9, opcodes7);
 
         // Run all tasks that are scheduled now
         while (tasks[0].cycles <= globalCycles) {
             (*tasks[0].task)();
             tasks.erase(tasks.begin());
+            if (!runningAhead)
+                stats.countTask();
         }
     }
+
+    perfCounters.enter(PHASE_NONE);
+    TRACE_ENTER(nullptr);
 }
 
 void Core::schedule(Task task) {
@@ -177,7 +295,7 @@ void Core::schedule(Task task) {
 void Core::enterGbaMode() {
     // Switch to GBA mode
     gbaMode = true;
-    runFunc = &Core::runGbaFrame;
+    runFunc = instrTrace.isEnabled() ? &Core::runGbaFrame<true> : &Core::runGbaFrame<false>;
     running.store(false);
 
     // Reset the scheduler and schedule initial tasks for GBA mode
@@ -198,10 +316,129 @@ void Core::enterGbaMode() {
     memory.write<uint8_t>(false, 0x4000241, 0x80); // VRAMCNT_B
 }
 
+void Core::saveState(State &state, bool memory) {
+    // Write a header to identify the state, followed by the state of the whole system
+    state.startSave(memory);
+    uint32_t magic = STATE_MAGIC, version = STATE_VERSION;
+    uint64_t size = 0;
+    state.var(magic);
+    state.var(version);
+    state.var(gbaMode);
+    state.var(memory);
+    size_t sizeOffset = state.block(&size, sizeof(size)) - state.getData();
+    syncState(state);
+
+    // Fill in the total size, so truncated states can be rejected before loading
+    size = state.getSize();
+    memcpy(state.getData() + sizeOffset, &size, sizeof(size));
+}
+
+bool Core::checkState(State &state, uint64_t &size) {
+    // Check that the state matches this core and isn't truncated before loading anything
+    // States can't be loaded across a switch to GBA mode, since the system is set up differently
+    // States can be padded past their size, like rewind does to compare them word by word
+    state.startLoad();
+    uint32_t magic = 0, version = 0;
+    bool mode = false, memory = false;
+    state.var(magic);
+    state.var(version);
+    state.var(mode);
+    state.var(memory);
+    state.var(size);
+    return state.isValid() && magic == STATE_MAGIC && version == STATE_VERSION && mode == gbaMode &&
+           memory == state.hasMemory() && size <= state.getSize();
+}
+
+bool Core::loadState(State &state, bool trusted) {
+    uint64_t size;
+    if (!checkState(state, size))
+        return false;
+
+    // Let the 3D renderer finish with the current state before it changes
+    gpu3DRenderer.joinThreads();
+
+    // Load states this core just saved directly, since they can't be corrupt
+    if (trusted) {
+        syncState(state);
+        return state.isValid();
+    }
+
+    // Back up the current state first, so it can be restored if the state turns out to be corrupt partway through
+    // A state that loads fully must also end exactly at its size
+    saveState(backupState, state.hasMemory());
+    syncState(state);
+    if (state.isValid() && state.getOffset() == size)
+        return true;
+
+    LOG("Failed to load state, restoring the previous one\n");
+    checkState(backupState, size);
+    syncState(backupState);
+    return false;
+}
+
+void Core::syncState(State &state) {
+    // Sync the cycle counts
+    state.var(globalCycles);
+    state.var(cycleBase);
+    state.var(arm9Cycles);
+    state.var(arm7Cycles);
+
+    // Sync the components, with memory first so the others can update the memory maps over it
+    memory.syncState(state);
+    cp15.syncState(state);
+    interpreter[0].syncState(state);
+    interpreter[1].syncState(state);
+    bios9.syncState(state);
+    bios7.syncState(state);
+    cartridgeNds.syncState(state);
+    cartridgeGba.syncState(state);
+    dma[0].syncState(state);
+    dma[1].syncState(state);
+    timers[0].syncState(state);
+    timers[1].syncState(state);
+    ipc.syncState(state);
+    divSqrt.syncState(state);
+    rtc.syncState(state);
+    spi.syncState(state);
+    spu.syncState(state);
+    wifi.syncState(state);
+    gpu2D[0].syncState(state);
+    gpu2D[1].syncState(state);
+    gpu3D.syncState(state);
+    gpu3DRenderer.syncState(state);
+
+    // Sync the scheduled tasks and 3D buffers near the end, since their sizes vary and would shift everything after them
+    // Task functions are core members, so they're stored as offsets that point into any core
+    // Counts that don't fit in the rest of the state and offsets outside the core are rejected
+    uint32_t count = tasks.size();
+    state.var(count);
+    if (!state.isSaving() && state.isValid()) {
+        if (count > (state.getSize() - state.getOffset()) / (sizeof(uint32_t) * 2))
+            state.invalidate();
+        else
+            tasks.resize(count, Task(nullptr, 0));
+    }
+    for (auto &task: tasks) {
+        uint32_t offset = (uint8_t*)task.task - (uint8_t*)this;
+        state.var(offset);
+        state.var(task.cycles);
+        if (offset > sizeof(Core) - sizeof(std::function<void()>)) {
+            state.invalidate();
+            offset = 0;
+        }
+        task.task = (std::function<void()>*)((uint8_t*)this + offset);
+    }
+    gpu3D.syncBuffers(state);
+
+    // Sync the GPU last, since it redraws 3D using the other graphics state
+    gpu.syncState(state);
+}
+
 void Core::endFrame() {
-    // Break execution at the end of a frame and count it
+    // Break execution at the end of a frame and count it, leaving out extra frames from run-ahead
     running.store(false);
-    fpsCount++;
+    if (!runningAhead) fpsCount++;
+    perfCounters.endFrame();
 
     // Update the FPS and reset the counter every second
     std::chrono::duration<double> fpsTime = std::chrono::steady_clock::now() - lastFpsTime;
@@ -211,12 +448,29 @@ void Core::endFrame() {
         lastFpsTime = std::chrono::steady_clock::now();
     }
 
-    // Schedule WiFi updates only when needed
+    // Update the stats, which are published on their own period and only cover frames that are shown
+    if (!runningAhead)
+        stats.endFrame();
+
+    // Schedule WiFi updates only when needed, and wake them for packets that arrived while idle
+    // Peers in other processes are checked first, since they decide whether the core is linked
+    wifi.updatePeers();
     if (wifi.shouldSchedule())
         wifi.scheduleInit();
+    else
+        wifi.checkPackets();
 }
 
+template<bool traced>
 FORCE_INLINE int Interpreter::runOpcode() {
+    if (traced) {
+        // Record the opcode about to run, then run it with the variant that doesn't record
+        // The program counter is a fetch ahead of the opcode here, and the mode includes the THUMB bit
+        uint32_t pc = *registers[15] - ((cpsr & BIT(5)) ? 2 : 4);
+        core->instrTrace.record(cpu, pc, pipeline[0], cpsr & 0x3F, core->getTotalCycles());
+        return runOpcode<false>();
+    }
+
     // Push the next opcode through the pipeline
     uint32_t opcode = pipeline[0];
     pipeline[0] = pipeline[1];
@@ -244,3 +498,40 @@ FORCE_INLINE int Interpreter::runOpcode() {
         }
     }
 }
+
+uint32_t Interpreter::callGuest(uint32_t address, uint32_t arg0, uint32_t arg1, uint32_t arg2) {
+    // Save the state the call will change, since HLE BIOS functions run in the middle of an opcode
+    uint32_t saved[16];
+    uint32_t savedCpsr = cpsr;
+    uint32_t savedPipeline[2] = { pipeline[0], pipeline[1] };
+    for (int i = 0; i < 16; i++)
+        saved[i] = *registers[i];
+
+    // Jump to the function with the arguments, returning to an address in HLE BIOS that's never executed
+    uint32_t ret = (cpu ? 0x00000000 : 0xFFFF0000) + 4;
+    *registers[0] = arg0;
+    *registers[1] = arg1;
+    *registers[2] = arg2;
+    *registers[14] = ret;
+    *registers[15] = address;
+    cpsr = (cpsr & ~BIT(5)) | ((address & 1) << 5);
+    flushPipeline();
+
+    // Run the function until it returns, giving up on ones that never do
+    for (int i = 0; *registers[15] - ((cpsr & BIT(5)) ? 2 : 4) != ret; i++) {
+        if (i == MAX_GUEST_OPCODES) {
+            LOG("ARM%d function at 0x%X called from HLE BIOS never returned\n", (cpu ? 7 : 9), address);
+            break;
+        }
+        runOpcode<false>();
+    }
+
+    // Restore the caller's state and return the function's result
+    uint32_t result = *registers[0];
+    setCpsr(savedCpsr);
+    for (int i = 0; i < 16; i++)
+        *registers[i] = saved[i];
+    pipeline[0] = savedPipeline[0];
+    pipeline[1] = savedPipeline[1];
+    return result;
+}
@@ -19,13 +19,19 @@
 #include "gpu_3d.h"
 #include "gpu_3d_renderer.h"
 #include "input.h"
+#include "instr_trace.h"
 #include "interpreter.h"
 #include "ipc.h"
 #include "memory.h"
+#include "perf_counters.h"
+#include "rewind.h"
 #include "rtc.h"
 #include "spi.h"
 #include "spu.h"
+#include "state.h"
+#include "stats.h"
 #include "timers.h"
+#include "trace.h"
 #include "wifi.h"
 
 enum CoreError {
@@ -47,7 +53,11 @@ class Core {
 public:
     Core(const std::string& ndsPath = "", const std::string& gbaPath = "", int id = 0);
 
-    void runFrame() { (this->*runFunc)(); }
+    static void *operator new(size_t size);
+
+    static void operator delete(void *pointer, size_t size);
+
+    void runFrame();
 
     bool isGbaMode() { return gbaMode; }
 
@@ -59,12 +69,20 @@ public:
 
     uint32_t getGlobalCycles() { return globalCycles; }
 
+    uint64_t getTotalCycles() { return cycleBase + globalCycles; }
+
     void schedule(Task task);
 
     void enterGbaMode();
 
     void endFrame();
 
+    void breakExecution() { running.store(false); }
+
+    void saveState(State &state, bool memory = true);
+
+    bool loadState(State &state, bool trusted = false);
+
     Bios9 bios9;
     Bios7 bios7;
     CartridgeNds cartridgeNds;
@@ -78,26 +96,34 @@ public:
     Gpu3D gpu3D;
     Gpu3DRenderer gpu3DRenderer;
     Input input;
+    InstrTrace instrTrace;
     Interpreter interpreter[2];
     Ipc ipc;
     Memory memory;
+    PerfCounters perfCounters;
+    Rewind rewind;
     Rtc rtc;
     Spi spi;
     Spu spu;
+    Stats stats;
     Timers timers[2];
     Wifi wifi;
 
 private:
-    void (Core::*runFunc)() = &Core::runNdsFrame;
+    void (Core::*runFunc)() = &Core::runNdsFrame<false>;
 
     bool gbaMode = false;
     int id = 0;
 
     std::vector<Task> tasks;
     uint32_t globalCycles = 0;
+    uint64_t cycleBase = 0;
     uint32_t arm9Cycles = 0, arm7Cycles = 0;
 
     std::atomic<bool> running;
+    bool runningAhead = false;
+    State aheadState;
+    State backupState; // State from before the last load, restored if that load failed
     int fps = 0, fpsCount = 0;
     std::chrono::steady_clock::time_point lastFpsTime;
 
@@ -105,8 +131,16 @@ private:
 
     void resetCycles();
 
+    bool checkState(State &state, uint64_t &size);
+
+    void syncState(State &state);
+
+    void runAhead(int frames);
+
+    template<bool traced>
     void runNdsFrame();
 
+    template<bool traced>
     void runGbaFrame();
 };
 
@@ -0,0 +1,199 @@
+#include <algorithm>
+
+#include "core_group.h"
+#include "core.h"
+
+CoreGroup::CoreGroup(int threadCount) {
+    // Default to one worker per hardware thread
+    if (threadCount <= 0)
+        threadCount = std::max<int>(std::thread::hardware_concurrency(), 1);
+
+    // Start the workers, which sleep until there are frames to run
+    for (int i = 0; i < threadCount; i++)
+        workers.push_back(std::make_unique<Worker>());
+    for (int i = 0; i < threadCount; i++)
+        workers[i]->thread = std::thread(&CoreGroup::runWorker, this, i);
+}
+
+CoreGroup::~CoreGroup() {
+    // Stop the workers
+    mutex.lock();
+    stopping = true;
+    taskCond.notify_all();
+    mutex.unlock();
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i]->thread.join();
+
+    // Free the cores, which also unlinks them
+    for (size_t i = 0; i < members.size(); i++)
+        delete members[i].core;
+}
+
+Core *CoreGroup::addCore(const std::string &ndsPath, const std::string &gbaPath) {
+    // Use the lowest free instance ID, so cores get unique MAC addresses and save files
+    int id = 0;
+    while (std::any_of(members.begin(), members.end(), [&](Member &m) { return m.core->getId() == id; }))
+        id++;
+
+    // Create the core; this throws a CoreError on failure like a standalone core would
+    // Read-only BIOS and ROM images are shared with other cores that load the same files
+    Core *core = new Core(ndsPath, gbaPath, id);
+    members.push_back({core, {}, 0});
+    return core;
+}
+
+void CoreGroup::remCore(Core *core) {
+    // Find the core in the group
+    auto position = std::find_if(members.begin(), members.end(), [&](Member &m) { return m.core == core; });
+    if (position == members.end()) return;
+    size_t index = position - members.begin();
+
+    // Unlink the core from any others and fix up the remaining link indices
+    for (size_t i = 0; i < members.size(); i++) {
+        std::vector<size_t> &links = members[i].links;
+        if (std::find(links.begin(), links.end(), index) != links.end()) {
+            core->wifi.remConnection(members[i].core);
+            links.erase(std::find(links.begin(), links.end(), index));
+        }
+        for (size_t j = 0; j < links.size(); j++)
+            if (links[j] > index) links[j]--;
+    }
+
+    // Remove and free the core
+    members.erase(position);
+    delete core;
+}
+
+void CoreGroup::linkCores(Core *core1, Core *core2) {
+    // Find both cores in the group
+    auto find = [&](Core *core) {
+        return std::find_if(members.begin(), members.end(), [&](Member &m) { return m.core == core; }) - members.begin();
+    };
+    size_t index1 = find(core1), index2 = find(core2);
+    if (index1 == members.size() || index2 == members.size() || index1 == index2) return;
+
+    // Connect the cores over WiFi and remember the link for frame synchronization
+    core1->wifi.addConnection(core2);
+    members[index1].links.push_back(index2);
+    members[index2].links.push_back(index1);
+}
+
+void CoreGroup::buildSets() {
+    // Group cores that are linked directly or indirectly into sets that advance together
+    sets.clear();
+    std::vector<bool> visited(members.size());
+    for (size_t i = 0; i < members.size(); i++) {
+        if (visited[i]) continue;
+        sets.push_back(std::make_unique<CoreSet>());
+        std::vector<size_t> stack = {i};
+        visited[i] = true;
+
+        while (!stack.empty()) {
+            size_t index = stack.back();
+            stack.pop_back();
+            members[index].set = sets.size() - 1;
+            sets.back()->cores.push_back(index);
+            for (size_t link : members[index].links) {
+                if (visited[link]) continue;
+                visited[link] = true;
+                stack.push_back(link);
+            }
+        }
+    }
+}
+
+void CoreGroup::runFrames(int count) {
+    if (members.empty() || count <= 0) return;
+    buildSets();
+
+    // Queue the first frame of every core, spread across the workers
+    mutex.lock();
+    frameCount = count;
+    activeSets = sets.size();
+    mutex.unlock();
+    for (size_t i = 0; i < sets.size(); i++) {
+        sets[i]->remaining.store(sets[i]->cores.size());
+        sets[i]->frame = 0;
+    }
+    for (size_t i = 0; i < members.size(); i++)
+        pushTask(i % workers.size(), i);
+
+    // Wait for every set to finish its frames
+    std::unique_lock<std::mutex> lock(mutex);
+    doneCond.wait(lock, [&] { return activeSets == 0; });
+}
+
+void CoreGroup::pushTask(size_t worker, size_t index) {
+    // Add a core's frame to a worker's queue and wake a sleeping worker to run or steal it
+    workers[worker]->mutex.lock();
+    workers[worker]->tasks.push_back(index);
+    workers[worker]->mutex.unlock();
+
+    mutex.lock();
+    queued++;
+    taskCond.notify_one();
+    mutex.unlock();
+}
+
+bool CoreGroup::popTask(size_t worker, size_t &index) {
+    // Take the newest task from this worker's queue, or steal the oldest task from another's
+    for (size_t i = 0; i < workers.size(); i++) {
+        Worker *w = workers[(worker + i) % workers.size()].get();
+        std::lock_guard<std::mutex> guard(w->mutex);
+        if (w->tasks.empty()) continue;
+
+        if (i == 0) {
+            index = w->tasks.back();
+            w->tasks.pop_back();
+        } else {
+            index = w->tasks.front();
+            w->tasks.pop_front();
+        }
+
+        mutex.lock();
+        queued--;
+        mutex.unlock();
+        return true;
+    }
+
+    return false;
+}
+
+void CoreGroup::runTask(size_t worker, size_t index) {
+    // Run a frame on the core
+    members[index].core->runFrame();
+
+    // Wait for the rest of the core's set to finish the frame before queueing the next one
+    CoreSet &set = *sets[members[index].set];
+    if (set.remaining.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+
+    if (++set.frame < frameCount) {
+        // Queue the next frame for every core in the set, letting idle workers steal them
+        set.remaining.store(set.cores.size(), std::memory_order_relaxed);
+        for (size_t i = 0; i < set.cores.size(); i++)
+            pushTask(worker, set.cores[i]);
+    } else {
+        // Signal completion once every set has run all its frames
+        mutex.lock();
+        if (--activeSets == 0)
+            doneCond.notify_all();
+        mutex.unlock();
+    }
+}
+
+void CoreGroup::runWorker(size_t worker) {
+    while (true) {
+        // Run tasks until none are left to take
+        size_t index;
+        if (popTask(worker, index)) {
+            runTask(worker, index);
+            continue;
+        }
+
+        // Sleep until more tasks are queued or the group is destroyed
+        std::unique_lock<std::mutex> lock(mutex);
+        taskCond.wait(lock, [&] { return queued > 0 || stopping; });
+        if (stopping) return;
+    }
+}
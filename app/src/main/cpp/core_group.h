@@ -0,0 +1,76 @@
+#ifndef CORE_GROUP_H
+#define CORE_GROUP_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Core;
+
+// Runs multiple cores on a work-stealing thread pool, one frame per task
+// Cores linked by WiFi advance together, so none starts a frame until the others have finished theirs
+class CoreGroup {
+public:
+    CoreGroup(int threadCount = 0);
+
+    ~CoreGroup();
+
+    Core *addCore(const std::string &ndsPath = "", const std::string &gbaPath = "");
+
+    void remCore(Core *core);
+
+    void linkCores(Core *core1, Core *core2);
+
+    void runFrames(int count = 1);
+
+    size_t getCount() { return members.size(); }
+
+    Core *getCore(size_t index) { return members[index].core; }
+
+private:
+    struct Member {
+        Core *core;
+        std::vector<size_t> links;
+        size_t set;
+    };
+
+    struct CoreSet {
+        std::vector<size_t> cores;
+        std::atomic<int> remaining{0};
+        int frame = 0;
+    };
+
+    struct Worker {
+        std::deque<size_t> tasks;
+        std::mutex mutex;
+        std::thread thread;
+    };
+
+    std::vector<Member> members;
+    std::vector<std::unique_ptr<CoreSet>> sets;
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    std::mutex mutex;
+    std::condition_variable taskCond, doneCond;
+    int queued = 0, activeSets = 0;
+    int frameCount = 0;
+    bool stopping = false;
+
+    void buildSets();
+
+    void pushTask(size_t worker, size_t index);
+
+    bool popTask(size_t worker, size_t &index);
+
+    void runTask(size_t worker, size_t index);
+
+    void runWorker(size_t worker);
+};
+
+#endif // CORE_GROUP_H
@@ -89,3 +89,29 @@ void Cp15::write(int cn, int cm, int cp, uint32_t value) {
         }
     }
 }
+
+void Cp15::syncState(State &state) {
+    uint32_t dtcmAddrOld = dtcmAddr;
+    uint32_t dtcmSizeOld = dtcmSize;
+    uint32_t itcmSizeOld = itcmSize;
+
+    // Sync the registers and the TCM settings derived from them
+    state.var(ctrlReg);
+    state.var(dtcmReg);
+    state.var(itcmReg);
+    state.var(exceptionAddr);
+    state.var(dtcmReadEnabled);
+    state.var(dtcmWriteEnabled);
+    state.var(itcmReadEnabled);
+    state.var(itcmWriteEnabled);
+    state.var(dtcmAddr);
+    state.var(dtcmSize);
+    state.var(itcmSize);
+
+    if (!state.isSaving()) {
+        // Update the memory map at the old and new TCM locations
+        core->memory.updateMap9(dtcmAddrOld, dtcmAddrOld + dtcmSizeOld);
+        core->memory.updateMap9(dtcmAddr, dtcmAddr + dtcmSize);
+        core->memory.updateMap9(0x00000000, std::max(itcmSizeOld, itcmSize));
+    }
+}
@@ -5,6 +5,8 @@
 
 class Core;
 
+class State;
+
 class Cp15 {
 public:
     Cp15(Core *core) : core(core) {}
@@ -13,6 +15,8 @@ public:
 
     void write(int cn, int cm, int cp, uint32_t value);
 
+    void syncState(State &state);
+
     uint32_t getExceptionAddr() { return exceptionAddr; }
 
     bool getDtcmReadEnabled() { return dtcmReadEnabled; }
@@ -0,0 +1,56 @@
+#include "crc16.h"
+
+// Lookup tables for slicing-by-8, generated at compile time
+// The first table is the usual bytewise CRC table, built from the bitwise algorithm the BIOS uses
+struct Crc16Tables {
+    uint16_t table[8][0x100] = {};
+
+    constexpr Crc16Tables() {
+        const uint16_t values[] = {0xC0C1, 0xC181, 0xC301, 0xC601, 0xCC01, 0xD801, 0xF001, 0xA001};
+
+        for (uint32_t i = 0; i < 0x100; i++) {
+            uint32_t crc = i;
+            for (int j = 0; j < 8; j++)
+                crc = (crc >> 1) ^ ((crc & 1) ? (values[j] << (7 - j)) : 0);
+            table[0][i] = crc;
+        }
+
+        for (int t = 1; t < 8; t++) {
+            for (uint32_t i = 0; i < 0x100; i++)
+                table[t][i] = (table[t - 1][i] >> 8) ^ table[0][table[t - 1][i] & 0xFF];
+        }
+    }
+};
+
+static constexpr Crc16Tables tables;
+
+uint32_t Crc16::update(uint32_t value, uint8_t data) {
+    // Add a single byte to a CRC16 value
+    return (value >> 8) ^ tables.table[0][(value ^ data) & 0xFF];
+}
+
+uint32_t Crc16::calculate(uint32_t value, const uint8_t *data, size_t size) {
+    // Process bytes one at a time until the value fits in 16 bits
+    // The BIOS allows larger starting values, and their upper bits just shift down
+    while (size > 0 && value > 0xFFFF) {
+        value = update(value, *data++);
+        size--;
+    }
+
+    // Process 8 bytes at a time
+    while (size >= 8) {
+        uint32_t crc = value ^ (data[0] | (data[1] << 8));
+        value = tables.table[7][crc & 0xFF] ^ tables.table[6][crc >> 8] ^
+                tables.table[5][data[2]] ^ tables.table[4][data[3]] ^
+                tables.table[3][data[4]] ^ tables.table[2][data[5]] ^
+                tables.table[1][data[6]] ^ tables.table[0][data[7]];
+        data += 8;
+        size -= 8;
+    }
+
+    // Process the remaining bytes
+    while (size-- > 0)
+        value = update(value, *data++);
+
+    return value;
+}
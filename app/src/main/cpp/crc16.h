@@ -0,0 +1,17 @@
+#ifndef CRC16_H
+#define CRC16_H
+
+#include <cstddef>
+#include <cstdint>
+
+class Crc16 {
+public:
+    static uint32_t calculate(uint32_t value, const uint8_t *data, size_t size);
+
+    static uint32_t update(uint32_t value, uint8_t data);
+
+private:
+    Crc16() {} // Private to prevent instantiation
+};
+
+#endif // CRC16_H
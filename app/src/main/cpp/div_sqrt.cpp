@@ -1,9 +1,26 @@
+#include <algorithm>
 #include <cmath>
 
 #include "div_sqrt.h"
 #include "core.h"
 
+void DivSqrt::syncState(State &state) {
+    // Sync the registers, including results that haven't been calculated yet
+    state.var(divCnt);
+    state.var(divNumer);
+    state.var(divDenom);
+    state.var(divResult);
+    state.var(divRemResult);
+    state.var(sqrtCnt);
+    state.var(sqrtResult);
+    state.var(sqrtParam);
+    state.var(divDirty);
+    state.var(sqrtDirty);
+}
+
 void DivSqrt::divide() {
+    divDirty = false;
+
     // Set the division by zero error bit
     // The bit only gets set if the full 64-bit denominator is zero, even in 32-bit mode
     if (divDenom == 0) divCnt |= BIT(14); else divCnt &= ~BIT(14);
@@ -66,17 +83,19 @@ void DivSqrt::divide() {
 }
 
 void DivSqrt::squareRoot() {
-    // Calculate the square root result
-    switch (sqrtCnt & 0x0001) // Square root mode
-    {
-        case 0: // 32-bit
-            sqrtResult = sqrt((uint32_t) sqrtParam);
-            break;
+    sqrtDirty = false;
 
-        case 1: // 64-bit
-            sqrtResult = sqrtl(sqrtParam);
-            break;
-    }
+    // Get the square root parameter for the current mode
+    uint64_t param = (sqrtCnt & 0x0001) ? sqrtParam : (uint32_t) sqrtParam; // 64-bit : 32-bit
+
+    // Estimate the square root, then correct it to the exact integer result
+    uint64_t result = std::min<uint64_t>(sqrt((double) param), 0xFFFFFFFF);
+    while (result * result > param)
+        result--;
+    while (result < 0xFFFFFFFF && (result + 1) * (result + 1) <= param)
+        result++;
+
+    sqrtResult = result;
 }
 
 void DivSqrt::writeDivCnt(uint16_t mask, uint16_t value) {
@@ -84,35 +103,35 @@ void DivSqrt::writeDivCnt(uint16_t mask, uint16_t value) {
     mask &= 0x0003;
     divCnt = (divCnt & ~mask) | (value & mask);
 
-    divide();
+    divDirty = true;
 }
 
 void DivSqrt::writeDivNumerL(uint32_t mask, uint32_t value) {
     // Write to the DIVNUMER register
     divNumer = (divNumer & ~((uint64_t) mask)) | (value & mask);
 
-    divide();
+    divDirty = true;
 }
 
 void DivSqrt::writeDivNumerH(uint32_t mask, uint32_t value) {
     // Write to the DIVNUMER register
     divNumer = (divNumer & ~((uint64_t) mask << 32)) | ((uint64_t) (value & mask) << 32);
 
-    divide();
+    divDirty = true;
 }
 
 void DivSqrt::writeDivDenomL(uint32_t mask, uint32_t value) {
     // Write to the DIVDENOM register
     divDenom = (divDenom & ~((uint64_t) mask)) | (value & mask);
 
-    divide();
+    divDirty = true;
 }
 
 void DivSqrt::writeDivDenomH(uint32_t mask, uint32_t value) {
     // Write to the DIVDENOM register
     divDenom = (divDenom & ~((uint64_t) mask << 32)) | ((uint64_t) (value & mask) << 32);
 
-    divide();
+    divDirty = true;
 }
 
 void DivSqrt::writeSqrtCnt(uint16_t mask, uint16_t value) {
@@ -120,19 +139,19 @@ void DivSqrt::writeSqrtCnt(uint16_t mask, uint16_t value) {
     mask &= 0x0001;
     sqrtCnt = (sqrtCnt & ~mask) | (value & mask);
 
-    squareRoot();
+    sqrtDirty = true;
 }
 
 void DivSqrt::writeSqrtParamL(uint32_t mask, uint32_t value) {
     // Write to the DIVDENOM register
     sqrtParam = (sqrtParam & ~((uint64_t) mask)) | (value & mask);
 
-    squareRoot();
+    sqrtDirty = true;
 }
 
 void DivSqrt::writeSqrtParamH(uint32_t mask, uint32_t value) {
     // Write to the SQRTPARAM register
     sqrtParam = (sqrtParam & ~((uint64_t) mask << 32)) | ((uint64_t) (value & mask) << 32);
 
-    squareRoot();
+    sqrtDirty = true;
 }
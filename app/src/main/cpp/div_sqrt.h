@@ -3,13 +3,19 @@
 
 #include <cstdint>
 
+#include "defines.h"
+
 class Core;
 
+class State;
+
 class DivSqrt {
 public:
     DivSqrt(Core *core) : core(core) {}
 
-    uint16_t readDivCnt() { return divCnt; }
+    void syncState(State &state);
+
+    uint16_t readDivCnt();
 
     uint32_t readDivNumerL() { return divNumer; }
 
@@ -19,17 +25,17 @@ public:
 
     uint32_t readDivDenomH() { return divDenom >> 32; }
 
-    uint32_t readDivResultL() { return divResult; }
+    uint32_t readDivResultL();
 
-    uint32_t readDivResultH() { return divResult >> 32; }
+    uint32_t readDivResultH();
 
-    uint32_t readDivRemResultL() { return divRemResult; }
+    uint32_t readDivRemResultL();
 
-    uint32_t readDivRemResultH() { return divRemResult >> 32; }
+    uint32_t readDivRemResultH();
 
     uint16_t readSqrtCnt() { return sqrtCnt; }
 
-    uint32_t readSqrtResult() { return sqrtResult; }
+    uint32_t readSqrtResult();
 
     uint32_t readSqrtParamL() { return sqrtParam; }
 
@@ -64,9 +70,44 @@ private:
     uint32_t sqrtResult = 0;
     uint64_t sqrtParam = 0;
 
+    // Results are only calculated when read after their inputs change
+    bool divDirty = false;
+    bool sqrtDirty = false;
+
     void divide();
 
     void squareRoot();
 };
 
+FORCE_INLINE uint16_t DivSqrt::readDivCnt() {
+    // Update the division result, which sets the division by zero error bit
+    if (divDirty) divide();
+    return divCnt;
+}
+
+FORCE_INLINE uint32_t DivSqrt::readDivResultL() {
+    if (divDirty) divide();
+    return divResult;
+}
+
+FORCE_INLINE uint32_t DivSqrt::readDivResultH() {
+    if (divDirty) divide();
+    return divResult >> 32;
+}
+
+FORCE_INLINE uint32_t DivSqrt::readDivRemResultL() {
+    if (divDirty) divide();
+    return divRemResult;
+}
+
+FORCE_INLINE uint32_t DivSqrt::readDivRemResultH() {
+    if (divDirty) divide();
+    return divRemResult >> 32;
+}
+
+FORCE_INLINE uint32_t DivSqrt::readSqrtResult() {
+    if (sqrtDirty) squareRoot();
+    return sqrtResult;
+}
+
 #endif // DIV_SQRT_H
@@ -1,11 +1,22 @@
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <vector>
+
 #include "dldi.h"
 #include "core.h"
 #include "settings.h"
 
+// Maximum number of 4KB blocks to read at once on sequential access
+#define READ_AHEAD 8
+
 Dldi::~Dldi() {
     // Ensure the SD image is closed
-    if (sdImage)
-        fclose(sdImage);
+    shutdown();
 }
 
 void Dldi::patchRom(uint8_t *rom, size_t offset, size_t size) {
@@ -23,6 +34,12 @@ void Dldi::patchRom(uint8_t *rom, size_t offset, size_t size) {
                 goto next;
         }
 
+        // Skip drivers that were already patched, like in a ROM shared with another instance
+        if ((uint32_t)U8TO32(rom, i + 0x80) == DLDI_START) {
+            patched = true;
+            continue;
+        }
+
         // Patch the DLDI driver to use the HLE functions
         rom[i + 0x0F] = 0x0E;                     // Size of driver in terms of 1 << n (16KB)
         uint32_t address = U8TO32(rom, i + 0x40); // Address of driver
@@ -48,64 +65,318 @@ void Dldi::patchRom(uint8_t *rom, size_t offset, size_t size) {
 }
 
 int Dldi::startup() {
-    // Try to open the SD image
-    sdImage = fopen(Settings::getSdImagePath().c_str(), "rb+");
-    return (sdImage ? 1 : 0);
+    // Close the SD image if it was already opened
+    shutdown();
+
+    // Try to open the SD image, and get its size
+    sdImage = open(Settings::getSdImagePath().c_str(), O_RDWR);
+    if (sdImage < 0) return 0;
+    struct stat st;
+    imageSize = (fstat(sdImage, &st) == 0) ? st.st_size : 0;
+
+    // Map the whole SD image into memory if enabled, falling back to file I/O on failure
+    // Images too big for the address space, like ones over 4GB on 32-bit hosts, always use file I/O
+    if (Settings::getSdImageMapped() && imageSize > 0 && (uint64_t)imageSize <= SIZE_MAX) {
+        void *map = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, sdImage, 0);
+        if (map != MAP_FAILED) {
+            sdMap = (uint8_t*)map;
+            sdSize = st.st_size;
+        }
+    }
+
+    // Set up the block cache when not using a mapping
+    cacheLimit = sdMap ? 0 : (std::max(Settings::getSdCacheSize(), 0) >> 2);
+    nextBlock = -1;
+    return 1;
 }
 
 int Dldi::isInserted() {
     // Check if the SD image is opened
-    return (sdImage ? 1 : 0);
+    return (sdImage >= 0 ? 1 : 0);
+}
+
+bool Dldi::readFile(uint8_t *data, off_t offset, size_t size) {
+    // Read data from the SD image file, reading zeros past the end
+    while (size > 0) {
+        ssize_t count = pread(sdImage, data, size, offset);
+        if (count < 0) return false;
+        if (count == 0) {
+            memset(data, 0, size);
+            break;
+        }
+        data += count;
+        offset += count;
+        size -= count;
+    }
+
+    return true;
+}
+
+bool Dldi::writeFile(const uint8_t *data, off_t offset, size_t size) {
+    // Write data to the SD image file
+    while (size > 0) {
+        ssize_t count = pwrite(sdImage, data, size, offset);
+        if (count <= 0) return false;
+        data += count;
+        offset += count;
+        size -= count;
+    }
+
+    return true;
+}
+
+SdBlock *Dldi::loadBlock(uint32_t index, bool fill) {
+    // Move a cached block to the front of the LRU list and return it
+    auto it = cacheMap.find(index);
+    if (it != cacheMap.end()) {
+        cache.splice(cache.begin(), cache, it->second);
+        nextBlock = index + 1;
+        cacheHits++;
+        return &cache.front();
+    }
+
+    // Read ahead when accesses are sequential, stopping at blocks that are already cached
+    size_t count = 1;
+    if (fill && index == nextBlock) {
+        size_t limit = std::min<size_t>(READ_AHEAD, cacheLimit);
+        while (count < limit && cacheMap.find(index + count) == cacheMap.end())
+            count++;
+    }
+
+    // Read the missing blocks from the SD image in one go
+    uint8_t buffer[READ_AHEAD * 0x1000];
+    if (fill && !readFile(buffer, (off_t)index << 12, count << 12))
+        return nullptr;
+
+    // Insert the new blocks, with the requested one ending up most recently used
+    for (size_t i = count; i-- > 0;) {
+        if (cache.size() >= cacheLimit) {
+            // Evict the least recently used block, writing it back first if dirty
+            SdBlock &last = cache.back();
+            if (last.dirty && !flushBlock(last)) return nullptr;
+            cacheMap.erase(last.index);
+            cache.splice(cache.begin(), cache, std::prev(cache.end()));
+        } else {
+            cache.emplace_front();
+        }
+
+        SdBlock &block = cache.front();
+        block.index = index + i;
+        block.dirty = false;
+        if (fill) memcpy(block.data, &buffer[i << 12], 0x1000);
+        cacheMap[block.index] = cache.begin();
+    }
+
+    nextBlock = index + 1;
+    cacheMisses++;
+    return &cache.front();
+}
+
+bool Dldi::flushBlock(SdBlock &block) {
+    // Write a dirty block back to the SD image, clamped to the image size so the file never grows
+    off_t offset = (off_t)block.index << 12;
+    size_t size = (offset < imageSize) ? std::min<off_t>(0x1000, imageSize - offset) : 0;
+    if (size > 0 && !writeFile(block.data, offset, size)) return false;
+    block.dirty = false;
+    return true;
+}
+
+bool Dldi::flushCache() {
+    if (sdImage < 0) return true;
+
+    // Write changes in the mapped SD image back to the file, waiting for them to finish
+    if (sdMap)
+        return msync(sdMap, sdSize, MS_SYNC) == 0;
+
+    // Gather the dirty blocks in SD image order
+    std::vector<SdBlock*> dirty;
+    for (auto &block : cache) {
+        if (block.dirty)
+            dirty.push_back(&block);
+    }
+    std::sort(dirty.begin(), dirty.end(), [](SdBlock *a, SdBlock *b) { return a->index < b->index; });
+
+    // Write back runs of consecutive blocks with a single call each
+    for (size_t i = 0; i < dirty.size();) {
+        // Write a block that reaches past the end of the image on its own, so it can be clamped
+        if (((off_t)(dirty[i]->index + 1) << 12) > imageSize) {
+            if (!flushBlock(*dirty[i])) return false;
+            i++;
+            continue;
+        }
+
+        struct iovec iov[64];
+        size_t count = 0;
+        do {
+            iov[count].iov_base = dirty[i + count]->data;
+            iov[count].iov_len = 0x1000;
+            count++;
+        } while (count < 64 && i + count < dirty.size() &&
+                 dirty[i + count]->index == dirty[i]->index + count &&
+                 ((off_t)(dirty[i + count]->index + 1) << 12) <= imageSize);
+
+        off_t offset = (off_t)dirty[i]->index << 12;
+        if (pwritev(sdImage, iov, count, offset) != (ssize_t)(count << 12)) {
+            // Fall back to writing the blocks one at a time
+            for (size_t j = 0; j < count; j++) {
+                if (!flushBlock(*dirty[i + j])) return false;
+            }
+        }
+
+        for (size_t j = 0; j < count; j++)
+            dirty[i + j]->dirty = false;
+        i += count;
+    }
+
+    return true;
+}
+
+bool Dldi::readImage(uint8_t *data, off_t offset, size_t size) {
+    if (sdMap) {
+        // Copy data from the mapped SD image, reading zeros past the end
+        size_t count = (offset < (off_t)sdSize) ? std::min<size_t>(size, sdSize - offset) : 0;
+        if (count > 0) memcpy(data, &sdMap[offset], count);
+        memset(&data[count], 0, size - count);
+        return true;
+    }
+
+    // Read data from the SD image file directly if the cache is disabled
+    if (!cacheLimit)
+        return readFile(data, offset, size);
+
+    // Copy data from the cached blocks, loading them as needed
+    while (size > 0) {
+        size_t start = offset & 0xFFF;
+        size_t count = std::min<size_t>(size, 0x1000 - start);
+        SdBlock *block = loadBlock(offset >> 12, true);
+        if (!block) return false;
+        memcpy(data, &block->data[start], count);
+        data += count;
+        offset += count;
+        size -= count;
+    }
+
+    return true;
+}
+
+bool Dldi::writeImage(const uint8_t *data, off_t offset, size_t size) {
+    if (sdMap) {
+        // Copy data to the mapped SD image; the mapping can't grow, so writes past the end are dropped
+        size_t count = (offset < (off_t)sdSize) ? std::min<size_t>(size, sdSize - offset) : 0;
+        if (count > 0) memcpy(&sdMap[offset], data, count);
+        return count == size;
+    }
+
+    // The image can't grow, so writes past the end fail like with a mapping
+    if (offset + (off_t)size > imageSize)
+        return false;
+
+    // Write data to the SD image file directly if the cache is disabled
+    if (!cacheLimit)
+        return writeFile(data, offset, size);
+
+    // Copy data to the cached blocks, only reading blocks from the SD image if partially overwritten
+    while (size > 0) {
+        size_t start = offset & 0xFFF;
+        size_t count = std::min<size_t>(size, 0x1000 - start);
+        SdBlock *block = loadBlock(offset >> 12, count < 0x1000);
+        if (!block) return false;
+        memcpy(&block->data[start], data, count);
+        block->dirty = true;
+        data += count;
+        offset += count;
+        size -= count;
+    }
+
+    return true;
 }
 
 int Dldi::readSectors(bool cpu, int sector, int numSectors, uint32_t buf) {
-    if (!sdImage) return 0;
+    if (sdImage < 0) return 0;
 
-    const int offset = sector * 0x200;
-    const int size = numSectors * 0x200;
+    const off_t offset = (off_t)(uint32_t)sector << 9;
+    const size_t size = (size_t)(uint32_t)numSectors << 9;
 
-    // Read data from the SD image
-    uint8_t *data = new uint8_t[size];
-    fseek(sdImage, offset, SEEK_SET);
-    fread(data, sizeof(uint8_t), size, sdImage);
+    // Transfer the data in chunks that don't cross a 4KB memory block
+    for (size_t i = 0; i < size;) {
+        uint32_t address = buf + i;
+        size_t chunk = std::min<size_t>(size - i, 0x1000 - (address & 0xFFF));
+
+        if (uint8_t *data = core->memory.getWritePointer(cpu, address)) {
+            // Read data from the SD image straight into plain memory
+            if (!readImage(data, offset + i, chunk)) return 0;
+        } else {
+            // Read data from the SD image and write it to special memory one byte at a time
+            uint8_t buffer[0x1000];
+            if (!readImage(buffer, offset + i, chunk)) return 0;
+            for (size_t j = 0; j < chunk; j++)
+                core->memory.write<uint8_t>(cpu, address + j, buffer[j]);
+        }
 
-    // Write the data to memory
-    for (int i = 0; i < size; i++)
-        core->memory.write<uint8_t>(cpu, buf + i, data[i]);
+        i += chunk;
+    }
 
-    delete[] data;
     return 1;
 }
 
 int Dldi::writeSectors(bool cpu, int sector, int numSectors, uint32_t buf) {
-    if (!sdImage) return 0;
+    if (sdImage < 0) return 0;
 
-    const int offset = sector * 0x200;
-    const int size = numSectors * 0x200;
+    const off_t offset = (off_t)(uint32_t)sector << 9;
+    const size_t size = (size_t)(uint32_t)numSectors << 9;
 
-    // Read data from memory
-    uint8_t *data = new uint8_t[size];
-    for (int i = 0; i < size; i++)
-        data[i] = core->memory.read<uint8_t>(cpu, buf + i);
+    // Transfer the data in chunks that don't cross a 4KB memory block
+    for (size_t i = 0; i < size;) {
+        uint32_t address = buf + i;
+        size_t chunk = std::min<size_t>(size - i, 0x1000 - (address & 0xFFF));
 
-    // Write the data to the SD image
-    fseek(sdImage, offset, SEEK_SET);
-    fwrite(data, sizeof(uint8_t), size, sdImage);
+        if (uint8_t *data = core->memory.getReadPointer(cpu, address)) {
+            // Write data from plain memory straight to the SD image
+            if (!writeImage(data, offset + i, chunk)) return 0;
+        } else {
+            // Read data from special memory one byte at a time and write it to the SD image
+            uint8_t buffer[0x1000];
+            for (size_t j = 0; j < chunk; j++)
+                buffer[j] = core->memory.read<uint8_t>(cpu, address + j);
+            if (!writeImage(buffer, offset + i, chunk)) return 0;
+        }
+
+        i += chunk;
+    }
+
+    // Start writing changes in the mapped SD image back to the file without waiting for them
+    if (sdMap && offset < (off_t)sdSize) {
+        size_t start = offset & ~(sysconf(_SC_PAGESIZE) - 1);
+        size_t end = std::min<size_t>(offset + size, sdSize);
+        msync(&sdMap[start], end - start, MS_ASYNC);
+    }
 
-    delete[] data;
     return 1;
 }
 
 int Dldi::clearStatus() {
     // Dummy function
-    return (sdImage ? 1 : 0);
+    return (sdImage >= 0 ? 1 : 0);
 }
 
 int Dldi::shutdown() {
-    if (!sdImage) return 0;
+    if (sdImage < 0) return 0;
+
+    // Write back and drop the block cache
+    flushCache();
+    cache.clear();
+    cacheMap.clear();
+
+    // Unmap the SD image if it was mapped, after the flush above wrote it back
+    if (sdMap) {
+        munmap(sdMap, sdSize);
+        sdMap = nullptr;
+        sdSize = 0;
+    }
 
     // Close the SD image
-    fclose(sdImage);
-    sdImage = nullptr;
+    close(sdImage);
+    sdImage = -1;
+    imageSize = 0;
     return 1;
 }
@@ -1,8 +1,11 @@
 #ifndef DLDI_H
 #define DLDI_H
 
+#include <cstddef>
 #include <cstdint>
-#include <cstdio>
+#include <list>
+#include <unordered_map>
+#include <sys/types.h>
 
 class Core;
 
@@ -15,6 +18,12 @@ enum DldiFunc {
     DLDI_STOP
 };
 
+struct SdBlock {
+    uint32_t index;
+    bool dirty;
+    uint8_t data[0x1000];
+};
+
 class Dldi {
 public:
     Dldi(Core *core) : core(core) {}
@@ -25,6 +34,8 @@ public:
 
     bool isPatched() { return patched; }
 
+    bool isMounted() { return sdImage >= 0; }
+
     int startup();
 
     int isInserted();
@@ -37,11 +48,41 @@ public:
 
     int shutdown();
 
+    uint32_t getCacheHits() { return cacheHits; }
+
+    uint32_t getCacheMisses() { return cacheMisses; }
+
+    bool flushCache();
+
 private:
     Core *core;
 
     bool patched = false;
-    FILE *sdImage = nullptr;
+    int sdImage = -1;
+    off_t imageSize = 0;
+
+    // Optional memory mapping of the whole SD image
+    uint8_t *sdMap = nullptr;
+    size_t sdSize = 0;
+
+    // LRU cache of 4KB SD image blocks, most recently used first
+    std::list<SdBlock> cache;
+    std::unordered_map<uint32_t, std::list<SdBlock>::iterator> cacheMap;
+    size_t cacheLimit = 0;
+    uint32_t nextBlock = -1;
+    uint32_t cacheHits = 0, cacheMisses = 0;
+
+    SdBlock *loadBlock(uint32_t index, bool fill);
+
+    bool flushBlock(SdBlock &block);
+
+    bool readFile(uint8_t *data, off_t offset, size_t size);
+
+    bool writeFile(const uint8_t *data, off_t offset, size_t size);
+
+    bool readImage(uint8_t *data, off_t offset, size_t size);
+
+    bool writeImage(const uint8_t *data, off_t offset, size_t size);
 };
 
 #endif // DLDI_H
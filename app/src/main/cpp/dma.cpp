@@ -7,6 +7,17 @@ Dma::Dma(Core *core, bool cpu) : core(core), cpu(cpu) {
         transferTask[i] = std::bind(&Dma::transfer, this, i);
 }
 
+void Dma::syncState(State &state) {
+    // Sync the registers and the internal transfer state
+    state.var(srcAddrs);
+    state.var(dstAddrs);
+    state.var(wordCounts);
+    state.var(stalled);
+    state.var(dmaSad);
+    state.var(dmaDad);
+    state.var(dmaCnt);
+}
+
 void Dma::transfer(int channel) {
     int dstAddrCnt = (dmaCnt[channel] & 0x00600000) >> 21;
     int srcAddrCnt = (dmaCnt[channel] & 0x01800000) >> 23;
@@ -31,6 +42,13 @@ void Dma::transfer(int channel) {
     } else if (dmaCnt[channel] & BIT(26)) // Whole word transfer
     {
         for (unsigned int i = 0; i < wordCounts[channel]; i++) {
+            // Stall on a full GXFIFO like the bus does on hardware, keeping the words that are left
+            if (cpu == 0 && (dstAddrs[channel] & ~0x1FF) == 0x4000400 && core->gpu3D.isFifoFull()) {
+                wordCounts[channel] -= i;
+                stalled |= BIT(channel);
+                return;
+            }
+
             // Transfer a word
             core->memory.write<uint32_t>(cpu, dstAddrs[channel],
                                          core->memory.read<uint32_t>(cpu, srcAddrs[channel]));
@@ -54,6 +72,13 @@ void Dma::transfer(int channel) {
     } else // Half-word transfer
     {
         for (unsigned int i = 0; i < wordCounts[channel]; i++) {
+            // Stall on a full GXFIFO like the bus does on hardware, keeping the half-words that are left
+            if (cpu == 0 && (dstAddrs[channel] & ~0x1FF) == 0x4000400 && core->gpu3D.isFifoFull()) {
+                wordCounts[channel] -= i;
+                stalled |= BIT(channel);
+                return;
+            }
+
             // Transfer a half-word
             core->memory.write<uint16_t>(cpu, dstAddrs[channel],
                                          core->memory.read<uint16_t>(cpu, srcAddrs[channel]));
@@ -119,6 +144,15 @@ void Dma::trigger(int mode, uint8_t channels) {
     }
 }
 
+void Dma::resume() {
+    // Continue transfers that stalled on a full GXFIFO
+    for (int i = 0; i < 4; i++) {
+        if (stalled & BIT(i))
+            core->schedule(Task(&transferTask[i], 1));
+    }
+    stalled = 0;
+}
+
 void Dma::writeDmaSad(int channel, uint32_t mask, uint32_t value) {
     // Write to one of the DMASAD registers
     mask &= ((cpu == 0 || channel != 0) ? 0x0FFFFFFF : 0x07FFFFFF);
@@ -138,6 +172,10 @@ void Dma::writeDmaCnt(int channel, uint32_t mask, uint32_t value) {
     mask &= ((cpu == 0) ? 0xFFFFFFFF : (channel == 3 ? 0xF7E0FFFF : 0xF7E03FFF));
     dmaCnt[channel] = (dmaCnt[channel] & ~mask) | (value & mask);
 
+    // Drop a stalled transfer if the channel was disabled
+    if (!(dmaCnt[channel] & BIT(31)))
+        stalled &= ~BIT(channel);
+
     // In GXFIFO mode, schedule a transfer on the channel immediately if the FIFO is already half empty
     // All other modes are only triggered at the moment when the event happens
     // For example, if a word from the DS cart is ready before starting a DMA, the DMA will not be triggered
@@ -6,11 +6,16 @@
 
 class Core;
 
+class State;
+
 class Dma {
 public:
     Dma(Core *core, bool cpu);
 
+    void syncState(State &state);
+
     void trigger(int mode, uint8_t channels = 0x0F);
+    void resume();
 
     uint32_t readDmaSad(int channel) { return dmaSad[channel]; }
 
@@ -31,6 +36,7 @@ private:
     uint32_t srcAddrs[4] = {};
     uint32_t dstAddrs[4] = {};
     uint32_t wordCounts[4] = {};
+    uint8_t stalled = 0;
 
     uint32_t dmaSad[4] = {};
     uint32_t dmaDad[4] = {};
@@ -0,0 +1,35 @@
+#ifndef FIFO_H
+#define FIFO_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "defines.h"
+
+// Fixed-capacity ring buffer for hardware FIFOs, stored inline without heap allocation
+// The capacity must be a power of 2; callers are responsible for not pushing when full
+template<typename T, size_t capacity>
+class Fifo {
+public:
+    static_assert((capacity & (capacity - 1)) == 0, "FIFO capacity must be a power of 2");
+
+    FORCE_INLINE bool empty() const { return head == tail; }
+
+    FORCE_INLINE bool full() const { return tail - head == capacity; }
+
+    FORCE_INLINE size_t size() const { return tail - head; }
+
+    FORCE_INLINE T &front() { return entries[head & (capacity - 1)]; }
+
+    FORCE_INLINE void push(const T &entry) { entries[tail++ & (capacity - 1)] = entry; }
+
+    FORCE_INLINE void pop() { head++; }
+
+    FORCE_INLINE void clear() { head = tail; }
+
+private:
+    T entries[capacity] = {};
+    uint32_t head = 0, tail = 0;
+};
+
+#endif // FIFO_H
@@ -0,0 +1,63 @@
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "file_cache.h"
+
+std::mutex FileCache::mutex;
+std::map<std::pair<std::string, size_t>, FileCache::Entry> FileCache::files;
+
+std::shared_ptr<uint8_t[]> FileCache::load(const std::string &path, size_t &size,
+        std::function<void(uint8_t*, size_t)> prepare) {
+    // Images are keyed by their requested size, where 0 means the whole file
+    std::lock_guard<std::mutex> guard(mutex);
+    std::pair<std::string, size_t> key(path, size);
+
+    // Reuse an image that another instance still holds
+    auto position = files.find(key);
+    if (position != files.end()) {
+        if (std::shared_ptr<uint8_t[]> data = position->second.data.lock()) {
+            size = position->second.size;
+            return data;
+        }
+    }
+
+    // Open the file and determine how much to load
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return nullptr;
+    struct stat st;
+    size_t fileSize = (fstat(fd, &st) == 0) ? st.st_size : 0;
+    if (!size) size = fileSize;
+    std::shared_ptr<uint8_t[]> data;
+
+    // Map the file privately if it covers the whole image, so pages are only read when used
+    // Writes from preparing the image are copy-on-write and never reach the file
+    if (size > 0 && size <= fileSize) {
+        void *map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED)
+            data = std::shared_ptr<uint8_t[]>((uint8_t*)map, [size](uint8_t *map) { munmap(map, size); });
+    }
+
+    if (!data) {
+        // Read the file instead, padding it with zeros up to the requested size
+        data = std::shared_ptr<uint8_t[]>(new uint8_t[size]);
+        size_t count = 0;
+        while (count < std::min(size, fileSize)) {
+            ssize_t result = pread(fd, &data[count], std::min(size, fileSize) - count, count);
+            if (result <= 0) break;
+            count += result;
+        }
+        memset(&data[count], 0, size - count);
+    }
+    close(fd);
+
+    // Let the first loader modify the image before it's shared
+    if (prepare)
+        prepare(data.get(), size);
+
+    files[key] = {data, size};
+    return data;
+}
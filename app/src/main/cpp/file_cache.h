@@ -0,0 +1,30 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+// Process-wide cache of read-only file images, shared between core instances
+class FileCache {
+public:
+    static std::shared_ptr<uint8_t[]> load(const std::string &path, size_t &size,
+        std::function<void(uint8_t*, size_t)> prepare = nullptr);
+
+private:
+    struct Entry {
+        std::weak_ptr<uint8_t[]> data;
+        size_t size;
+    };
+
+    FileCache() {} // Private to prevent instantiation
+
+    static std::mutex mutex;
+    static std::map<std::pair<std::string, size_t>, Entry> files;
+};
+
+#endif // FILE_CACHE_H
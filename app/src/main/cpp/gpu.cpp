@@ -33,6 +33,31 @@ Gpu::~Gpu() {
     }
 }
 
+void Gpu::syncState(State &state) {
+    // Sync the registers and display state, leaving out queued frames and threads
+    state.var(gbaBlock);
+    state.var(displayCapture);
+    state.var(dirty3D);
+    state.var(dispStat);
+    state.var(vCount);
+    state.var(dispCapCnt);
+    state.var(powCnt1);
+
+    // Redraw the 3D lines that would have been drawn by now, since the renderer output isn't saved
+    // This relies on the 2D, 3D, and renderer states already being loaded
+    if (!state.isSaving() && !core->isGbaMode()) {
+        if (core->gpu2D[0].readDispCnt() & BIT(3)) {
+            // Lines are drawn 48 ahead from line 215, so a frame in progress has only drawn up to there
+            // Otherwise the last frame should be complete, so draw all of it
+            int count = (dirty3D & BIT(1)) ? ((vCount >= 215) ? (vCount - 214) : (vCount + 49)) : 192;
+            for (int i = 0; i < count; i++)
+                core->gpu3DRenderer.drawScanline(i);
+        } else {
+            invalidate3D();
+        }
+    }
+}
+
 void Gpu::scheduleInit() {
     // Schedule initial NDS GPU tasks (these will reschedule themselves indefinitely)
     core->schedule(Task(&scanline256Task, 256 * 6));
@@ -70,6 +95,10 @@ uint16_t Gpu::rgb6ToRgb5(uint32_t color) {
 }
 
 bool Gpu::getFrame(uint32_t *out, bool gbaCrop) {
+    PerfScope scope(core->perfCounters, PHASE_GET_FRAME);
+    TRACE_THREAD("Display");
+    TRACE_SCOPE("Gpu::getFrame");
+
     // Check if a new frame is ready
     if (!ready.load())
         return false;
@@ -197,9 +226,18 @@ bool Gpu::getFrame(uint32_t *out, bool gbaCrop) {
     return true;
 }
 
+int Gpu::getQueuedFrames() {
+    // Get the number of frames waiting to be displayed
+    std::lock_guard<std::mutex> guard(mutex);
+    return framebuffers.size();
+}
+
 void Gpu::gbaScanline240() {
     if (vCount < 160) {
-        if (thread) {
+        if (hidden) {
+            // Skip drawing scanlines of frames that won't be shown
+            core->gpu2D[0].skipGbaScanline(vCount);
+        } else if (thread) {
             // Wait for the thread to finish the scanline
             while (drawing.load() != 0)
                 std::this_thread::yield();
@@ -231,6 +269,9 @@ void Gpu::gbaScanline308() {
     switch (++vCount) {
         case 160: // End of visible scanlines
         {
+            // Apply queued input at the start of V-blank
+            core->input.update();
+
             // Stop the thread now that the frame has been drawn
             if (thread) {
                 running = false;
@@ -250,7 +291,8 @@ void Gpu::gbaScanline308() {
             core->dma[1].trigger(1);
 
             // Allow up to 2 framebuffers to be queued, to preserve frame pacing if emulation runs ahead
-            if (framebuffers.size() < 2) {
+            // Hidden frames aren't queued, since they weren't drawn
+            if (framebuffers.size() < 2 && !hidden) {
                 // Copy the completed sub-framebuffer to a new framebuffer
                 Buffers buffers;
                 buffers.framebuffer = new uint32_t[256 * 160];
@@ -262,6 +304,9 @@ void Gpu::gbaScanline308() {
                 framebuffers.push(buffers);
                 ready.store(true);
                 mutex.unlock();
+            } else if (!hidden) {
+                // Count frames dropped because the queue was full
+                core->stats.countSkippedFrame();
             }
 
             break;
@@ -291,7 +336,7 @@ void Gpu::gbaScanline308() {
     }
 
     // Signal that the next scanline should start drawing
-    if (vCount < 160 && thread)
+    if (vCount < 160 && thread && !hidden)
         drawing.store(1);
 
     // Check if the current scanline matches the V-counter
@@ -312,8 +357,14 @@ void Gpu::gbaScanline308() {
 }
 
 void Gpu::scanline256() {
+    TRACE_SCOPE("Gpu::scanline256");
+
     if (vCount < 192) {
-        if (thread) {
+        if (hidden && !displayCapture && !(vCount == 0 && (dispCapCnt & BIT(31)))) {
+            // Skip drawing scanlines of frames that won't be shown, unless they're needed for a display capture
+            core->gpu2D[0].skipScanline(vCount);
+            core->gpu2D[1].skipScanline(vCount);
+        } else if (thread && !hidden) {
             // Make sure the thread has started before changing the state
             while (drawing.load() == 1)
                 std::this_thread::yield();
@@ -486,10 +537,15 @@ void Gpu::scanline256() {
 }
 
 void Gpu::scanline355() {
+    TRACE_SCOPE("Gpu::scanline355");
+
     // Move to the next scanline
     switch (++vCount) {
         case 192: // End of visible scanlines
         {
+            // Apply queued input at the start of V-blank
+            core->input.update();
+
             // Stop the thread now that the frame has been drawn
             if (thread) {
                 running = false;
@@ -515,7 +571,8 @@ void Gpu::scanline355() {
                 core->gpu3D.swapBuffers();
 
             // Allow up to 2 framebuffers to be queued, to preserve frame pacing if emulation runs ahead
-            if (framebuffers.size() < 2) {
+            // Hidden frames aren't queued, since they weren't drawn
+            if (framebuffers.size() < 2 && !hidden) {
                 Buffers buffers;
 
                 // Copy the completed sub-framebuffers to a new framebuffer
@@ -551,6 +608,9 @@ void Gpu::scanline355() {
                 framebuffers.push(buffers);
                 ready.store(true);
                 mutex.unlock();
+            } else if (!hidden) {
+                // Count frames dropped because the queue was full
+                core->stats.countSkippedFrame();
             }
 
             break;
@@ -581,7 +641,7 @@ void Gpu::scanline355() {
     }
 
     // Signal that the next scanline should start drawing
-    if (vCount < 192 && thread)
+    if (vCount < 192 && thread && !hidden)
         drawing.store(1);
 
     for (int i = 0; i < 2; i++) {
@@ -607,6 +667,8 @@ void Gpu::scanline355() {
 }
 
 void Gpu::drawGbaThreaded() {
+    TRACE_THREAD("2D renderer");
+
     while (running) {
         // Wait until the next scanline should start
         while (drawing.load() != 1) {
@@ -623,6 +685,8 @@ void Gpu::drawGbaThreaded() {
 }
 
 void Gpu::drawThreaded() {
+    TRACE_THREAD("2D renderer");
+
     while (running) {
         // Wait until the next scanline should start
         while (drawing.load() != 1) {
@@ -12,6 +12,8 @@
 
 class Core;
 
+class State;
+
 class Gpu {
 public:
     Gpu(Core *core);
@@ -22,10 +24,16 @@ public:
 
     void gbaScheduleInit();
 
+    void syncState(State &state);
+
     bool getFrame(uint32_t *out, bool gbaCrop);
 
+    int getQueuedFrames();
+
     void invalidate3D() { dirty3D |= BIT(0); }
 
+    void setHidden(bool value) { hidden = value; }
+
     uint16_t readDispStat(bool cpu) { return dispStat[cpu]; }
 
     uint16_t readVCount() { return vCount; }
@@ -56,6 +64,7 @@ private:
     bool running = false;
     std::atomic<int> drawing;
     std::thread *thread = nullptr;
+    bool hidden = false;
 
     bool gbaBlock = true;
     bool displayCapture = false;
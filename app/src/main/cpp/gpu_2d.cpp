@@ -22,6 +22,35 @@ Gpu2D::Gpu2D(Core *core, bool engine) : core(core), engine(engine) {
     }
 }
 
+void Gpu2D::syncState(State &state) {
+    // Sync the registers and internal counters, leaving out the framebuffer since it's redrawn each frame
+    state.var(internalX);
+    state.var(internalY);
+    state.var(winHFlip);
+    state.var(winVFlip);
+    state.var(dispCnt);
+    state.var(bgCnt);
+    state.var(bgHOfs);
+    state.var(bgVOfs);
+    state.var(bgPA);
+    state.var(bgPB);
+    state.var(bgPC);
+    state.var(bgPD);
+    state.var(bgX);
+    state.var(bgY);
+    state.var(winX1);
+    state.var(winX2);
+    state.var(winY1);
+    state.var(winY2);
+    state.var(winIn);
+    state.var(winOut);
+    state.var(bldCnt);
+    state.var(mosaic);
+    state.var(bldAlpha);
+    state.var(bldY);
+    state.var(masterBright);
+}
+
 uint32_t Gpu2D::rgb5ToRgb6(uint32_t color) {
     // Convert an RGB5 value to an RGB6 value (the way the 2D engine does it)
     // Also keep the extra bits because some of them are used to keep track of stuff
@@ -32,6 +61,8 @@ uint32_t Gpu2D::rgb5ToRgb6(uint32_t color) {
 }
 
 void Gpu2D::drawGbaScanline(int line) {
+    StatsScope statsScope(core->stats, STATS_GPU_2D);
+
     // Reload the internal registers at the start of the frame
     if (line == 0) {
         internalX[0] = bgX[0];
@@ -170,6 +201,10 @@ void Gpu2D::drawGbaScanline(int line) {
 }
 
 void Gpu2D::drawScanline(int line) {
+    PerfScope scope(core->perfCounters, PHASE_GPU_2D);
+    StatsScope statsScope(core->stats, STATS_GPU_2D);
+    TRACE_SCOPE("Gpu2D::drawScanline");
+
     // Reload the internal registers at the start of the frame
     if (line == 0) {
         internalX[0] = bgX[0];
@@ -427,6 +462,44 @@ void Gpu2D::drawScanline(int line) {
     }
 }
 
+void Gpu2D::skipGbaScanline(int line) {
+    // Reload the internal registers at the start of the frame
+    if (line == 0) {
+        internalX[0] = bgX[0];
+        internalX[1] = bgX[1];
+        internalY[0] = bgY[0];
+        internalY[1] = bgY[1];
+    }
+
+    // Advance the affine layers that would have been drawn in the current BG mode
+    static const uint16_t affineBgs[8] = { 0, BIT(10), BIT(10) | BIT(11), BIT(10), BIT(10), BIT(10), 0, 0 };
+    advanceAffine(dispCnt & affineBgs[dispCnt & 0x7]);
+}
+
+void Gpu2D::skipScanline(int line) {
+    // Reload the internal registers at the start of the frame
+    if (line == 0) {
+        internalX[0] = bgX[0];
+        internalX[1] = bgX[1];
+        internalY[0] = bgY[0];
+        internalY[1] = bgY[1];
+    }
+
+    // Advance the affine layers that would have been drawn in the current BG mode
+    static const uint16_t affineBgs[8] = { 0, BIT(11), BIT(10) | BIT(11), BIT(11), BIT(10) | BIT(11),
+                                           BIT(10) | BIT(11), BIT(10), 0 };
+    advanceAffine(dispCnt & affineBgs[dispCnt & 0x7]);
+}
+
+void Gpu2D::advanceAffine(uint16_t bgs) {
+    // Increment the internal registers of the given affine layers, like drawing a scanline would
+    for (int bg = 2; bg < 4; bg++) {
+        if (!(bgs & BIT(8 + bg))) continue;
+        internalX[bg - 2] += bgPB[bg - 2];
+        internalY[bg - 2] += bgPD[bg - 2];
+    }
+}
+
 void Gpu2D::drawBgPixel(int bg, int line, int x, uint32_t pixel) {
     // Skip the pixel if it's in the bounds of a window that has its layer disabled
     if (dispCnt & 0x0000E000) // Windows enabled
@@ -5,14 +5,22 @@
 
 class Core;
 
+class State;
+
 class Gpu2D {
 public:
     Gpu2D(Core *core, bool engine);
 
+    void syncState(State &state);
+
     void drawGbaScanline(int line);
 
     void drawScanline(int line);
 
+    void skipGbaScanline(int line);
+
+    void skipScanline(int line);
+
     uint32_t *getFramebuffer() { return framebuffer; }
 
     uint32_t *getRawLine() { return layers[0]; }
@@ -129,6 +137,8 @@ private:
 
     template<bool gbaMode>
     void drawObjects(int line, bool window);
+
+    void advanceAffine(uint16_t bgs);
 };
 
 #endif // GPU_2D_H
@@ -72,6 +72,121 @@ Gpu3D::Gpu3D(Core *core) : core(core) {
     runCommandTask = [this] { runCommand(); };
 }
 
+void Gpu3D::syncState(State &state) {
+    // Sync the geometry engine state
+    state.var(this->state);
+    state.var(fifo);
+    state.var(pipeSize);
+    state.var(testQueue);
+    state.var(matrixQueue);
+    state.var(matrixMode);
+    state.var(clipDirty);
+    state.var(projection);
+    state.var(projectionStack);
+    state.var(coordinate);
+    state.var(coordinateStack);
+    state.var(direction);
+    state.var(directionStack);
+    state.var(texture);
+    state.var(textureStack);
+    state.var(clip);
+
+    // Sync which buffer is being filled as a flag, since the buffers themselves are fixed
+    bool swapped = (verticesIn == vertices2);
+    state.var(swapped);
+    verticesIn = swapped ? vertices2 : vertices1;
+    verticesOut = swapped ? vertices1 : vertices2;
+    polygonsIn = swapped ? polygons2 : polygons1;
+    polygonsOut = swapped ? polygons1 : polygons2;
+
+    // Sync the saved vertex and polygon; the buffers are synced at the end with syncBuffers()
+    state.var(savedVertex);
+    syncPolygons(state, &savedPolygon, 1);
+
+    // Sync the remaining command state and registers
+    state.var(s);
+    state.var(t);
+    state.var(vertexCount);
+    state.var(clockwise);
+    state.var(polygonType);
+    state.var(textureCoordMode);
+    state.var(polygonAttr);
+    state.var(enabledLights);
+    state.var(renderBack);
+    state.var(renderFront);
+    state.var(diffuseColor);
+    state.var(ambientColor);
+    state.var(specularColor);
+    state.var(emissionColor);
+    state.var(shininessEnabled);
+    state.var(lightVector);
+    state.var(halfVector);
+    state.var(lightColor);
+    state.var(shininess);
+    state.var(viewportX);
+    state.var(viewportY);
+    state.var(viewportWidth);
+    state.var(viewportHeight);
+    state.var(gxFifo);
+    state.var(gxStat);
+    state.var(posResult);
+    state.var(vecResult);
+    state.var(gxFifoCount);
+}
+
+void Gpu3D::syncBuffers(State &state) {
+    // Sync the vertex and polygon counts, rejecting counts past the end of the buffers
+    state.var(vertexCountIn);
+    state.var(vertexCountOut);
+    state.var(polygonCountIn);
+    state.var(polygonCountOut);
+    if (!state.isSaving() && state.isValid() && ((uint32_t)vertexCountIn > 6144 || (uint32_t)vertexCountOut > 6144 ||
+            (uint32_t)polygonCountIn > 2048 || (uint32_t)polygonCountOut > 2048)) {
+        state.invalidate();
+        return;
+    }
+
+    // Sync only the used parts of the buffers, since they're large and usually mostly empty
+    // Their size varies with the counts, so this is called near the end to not shift the rest
+    bool swapped = (verticesIn == vertices2);
+    state.block(swapped ? vertices2 : vertices1, vertexCountIn * sizeof(Vertex));
+    state.block(swapped ? vertices1 : vertices2, vertexCountOut * sizeof(Vertex));
+    syncPolygons(state, polygonsIn, polygonCountIn);
+    syncPolygons(state, polygonsOut, polygonCountOut);
+}
+
+void Gpu3D::syncPolygons(State &state, _Polygon *polygons, int count) {
+    // Sync polygons with their vertex pointers stored separately as buffer indices
+    // Indices from 0 are in the first vertex buffer, from 6144 are in the second, and -1 is null
+    int32_t indices[2048];
+    _Polygon *data = (_Polygon*)state.block(polygons, count * sizeof(_Polygon));
+    if (state.isSaving()) {
+        for (int i = 0; i < count; i++) {
+            Vertex *vertices = polygons[i].vertices;
+            if (!vertices)
+                indices[i] = -1;
+            else if (vertices >= vertices1 && vertices < vertices1 + 6144)
+                indices[i] = vertices - vertices1;
+            else
+                indices[i] = 6144 + (vertices - vertices2);
+            data[i].vertices = nullptr;
+        }
+    }
+
+    state.block(indices, count * sizeof(int32_t));
+    if (!state.isSaving() && state.isValid()) {
+        for (int i = 0; i < count; i++) {
+            int32_t index = indices[i];
+            if (index < 0)
+                polygons[i].vertices = nullptr;
+            else if (index < 6144)
+                polygons[i].vertices = &vertices1[index];
+            else
+                polygons[i].vertices = &vertices2[index - 6144];
+        }
+    }
+}
+
 uint32_t Gpu3D::rgb5ToRgb6(uint16_t color) {
     // Convert an RGB5 value to an RGB6 value (the way the 3D engine does it)
     uint8_t r = ((color >> 0) & 0x1F) * 2;
@@ -346,9 +461,11 @@ void Gpu3D::runCommand() {
             break;
     }
 
-    // Unhalt the CPU if the FIFO was full but now has space free
+    // Unhalt the CPU and resume stalled DMA transfers if the FIFO was full but now has space free
     if (fifo.size() - pipeSize <= 256)
         core->interpreter[0].unhalt(1);
+    if (!isFifoFull())
+        core->dma[0].resume();
 
     // Keep executing commands as long as they're ready
     if (state != GX_HALTED) {
@@ -1529,6 +1646,7 @@ void Gpu3D::addEntry(Entry entry) {
         gxStat |= BIT(27); // Commands executing
     } else {
         // If the FIFO is full, halt the CPU until space is free
+        // The halt only takes effect between opcodes, and DMAs stall before writing, so the buffer never overflows
         if (fifo.size() - pipeSize >= 256)
             core->interpreter[0].halt(1);
 
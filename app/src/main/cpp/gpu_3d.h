@@ -3,13 +3,15 @@
 
 #include <cstdint>
 #include <functional>
-#include <queue>
 #include <vector>
 
 #include "defines.h"
+#include "fifo.h"
 
 class Core;
 
+class State;
+
 enum GXState {
     GX_IDLE = 0,
     GX_RUNNING,
@@ -17,9 +19,9 @@ enum GXState {
 };
 
 struct Entry {
-    Entry(uint8_t command, uint32_t param) : command(command), param(param) {}
+    Entry(uint8_t command = 0, uint32_t param = 0) : command(command), param(param) {}
 
-    uint8_t command;
+    uint32_t command; // Wider than a command, so entries have no padding when saved in states
     uint32_t param;
 };
 
@@ -51,28 +53,28 @@ struct Vertex : Vector {
     Vertex operator*(Matrix &mtx);
 };
 
+// Members are ordered to leave no padding, since polygons are saved in states byte for byte
 struct _Polygon {
-    int size = 0;
     Vertex *vertices = nullptr;
+    int size = 0;
+    int mode = 0;
+    int id = 0;
+
+    uint32_t textureAddr = 0, paletteAddr = 0;
+    int sizeS = 0, sizeT = 0;
+    int textureFmt = 0;
+    int wShift = 0;
+
     bool crossed = false;
     bool clockwise = false;
-
-    int mode = 0;
     bool transNewDepth = false;
     bool depthTestEqual = false;
     bool fog = false;
     uint8_t alpha = 0;
-    int id = 0;
-
-    uint32_t textureAddr = 0, paletteAddr = 0;
-    int sizeS = 0, sizeT = 0;
     bool repeatS = false, repeatT = false;
     bool flipS = false, flipT = false;
-    int textureFmt = 0;
     bool transparent0 = false;
-
     bool wBuffer = false;
-    int wShift = 0;
 };
 
 
@@ -80,6 +82,9 @@ class Gpu3D {
 public:
     Gpu3D(Core *core);
 
+    void syncState(State &state);
+    void syncBuffers(State &state);
+
     void swapBuffers();
 
     bool shouldSwap() { return state == GX_HALTED; }
@@ -89,6 +94,7 @@ public:
     int getPolygonCount() { return polygonCountOut; }
 
     uint32_t readGxStat() { return gxStat; }
+    bool isFifoFull() { return fifo.size() - pipeSize >= 256; }
 
     uint32_t readPosResult(int index) { return posResult[index]; }
 
@@ -183,7 +189,7 @@ private:
 
     GXState state = GX_IDLE;
 
-    std::queue<Entry> fifo;
+    Fifo<Entry, 512> fifo;
     size_t pipeSize = 0;
     size_t testQueue = 0;
     size_t matrixQueue = 0;
@@ -241,6 +247,8 @@ private:
 
     static uint32_t rgb5ToRgb6(uint16_t color);
 
+    void syncPolygons(State &state, _Polygon *polygons, int count);
+
     static Vertex intersection(Vertex *vtx1, Vertex *vtx2, int32_t val1, int32_t val2);
 
     static bool clipPolygon(Vertex *unclipped, Vertex *clipped, int *size);
@@ -14,14 +14,32 @@ Gpu3DRenderer::Gpu3DRenderer(Core *core) : core(core) {
 
 Gpu3DRenderer::~Gpu3DRenderer() {
     // Clean up the threads
+    joinThreads();
+}
+
+void Gpu3DRenderer::joinThreads() {
+    // Wait for the threads to finish drawing the frame and clean them up
     for (int i = 0; i < activeThreads; i++) {
         if (threads[i]) {
             threads[i]->join();
             delete threads[i];
+            threads[i] = nullptr;
         }
     }
 }
 
+void Gpu3DRenderer::syncState(State &state) {
+    // Sync the registers, leaving out the output since it's redrawn after loading
+    state.var(disp3DCnt);
+    state.var(edgeColor);
+    state.var(clearColor);
+    state.var(clearDepth);
+    state.var(fogColor);
+    state.var(fogOffset);
+    state.var(fogTable);
+    state.var(toonTable);
+}
+
 uint32_t Gpu3DRenderer::rgba5ToRgba6(uint32_t color) {
     // Convert an RGBA5 value to an RGBA6 value (the way the 3D engine does it)
     uint8_t r = ((color >> 0) & 0x1F) * 2;
@@ -98,12 +116,7 @@ void Gpu3DRenderer::drawScanline(int line) {
         resShift = Settings::getHighRes3D();
 
         // Clean up any existing threads
-        for (int i = 0; i < activeThreads; i++) {
-            if (threads[i]) {
-                threads[i]->join();
-                delete threads[i];
-            }
-        }
+        joinThreads();
 
         // Update the thread count
         activeThreads = Settings::getThreaded3D();
@@ -141,6 +154,9 @@ void Gpu3DRenderer::drawScanline(int line) {
 }
 
 void Gpu3DRenderer::drawThreaded(int thread) {
+    TRACE_THREAD("3D renderer");
+    TRACE_SCOPE("Gpu3DRenderer::drawThreaded");
+
     // Draw the 3D scanlines in a threaded sequence
     // The amount of scanlines skipped per thread depends on the number of active threads
     // Together, they render the entire 3D image
@@ -185,6 +201,9 @@ void Gpu3DRenderer::drawThreaded(int thread) {
 }
 
 void Gpu3DRenderer::drawScanline1(int line) {
+    PerfScope scope(core->perfCounters, PHASE_GPU_3D);
+    StatsScope statsScope(core->stats, STATS_GPU_3D);
+
     // Convert the clear values
     // The attribute buffer contains the polygon IDs (0-5, 6-11), transparency bit (12), fog bit (13), edge bit (14), and edge alpha (15-20)
     uint32_t color =
@@ -227,6 +246,10 @@ void Gpu3DRenderer::drawScanline1(int line) {
 }
 
 void Gpu3DRenderer::finishScanline(int line) {
+    PerfScope scope(core->perfCounters, PHASE_GPU_3D);
+    StatsScope statsScope(core->stats, STATS_GPU_3D);
+    TRACE_SCOPE("Gpu3DRenderer::finishScanline");
+
     // Perform edge marking if enabled
     if (disp3DCnt & BIT(5)) {
         int offset = line * 256 * 2;
@@ -7,6 +7,8 @@
 
 class Core;
 
+class State;
+
 struct Vertex;
 struct _Polygon;
 
@@ -16,6 +18,10 @@ public:
 
     ~Gpu3DRenderer();
 
+    void joinThreads();
+
+    void syncState(State &state);
+
     void drawScanline(int line);
 
     uint32_t *getLine(int line);
@@ -42,6 +48,7 @@ private:
     Core *core;
 
     bool resShift = false;
+    // Buffers are sized for high-res 3D
     uint32_t framebuffer[2][256 * 192 * 4] = {};
     int32_t depthBuffer[2][256 * 192 * 4] = {};
     uint32_t attribBuffer[2][256 * 192 * 4] = {};
@@ -0,0 +1,361 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <random>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "../core.h"
+#include "../crc16.h"
+#include "../settings.h"
+
+// Size of the SD image used for DLDI throughput, which should stay in the host's page cache
+#define SD_SIZE (64 << 20)
+
+static double seconds(std::chrono::steady_clock::time_point start) {
+    // Get the time since a starting point in seconds
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static Core *boot(const char *rom) {
+    // Boot a ROM with HLE BIOS and no system files, so benchmarks don't depend on the host
+    Settings::setDirectBoot(true);
+    Settings::setBios9Path("");
+    Settings::setBios7Path("");
+    Settings::setFirmwarePath("");
+    Settings::setGbaBiosPath("");
+    Settings::setRtcEpoch(0);
+    Settings::setFpsLimiter(0);
+    return new Core(rom);
+}
+
+static void benchCrc16() {
+    // Checksum a 1MB buffer repeatedly, like games verifying large save blocks
+    std::vector<uint8_t> data(1 << 20);
+    std::mt19937 random(0);
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = random();
+
+    uint32_t crc = 0xFFFF;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 256; i++)
+        crc = Crc16::calculate(crc, data.data(), data.size());
+    printf("crc16: %.0f MB/s (0x%04X)\n", 256 / seconds(start), crc);
+}
+
+static double dldiPass(Core *core, bool write, bool sequential, int sectors) {
+    // Transfer the whole SD image in runs of sectors to and from main RAM, in order or at random
+    std::mt19937 random(0);
+    int count = SD_SIZE / (sectors << 9);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++) {
+        int sector = (sequential ? i : (random() % count)) * sectors;
+        if (write)
+            core->dldi.writeSectors(0, sector, sectors, 0x2000000);
+        else
+            core->dldi.readSectors(0, sector, sectors, 0x2000000);
+    }
+    return SD_SIZE / (1 << 20) / seconds(start);
+}
+
+static void benchDldi(const char *rom) {
+    // Create a temporary SD image
+    char path[] = "/tmp/dees_bench_sd_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0 || ftruncate(fd, SD_SIZE) < 0) {
+        printf("dldi: failed to create an SD image\n");
+        return;
+    }
+    close(fd);
+
+    // Measure throughput through the block cache, with the cache disabled, and through a mapping
+    // Sequential runs use 128-sector transfers like file streaming, and random runs use 8-sector ones
+    Core *core = boot(rom);
+    Settings::setSdImagePath(path);
+    const char *modes[] = { "cached", "uncached", "mapped" };
+    for (int i = 0; i < 3; i++) {
+        Settings::setSdCacheSize(i == 1 ? 0 : 1024);
+        Settings::setSdImageMapped(i == 2);
+        core->dldi.startup();
+        dldiPass(core, false, true, 128); // Warm up the host's page cache
+        printf("dldi %-8s sequential read %7.0f MB/s, write %7.0f MB/s; random read %7.0f MB/s, write %7.0f MB/s\n",
+               modes[i], dldiPass(core, false, true, 128), dldiPass(core, true, true, 128),
+               dldiPass(core, false, false, 8), dldiPass(core, true, false, 8));
+        core->dldi.shutdown();
+    }
+
+    delete core;
+    unlink(path);
+}
+
+static void benchBoot(const char *rom) {
+    // Time core construction and boot to the end of the first frame, with transparent huge pages allowed and then
+    // disabled, since a huge page is faulted in and zeroed as a whole on first touch
+    for (int i = 0; i < 2; i++) {
+        if (i == 1) prctl(PR_SET_THP_DISABLE, 1, 0, 0, 0);
+        double construct = 0, frame = 0;
+        for (int j = 0; j < 20; j++) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            Core *core = boot(rom);
+            construct += seconds(start);
+            core->runFrame();
+            frame += seconds(start);
+            delete core;
+        }
+        printf("boot huge pages %-8s construct %.2f ms, first frame %.2f ms\n",
+               i ? "disabled" : "allowed", construct * 1000 / 20, frame * 1000 / 20);
+    }
+}
+
+static int openDtlbCounter() {
+    // Count dTLB load misses on this thread, or return -1 if the host doesn't allow it
+    perf_event_attr attr = {};
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void benchHugePages(const char *rom) {
+    // Run the same frames with transparent huge pages allowed, then disabled for the rest of the process
+    // Disabling only affects new mappings, so each pass boots a fresh core
+    for (int i = 0; i < 2; i++) {
+        if (i == 1) prctl(PR_SET_THP_DISABLE, 1, 0, 0, 0);
+        Core *core = boot(rom);
+        for (int j = 0; j < 60; j++)
+            core->runFrame();
+
+        int fd = openDtlbCounter();
+        uint64_t misses = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int j = 0; j < 600; j++)
+            core->runFrame();
+        double time = seconds(start);
+        if (fd >= 0 && ::read(fd, &misses, sizeof(misses)) != (ssize_t)sizeof(misses))
+            misses = 0;
+
+        // Report how much of the process is actually backed by huge pages
+        long hugeKb = 0;
+        char line[256];
+        if (FILE *file = fopen("/proc/self/smaps_rollup", "r")) {
+            while (fgets(line, sizeof(line), file) != nullptr)
+                sscanf(line, "AnonHugePages: %ld kB", &hugeKb);
+            fclose(file);
+        }
+
+        printf("huge pages %-8s %.2f ms/frame, %ld KB huge", i ? "disabled" : "allowed", time * 1000 / 600, hugeKb);
+        if (fd >= 0)
+            printf(", %.0f dTLB misses/frame\n", misses / 600.0);
+        else
+            printf(", dTLB misses unavailable\n");
+        if (fd >= 0) close(fd);
+        delete core;
+    }
+}
+
+static void benchRewind(const char *rom) {
+    // Time rewind captures over 10 seconds of play, then stepping all the way back
+    // This is done without and with run-ahead, since its state loads interact with the main RAM tracking
+    Settings::setRewindLength(10);
+    for (int ahead = 0; ahead <= 1; ahead++) {
+        Settings::setRunAhead(ahead);
+        Core *core = boot(rom);
+        for (int i = 0; i < 60; i++)
+            core->runFrame();
+
+        uint64_t total = 0, worst = 0, bytes = 0;
+        int captures = 0;
+        for (int i = 0; i < 600; i++) {
+            core->runFrame();
+            if (core->rewind.getCount() == 0 || (i & 3) != 3) continue;
+            total += core->rewind.getCaptureTime();
+            worst = std::max<uint64_t>(worst, core->rewind.getCaptureTime());
+            bytes += core->rewind.getCaptureBytes();
+            captures++;
+        }
+        printf("rewind capture, run-ahead %d: %.3f ms average, %.3f ms worst, %.1f KB per snapshot\n",
+               ahead, total / 1000.0 / captures, worst / 1000.0, bytes / 1024.0 / captures);
+
+        int steps = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        while (core->rewind.stepBack())
+            steps++;
+        printf("rewind step back, run-ahead %d: %.3f ms average over %d steps\n",
+               ahead, seconds(start) * 1000 / steps, steps);
+        delete core;
+    }
+    Settings::setRunAhead(0);
+    Settings::setRewindLength(0);
+}
+
+static void benchRunAhead(const char *rom) {
+    // Time frames with each amount of run-ahead, then the state save, load, and 3D redraw that each frame adds
+    Core *core = boot(rom);
+    for (int i = 0; i < 60; i++)
+        core->runFrame();
+
+    for (int ahead = 0; ahead <= 2; ahead++) {
+        Settings::setRunAhead(ahead);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int i = 0; i < 300; i++)
+            core->runFrame();
+        printf("run-ahead %d: %.3f ms per frame\n", ahead, seconds(start) * 1000 / 300);
+    }
+    Settings::setRunAhead(0);
+
+    State state;
+    double save = 0, load = 0, redraw = 0;
+    for (int i = 0; i < 100; i++) {
+        core->runFrame();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        core->saveState(state);
+        save += seconds(start);
+        start = std::chrono::steady_clock::now();
+        core->loadState(state, true);
+        load += seconds(start);
+
+        // Redraw all 3D lines like loading does at most, to split its cost out of the load
+        start = std::chrono::steady_clock::now();
+        for (int j = 0; j < 192; j++)
+            core->gpu3DRenderer.drawScanline(j);
+        redraw += seconds(start);
+    }
+    printf("run-ahead state: save %.3f ms, load %.3f ms including up to %.3f ms of 3D redraw, %.1f MB\n",
+           save * 10, load * 10, redraw * 10, state.getSize() / 1048576.0);
+    delete core;
+}
+
+static void benchPerf(const char *rom) {
+    // Count host CPU events per emulation phase over some frames, and report them per frame
+    Settings::setPerfCounters(1);
+    Core *core = boot(rom);
+    for (int i = 0; i < 60; i++)
+        core->runFrame();
+
+    const int frames = 300;
+    uint64_t totals[PHASE_COUNT][EVENT_COUNT] = {};
+    for (int i = 0; i < frames; i++) {
+        core->runFrame();
+        for (int j = 0; j < PHASE_COUNT; j++) {
+            for (int k = 0; k < EVENT_COUNT; k++)
+                totals[j][k] += core->perfCounters.getFrameCount((PerfPhase)j, (PerfEvent)k);
+        }
+    }
+
+    // Print a phase by event table, marking events that couldn't be counted on this host
+    printf("%-12s", "per frame");
+    for (int k = 0; k < EVENT_COUNT; k++)
+        printf(" %15s", PerfCounters::getEventName((PerfEvent)k));
+    printf("\n");
+    for (int j = 0; j < PHASE_COUNT; j++) {
+        printf("%-12s", PerfCounters::getPhaseName((PerfPhase)j));
+        for (int k = 0; k < EVENT_COUNT; k++) {
+            if (core->perfCounters.isAvailable((PerfEvent)k))
+                printf(" %15llu", (unsigned long long)(totals[j][k] / frames));
+            else
+                printf(" %15s", "unavailable");
+        }
+        printf("\n");
+    }
+
+    Settings::setPerfCounters(0);
+    delete core;
+}
+
+static void benchStats(const char *rom) {
+    // Print the stats published after a few seconds of play, without and with run-ahead
+    // Frames run ahead aren't shown, so the stats for both should cover the same work per frame
+    for (int ahead = 0; ahead <= 1; ahead++) {
+        Settings::setRunAhead(ahead);
+        Core *core = boot(rom);
+        for (int i = 0; i < 600; i++)
+            core->runFrame();
+        printf("stats, run-ahead %d: %s\n", ahead, Stats::toJson(core->stats.getSnapshot()).c_str());
+        delete core;
+    }
+    Settings::setRunAhead(0);
+}
+
+static bool benchWatch(const char *rom, const char *cpu, const char *address, const char *size, const char *type,
+                       bool breaks) {
+    // Parse the watchpoint, with the CPU given as 9 or 7 and the range in any base strtoul accepts
+    bool arm7 = !strcmp(cpu, "7");
+    uint8_t flags = !strcmp(type, "r") ? WATCH_READ : !strcmp(type, "w") ? WATCH_WRITE :
+        !strcmp(type, "rw") ? (WATCH_READ | WATCH_WRITE) : 0;
+    if ((!arm7 && strcmp(cpu, "9")) || !flags) return false;
+
+    // Run frames with the watchpoint set, stopping at the first break if it breaks
+    Core *core = boot(rom);
+    int id = core->memory.addWatchpoint(arm7, strtoul(address, nullptr, 0), strtoul(size, nullptr, 0), flags, breaks);
+    if (id < 0) {
+        delete core;
+        return false;
+    }
+    const int frames = 300;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; i++) {
+        core->runFrame();
+        if (core->memory.takeWatchBreak()) {
+            printf("watch break in frame %d\n", i);
+            break;
+        }
+    }
+    printf("watch: %.3f s\n", seconds(start));
+
+    // Print the opcodes that hit the watchpoint, from most to fewest hits
+    for (const Watchpoint &watch: core->memory.getWatchpoints()) {
+        if (watch.id != id) continue;
+        std::vector<std::pair<uint32_t, uint64_t>> hits(watch.hits.begin(), watch.hits.end());
+        std::sort(hits.begin(), hits.end(), [](auto &a, auto &b) {
+            return (a.second != b.second) ? (a.second > b.second) : (a.first < b.first);
+        });
+        printf("%zu opcodes hit the watchpoint\n", hits.size());
+        for (size_t i = 0; i < hits.size(); i++)
+            printf("PC 0x%08X: %llu\n", hits[i].first, (unsigned long long)hits[i].second);
+    }
+
+    core->memory.removeWatchpoint(id);
+    delete core;
+    return true;
+}
+
+static int usage(const char *name) {
+    // Print the available benchmarks, returning the exit code for bad arguments
+    fprintf(stderr, "Usage: %s crc16 | boot rom | dldi rom | hugepages rom | perf rom | rewind rom | runahead rom |"
+        " stats rom | watch rom 9|7 address size r|w|rw [break]\n", name);
+    return 2;
+}
+
+int main(int argc, char **argv) {
+    // Run the requested benchmark, with a ROM for the ones that need a core
+    if (argc >= 2 && !strcmp(argv[1], "crc16")) {
+        benchCrc16();
+    } else if (argc >= 3 && !strcmp(argv[1], "boot")) {
+        benchBoot(argv[2]);
+    } else if (argc >= 3 && !strcmp(argv[1], "dldi")) {
+        benchDldi(argv[2]);
+    } else if (argc >= 3 && !strcmp(argv[1], "hugepages")) {
+        benchHugePages(argv[2]);
+    } else if (argc >= 3 && !strcmp(argv[1], "rewind")) {
+        benchRewind(argv[2]);
+    } else if (argc >= 3 && !strcmp(argv[1], "perf")) {
+        benchPerf(argv[2]);
+    } else if (argc >= 3 && !strcmp(argv[1], "runahead")) {
+        benchRunAhead(argv[2]);
+    } else if (argc >= 3 && !strcmp(argv[1], "stats")) {
+        benchStats(argv[2]);
+    } else if (argc >= 7 && !strcmp(argv[1], "watch")) {
+        if (!benchWatch(argv[2], argv[3], argv[4], argv[5], argv[6], argc >= 8 && !strcmp(argv[7], "break")))
+            return usage(argv[0]);
+    } else {
+        return usage(argv[0]);
+    }
+    return 0;
+}
@@ -0,0 +1,262 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "../core.h"
+#include "../settings.h"
+
+// Where the test code, compressed data, and output are placed in ARM9 main RAM
+#define CODE_ADDR 0x2300000
+#define SRC_ADDR 0x2200000
+#define DST_ADDR 0x2280000
+#define DATA_SIZE 0x1000
+
+// Offsets in the code area; the offset callbacks add 0x2000000 to the source they're given
+#define STUB 0x000
+#define OFFSET_OPEN 0x040
+#define OFFSET_GET8 0x060
+#define OFFSET_GET32 0x080
+#define OFFSET_CLOSE 0x0A0
+#define PLAIN_OPEN 0x100
+#define PLAIN_GET8 0x110
+#define PLAIN_GET32 0x120
+#define OFFSET_STRUCT 0x200
+#define PLAIN_STRUCT 0x220
+#define LAST_SOURCE 0xF00
+#define LAST_PARAM 0xF04
+
+struct Result {
+    uint32_t value;
+    uint32_t lastSource;
+    uint32_t lastParam;
+    std::vector<uint8_t> output;
+};
+
+static std::vector<uint8_t> makeData() {
+    // Mix runs, repeated patterns, and noise so each format has something to compress
+    std::vector<uint8_t> data(DATA_SIZE);
+    uint32_t seed = 1;
+    for (size_t i = 0; i < data.size(); i++) {
+        seed = seed * 1103515245 + 12345;
+        switch ((i >> 8) & 3) {
+            case 0: data[i] = (i >> 5) & 0xFF; break;
+            case 1: data[i] = "DeeS BIOS test "[i % 15]; break;
+            default: data[i] = seed >> 24; break;
+        }
+    }
+    return data;
+}
+
+static std::vector<uint8_t> header(uint8_t type, size_t size) {
+    return { type, (uint8_t)size, (uint8_t)(size >> 8), (uint8_t)(size >> 16) };
+}
+
+static std::vector<uint8_t> lz77Compress(const std::vector<uint8_t> &data) {
+    // Compress greedily, keeping displacements of at least 2 so the 16-bit version decodes it
+    std::vector<uint8_t> out = header(0x10, data.size());
+    for (size_t i = 0; i < data.size();) {
+        size_t flags = out.size();
+        out.push_back(0);
+        for (int bit = 7; bit >= 0 && i < data.size(); bit--) {
+            size_t bestLength = 0, bestDisp = 0;
+            for (size_t disp = 2; disp <= 0x1000 && disp <= i; disp++) {
+                size_t length = 0;
+                while (length < 18 && i + length < data.size() && data[i + length] == data[i + length - disp])
+                    length++;
+                if (length > bestLength) {
+                    bestLength = length;
+                    bestDisp = disp;
+                }
+            }
+            if (bestLength >= 3) {
+                out[flags] |= 1 << bit;
+                out.push_back(((bestLength - 3) << 4) | ((bestDisp - 1) >> 8));
+                out.push_back(bestDisp - 1);
+                i += bestLength;
+            } else {
+                out.push_back(data[i++]);
+            }
+        }
+    }
+    return out;
+}
+
+static std::vector<uint8_t> runlenCompress(const std::vector<uint8_t> &data) {
+    // Encode runs of 3 or more as compressed blocks and everything else as literal blocks
+    std::vector<uint8_t> out = header(0x30, data.size());
+    for (size_t i = 0; i < data.size();) {
+        size_t run = 1;
+        while (run < 130 && i + run < data.size() && data[i + run] == data[i])
+            run++;
+        if (run >= 3) {
+            out.push_back(0x80 | (run - 3));
+            out.push_back(data[i]);
+            i += run;
+            continue;
+        }
+        size_t start = i;
+        while (i < data.size() && i - start < 128 && !(i + 2 < data.size() &&
+               data[i] == data[i + 1] && data[i] == data[i + 2]))
+            i++;
+        out.push_back(i - start - 1);
+        out.insert(out.end(), data.begin() + start, data.begin() + i);
+    }
+    return out;
+}
+
+static std::vector<uint8_t> huffCompress(const std::vector<uint8_t> &data) {
+    // Use a balanced tree for 4-bit data, where each value's code is its own 4 bits
+    // Node p has its children at 2p and 2p+1, and the values are the leaves at 16-31
+    std::vector<uint8_t> out = header(0x24, data.size());
+    out.push_back(15);
+    for (uint32_t p = 1; p < 16; p++)
+        out.push_back(((2 * p - (p & ~1) - 2) / 2) | (p >= 8 ? 0xC0 : 0));
+    for (uint32_t p = 16; p < 32; p++)
+        out.push_back(p - 16);
+
+    // Each output word holds 8 values from the low nibble up, and the bitstream is read from the top bit down
+    for (size_t i = 0; i < data.size(); i += 4) {
+        uint32_t bits = 0;
+        for (int j = 0; j < 8; j++)
+            bits |= ((data[i + j / 2] >> ((j & 1) * 4)) & 0xF) << (28 - j * 4);
+        for (int j = 0; j < 4; j++)
+            out.push_back(bits >> (j * 8));
+    }
+    return out;
+}
+
+static void setupCode(Core *core) {
+    static const uint32_t code[][2] = {
+        { STUB + 0x00, 0xE92D4000 }, // STMFD SP!,{LR}
+        { STUB + 0x04, 0xE59F3004 }, // LDR R3,[PC,#4]
+        { STUB + 0x08, 0xEF000000 }, // SWI (the comment is filled in per call)
+        { STUB + 0x0C, 0xE8BD8000 }, // LDMFD SP!,{PC}
+        { OFFSET_OPEN + 0x00, 0xE2800402 }, // ADD R0,R0,#0x2000000
+        { OFFSET_OPEN + 0x04, 0xE3A01623 }, // MOV R1,#0x2300000
+        { OFFSET_OPEN + 0x08, 0xE5812F04 }, // STR R2,[R1,#0xF04]
+        { OFFSET_OPEN + 0x0C, 0xE5900000 }, // LDR R0,[R0]
+        { OFFSET_OPEN + 0x10, 0xE12FFF1E }, // BX LR
+        { OFFSET_GET8 + 0x00, 0xE2800402 }, // ADD R0,R0,#0x2000000
+        { OFFSET_GET8 + 0x04, 0xE5D00000 }, // LDRB R0,[R0]
+        { OFFSET_GET8 + 0x08, 0xE12FFF1E }, // BX LR
+        { OFFSET_GET32 + 0x00, 0xE2800402 }, // ADD R0,R0,#0x2000000
+        { OFFSET_GET32 + 0x04, 0xE5900000 }, // LDR R0,[R0]
+        { OFFSET_GET32 + 0x08, 0xE12FFF1E }, // BX LR
+        { OFFSET_CLOSE + 0x00, 0xE3A01623 }, // MOV R1,#0x2300000
+        { OFFSET_CLOSE + 0x04, 0xE5810F00 }, // STR R0,[R1,#0xF00]
+        { OFFSET_CLOSE + 0x08, 0xE3A00000 }, // MOV R0,#0
+        { OFFSET_CLOSE + 0x0C, 0xE12FFF1E }, // BX LR
+        { PLAIN_OPEN + 0x00, 0xE5900000 }, // LDR R0,[R0]
+        { PLAIN_OPEN + 0x04, 0xE12FFF1E }, // BX LR
+        { PLAIN_GET8 + 0x00, 0x47707800 }, // LDRB R0,[R0] / BX LR (THUMB)
+        { PLAIN_GET32 + 0x00, 0xE5900000 }, // LDR R0,[R0]
+        { PLAIN_GET32 + 0x04, 0xE12FFF1E }, // BX LR
+        { OFFSET_STRUCT + 0x00, CODE_ADDR + OFFSET_OPEN },
+        { OFFSET_STRUCT + 0x04, CODE_ADDR + OFFSET_CLOSE },
+        { OFFSET_STRUCT + 0x08, CODE_ADDR + OFFSET_GET8 },
+        { OFFSET_STRUCT + 0x0C, 0 },
+        { OFFSET_STRUCT + 0x10, CODE_ADDR + OFFSET_GET32 },
+        { PLAIN_STRUCT + 0x00, CODE_ADDR + PLAIN_OPEN },
+        { PLAIN_STRUCT + 0x04, 0 },
+        { PLAIN_STRUCT + 0x08, CODE_ADDR + PLAIN_GET8 + 1 },
+        { PLAIN_STRUCT + 0x0C, 0 },
+        { PLAIN_STRUCT + 0x10, CODE_ADDR + PLAIN_GET32 },
+    };
+    for (auto &word : code)
+        core->memory.write<uint32_t>(0, CODE_ADDR + word[0], word[1]);
+}
+
+static Result decompress(Core *core, uint8_t swi, bool plain, const std::vector<uint8_t> &src) {
+    // Place the compressed data and clear the output and callback records
+    for (size_t i = 0; i < src.size(); i++)
+        core->memory.write<uint8_t>(0, SRC_ADDR + i, src[i]);
+    for (uint32_t i = 0; i < DATA_SIZE + 0x100; i += 4)
+        core->memory.write<uint32_t>(0, DST_ADDR + i, 0);
+    core->memory.write<uint32_t>(0, CODE_ADDR + LAST_SOURCE, 0);
+    core->memory.write<uint32_t>(0, CODE_ADDR + LAST_PARAM, 0);
+
+    // Call the SWI through the stub, giving the offset callbacks a source they have to translate
+    core->memory.write<uint32_t>(0, CODE_ADDR + STUB + 0x08, 0xEF000000 | (swi << 16));
+    core->memory.write<uint32_t>(0, CODE_ADDR + STUB + 0x10, CODE_ADDR + (plain ? PLAIN_STRUCT : OFFSET_STRUCT));
+    uint32_t source = plain ? SRC_ADDR : (SRC_ADDR - 0x2000000);
+    Result result;
+    result.value = core->interpreter[0].callGuest(CODE_ADDR + STUB, source, DST_ADDR, 0x1234);
+    result.lastSource = core->memory.read<uint32_t>(0, CODE_ADDR + LAST_SOURCE);
+    result.lastParam = core->memory.read<uint32_t>(0, CODE_ADDR + LAST_PARAM);
+    for (uint32_t i = 0; i < DATA_SIZE; i++)
+        result.output.push_back(core->memory.read<uint8_t>(0, DST_ADDR + i));
+    return result;
+}
+
+static Core *boot(const char *rom, const char *bios9) {
+    Settings::setDirectBoot(true);
+    Settings::setBios9Path(bios9);
+    Settings::setBios7Path("");
+    Settings::setFirmwarePath("");
+    Settings::setSdImagePath("");
+    Core *core = new Core(rom);
+    core->runFrame();
+    setupCode(core);
+    return core;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s rom [bios9]\n", argv[0]);
+        return 2;
+    }
+
+    std::vector<uint8_t> data = makeData();
+    struct Case { const char *name; uint8_t swi; std::vector<uint8_t> src; } cases[] = {
+        { "LZ77", 0x12, lz77Compress(data) },
+        { "Huffman", 0x13, huffCompress(data) },
+        { "RLE", 0x15, runlenCompress(data) },
+    };
+
+    // Check HLE output against the original data, with plain and offset callbacks
+    Core *core = boot(argv[1], "");
+    int failures = 0;
+    Result results[3];
+    for (int i = 0; i < 3; i++) {
+        for (int plain = 1; plain >= 0; plain--) {
+            Result result = decompress(core, cases[i].swi, plain, cases[i].src);
+            const char *type = plain ? "plain" : "offset";
+            if (result.output != data) {
+                printf("%s with %s callbacks: output differs\n", cases[i].name, type);
+                failures++;
+            }
+            if (result.value != DATA_SIZE) {
+                printf("%s with %s callbacks: returned 0x%X\n", cases[i].name, type, result.value);
+                failures++;
+            }
+            if (plain) continue;
+            if (result.lastParam != 0x1234 || result.lastSource != SRC_ADDR - 0x2000000 + cases[i].src.size()) {
+                printf("%s with offset callbacks: open got 0x%X, close got 0x%X\n", cases[i].name,
+                       result.lastParam, result.lastSource);
+                failures++;
+            }
+            results[i] = result;
+        }
+    }
+    delete core;
+
+    // Compare HLE against a real BIOS if one is given
+    if (argc > 2) {
+        core = boot(argv[1], argv[2]);
+        for (int i = 0; i < 3; i++) {
+            Result result = decompress(core, cases[i].swi, false, cases[i].src);
+            if (result.output != results[i].output || result.value != results[i].value ||
+                    result.lastSource != results[i].lastSource || result.lastParam != results[i].lastParam) {
+                printf("%s: HLE doesn't match the BIOS (returned 0x%X/0x%X, close got 0x%X/0x%X)\n", cases[i].name,
+                       results[i].value, result.value, results[i].lastSource, result.lastSource);
+                failures++;
+            }
+        }
+        delete core;
+    } else {
+        printf("No BIOS given; skipping the differential test\n");
+    }
+
+    printf("%s\n", failures ? "FAIL" : "PASS");
+    return failures ? 1 : 0;
+}
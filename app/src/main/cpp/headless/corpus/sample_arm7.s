@@ -0,0 +1,24 @@
+@ ARM7 side of the sample ROM: plays two PSG tones and idles
+.arm
+.text
+_start:
+  ldr r0, =0x04000304 @ Power on sound
+  mov r1, #1
+  strh r1, [r0]
+  ldr r0, =0x04000500 @ Enable sound at full master volume
+  ldr r1, =0x807F
+  strh r1, [r0]
+  ldr r0, =0x04000488 @ Start channel 8 as a PSG tone, centered
+  ldr r1, =0xFC00
+  strh r1, [r0]
+  ldr r0, =0x04000480
+  ldr r1, =0xE340007F
+  str r1, [r0]
+  ldr r0, =0x04000498 @ Start channel 9 as a lower and quieter PSG tone
+  ldr r1, =0xFE00
+  strh r1, [r0]
+  ldr r0, =0x04000490
+  ldr r1, =0xE040005F
+  str r1, [r0]
+l: b l
+.ltorg
@@ -0,0 +1,86 @@
+@ ARM9 side of the sample ROM: draws a triangle that moves each frame and scribbles over main RAM
+.arm
+.text
+_start:
+  ldr r0, =0x04000304 @ Power on both screens and the 3D engines
+  ldr r1, =0x820F
+  strh r1, [r0]
+  mov r0, #0x04000000 @ Show BG0 as 3D
+  ldr r1, =0x00010108
+  str r1, [r0]
+  ldr r0, =0x04000350 @ Set the clear color and depth
+  ldr r1, =0x001F7C00
+  str r1, [r0]
+  ldr r0, =0x04000354
+  ldr r1, =0x7FFF
+  strh r1, [r0]
+  mov r5, #0 @ Frame count
+  ldr r6, =12345 @ Random seed
+loop:
+  ldr r0, =0x04000006 @ Wait for V-blank
+w1:
+  ldrh r1, [r0]
+  cmp r1, #192
+  bne w1
+  ldr r0, =0x04000440 @ Reset the projection and position matrices
+  mov r1, #0
+  str r1, [r0]
+  ldr r0, =0x04000454
+  str r1, [r0]
+  ldr r0, =0x04000440
+  mov r1, #2
+  str r1, [r0]
+  ldr r0, =0x04000454
+  str r1, [r0]
+  ldr r0, =0x04000580 @ Set the viewport
+  ldr r1, =0xBFFF0000
+  str r1, [r0]
+  ldr r0, =0x040004A4 @ Set the polygon attributes
+  ldr r1, =0x001F00C0
+  str r1, [r0]
+  ldr r0, =0x04000500 @ Begin triangles, colored by the frame count
+  mov r1, #0
+  str r1, [r0]
+  ldr r0, =0x04000480
+  and r1, r5, #0x1F
+  str r1, [r0]
+  ldr r0, =0x0400048C @ Send three vertices, with the first moved by the frame count
+  and r2, r5, #0x3F
+  lsl r2, r2, #5
+  ldr r1, =0x0800F800
+  add r1, r1, r2
+  str r1, [r0]
+  mov r1, #0
+  str r1, [r0]
+  ldr r1, =0x08000800
+  str r1, [r0]
+  mov r1, #0
+  str r1, [r0]
+  ldr r1, =0xF8000000
+  str r1, [r0]
+  mov r1, #0
+  str r1, [r0]
+  ldr r0, =0x04000504 @ End the list and swap buffers
+  str r1, [r0]
+  ldr r0, =0x04000540
+  str r1, [r0]
+  mov r7, #256 @ Write 256 random words to main RAM
+  ldr r2, =1103515245
+  ldr r8, =12345
+  ldr r9, =0x000FFFFC
+rw:
+  mul r4, r6, r2
+  add r6, r4, r8
+  and r3, r6, r9
+  add r3, r3, #0x02100000
+  str r6, [r3]
+  subs r7, r7, #1
+  bne rw
+  add r5, r5, #1
+  ldr r0, =0x04000006 @ Wait for V-blank to end
+w2:
+  ldrh r1, [r0]
+  cmp r1, #192
+  beq w2
+  b loop
+.ltorg
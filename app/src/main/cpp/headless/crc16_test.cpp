@@ -0,0 +1,64 @@
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "../crc16.h"
+
+static uint32_t bitwise(uint32_t value, const uint8_t *data, size_t size) {
+    // Calculate a CRC16 value the way the BIOS does, which the table-driven version must match
+    static const uint16_t table[] = {0xC0C1, 0xC181, 0xC301, 0xC601, 0xCC01, 0xD801, 0xF001, 0xA001};
+    for (size_t i = 0; i < size; i++) {
+        value ^= data[i];
+        for (size_t j = 0; j < 8; j++)
+            value = (value >> 1) ^ ((value & 1) ? (table[j] << (7 - j)) : 0);
+    }
+    return value;
+}
+
+int main() {
+    int failures = 0;
+
+    // Check known vectors for this polynomial, which is CRC-16/ARC with a 0 start and CRC-16/MODBUS with 0xFFFF
+    const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    const struct { uint32_t start, result; } vectors[] = { {0x0000, 0xBB3D}, {0xFFFF, 0x4B37} };
+    for (auto &vector : vectors) {
+        uint32_t result = Crc16::calculate(vector.start, check, sizeof(check));
+        if (result != vector.result) {
+            printf("Start 0x%X: got 0x%X, expected 0x%X\n", vector.start, result, vector.result);
+            failures++;
+        }
+    }
+
+    // Compare against the bitwise version over every length and alignment around the 8-byte stride,
+    // including starting values above 16 bits, which the BIOS allows
+    std::vector<uint8_t> data(4096 + 8);
+    std::mt19937 random(0);
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = random();
+
+    const uint32_t starts[] = {0x0000, 0xFFFF, 0x1234, 0x12345678, 0xFFFFFFFF};
+    for (uint32_t start : starts) {
+        for (size_t size = 0; size <= 4096; size += (size < 64) ? 1 : 61) {
+            for (size_t offset = 0; offset < 8; offset++) {
+                uint32_t result = Crc16::calculate(start, &data[offset], size);
+                uint32_t expected = bitwise(start, &data[offset], size);
+                if (result == expected) continue;
+                printf("Start 0x%X, size %zu, offset %zu: got 0x%X, expected 0x%X\n",
+                       start, size, offset, result, expected);
+                failures++;
+            }
+        }
+
+        // Check that single-byte updates match as well
+        uint32_t value = start;
+        for (size_t i = 0; i < 100; i++)
+            value = Crc16::update(value, data[i]);
+        if (value != bitwise(start, data.data(), 100)) {
+            printf("Start 0x%X: byte updates got 0x%X, expected 0x%X\n", start, value, bitwise(start, data.data(), 100));
+            failures++;
+        }
+    }
+
+    printf("%s\n", failures ? "FAIL" : "PASS");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,84 @@
+#include <cstdio>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../core.h"
+#include "../settings.h"
+
+// Size of the SD image, which is deliberately not a multiple of the 4KB cache block size
+#define IMAGE_SIZE (0x5000 + 0x600)
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s rom\n", argv[0]);
+        return 2;
+    }
+
+    // Create an SD image filled with a pattern
+    char path[] = "/tmp/dees_dldi_test_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) return 2;
+    for (int i = 0; i < IMAGE_SIZE; i++) {
+        uint8_t value = i * 3;
+        if (write(fd, &value, 1) != 1) return 2;
+    }
+    close(fd);
+
+    Settings::setDirectBoot(true);
+    Settings::setBios9Path("");
+    Settings::setBios7Path("");
+    Settings::setFirmwarePath("");
+    Settings::setSdImagePath(path);
+    Core *core = new Core(argv[1]);
+    int failures = 0;
+
+    // Write the last sectors of the image in each mode, and check they persist without the image growing
+    const char *modes[] = { "cached", "uncached", "mapped" };
+    for (int i = 0; i < 3; i++) {
+        Settings::setSdCacheSize(i == 1 ? 0 : 1024);
+        Settings::setSdImageMapped(i == 2);
+        core->dldi.startup();
+
+        for (int j = 0; j < 0x600; j++)
+            core->memory.write<uint8_t>(0, 0x2000000 + j, j + i);
+        if (!core->dldi.writeSectors(0, 0x5000 >> 9, 3, 0x2000000)) {
+            printf("%s: writing the last sectors failed\n", modes[i]);
+            failures++;
+        }
+        if (core->dldi.writeSectors(0, IMAGE_SIZE >> 9, 1, 0x2000000)) {
+            printf("%s: writing past the end succeeded\n", modes[i]);
+            failures++;
+        }
+        if (!core->dldi.flushCache()) {
+            printf("%s: flushing failed\n", modes[i]);
+            failures++;
+        }
+
+        // Check the file while the image is still open, like after pausing
+        struct stat st;
+        if (stat(path, &st) != 0 || st.st_size != IMAGE_SIZE) {
+            printf("%s: image size changed to 0x%llX\n", modes[i], (unsigned long long)st.st_size);
+            failures++;
+        }
+        FILE *file = fopen(path, "rb");
+        uint8_t data[0x600] = {};
+        if (!file || fseek(file, 0x5000, SEEK_SET) || fread(data, 1, 0x600, file) != 0x600) {
+            printf("%s: failed to read back the image\n", modes[i]);
+            failures++;
+        } else {
+            for (int j = 0; j < 0x600; j++) {
+                if (data[j] == (uint8_t)(j + i)) continue;
+                printf("%s: byte 0x%X wasn't written back\n", modes[i], 0x5000 + j);
+                failures++;
+                break;
+            }
+        }
+        if (file) fclose(file);
+        core->dldi.shutdown();
+    }
+
+    delete core;
+    unlink(path);
+    printf("%s\n", failures ? "FAIL" : "PASS");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,97 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../core.h"
+#include "../settings.h"
+
+// Number of frames between rewind snapshots
+#define CAPTURE_FRAMES 4
+
+static uint64_t hashState(Core *core) {
+    // Hash the full state, including the main RAM and VRAM that rewind keeps out of its own states
+    State state;
+    core->saveState(state);
+    uint64_t hash = 0xCBF29CE484222325;
+    for (size_t i = 0; i < state.getSize(); i++)
+        hash = (hash ^ state.getData()[i]) * 0x100000001B3;
+    return hash;
+}
+
+static void runCaptures(Core *core, int captures, std::vector<uint64_t> &hashes) {
+    // Run until each of the next snapshots is captured, hashing the state each one should restore
+    for (int i = 0; i < captures * CAPTURE_FRAMES; i++) {
+        core->runFrame();
+        if (i % CAPTURE_FRAMES == CAPTURE_FRAMES - 1)
+            hashes.push_back(hashState(core));
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s rom [run-ahead frames]\n", argv[0]);
+        return 2;
+    }
+
+    // Keep 1 second of snapshots, which wraps around in the captures below
+    // Run-ahead can be enabled too, since its state loads must not hide main RAM writes from rewind
+    Settings::setDirectBoot(true);
+    Settings::setBios9Path("");
+    Settings::setBios7Path("");
+    Settings::setFirmwarePath("");
+    Settings::setSdImagePath("");
+    Settings::setRewindLength(1);
+    Settings::setRunAhead((argc >= 3) ? atoi(argv[2]) : 0);
+    Core *core = new Core(argv[1]);
+    int failures = 0;
+
+    // Step all the way back, checking that each step restores the state from when its snapshot was captured
+    // A few frames past the newest snapshot are run first, so the first step also has to undo them
+    std::vector<uint64_t> hashes;
+    runCaptures(core, 25, hashes);
+    for (int i = 0; i < CAPTURE_FRAMES / 2; i++)
+        core->runFrame();
+    size_t steps = core->rewind.getCount();
+    for (size_t i = 1; i <= steps; i++) {
+        if (!core->rewind.stepBack()) {
+            printf("step %zu: stepping back failed\n", i);
+            failures++;
+            break;
+        }
+        if (hashState(core) != hashes[hashes.size() - 1 - i]) {
+            printf("step %zu: state doesn't match its snapshot\n", i);
+            failures++;
+        }
+    }
+    if (core->rewind.stepBack()) {
+        printf("stepping back past the oldest snapshot succeeded\n");
+        failures++;
+    }
+
+    // Run forward from the oldest snapshot, which should replay the same states as the first time
+    size_t oldest = hashes.size() - 1 - steps;
+    std::vector<uint64_t> replay = { hashes[oldest] };
+    runCaptures(core, 10, replay);
+    for (size_t i = 1; i < replay.size(); i++) {
+        if (replay[i] != hashes[oldest + i]) {
+            printf("replay %zu: state differs from the first run\n", i);
+            failures++;
+            break;
+        }
+    }
+
+    // Step back over the replayed snapshots, which were captured on top of the restored one
+    for (size_t i = 1; i < replay.size(); i++) {
+        if (!core->rewind.stepBack() || hashState(core) != replay[replay.size() - 1 - i]) {
+            printf("replay step %zu: state doesn't match its snapshot\n", i);
+            failures++;
+            break;
+        }
+    }
+
+    Settings::setRewindLength(0);
+    Settings::setRunAhead(0);
+    delete core;
+    printf("%s\n", failures ? "FAIL" : "PASS");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,61 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "../lockstep.h"
+#include "../core.h"
+#include "../settings.h"
+
+int main(int argc, char **argv) {
+    // Parse a ROM and frame count, then options for the movie, register interval, and settings
+    // Settings given with --set apply to both cores, while --a and --b apply to only one
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s rom frames [--movie path] [--interval frames] "
+                        "[--set name=value] [--a name=value] [--b name=value]...\n", argv[0]);
+        return 2;
+    }
+
+    std::string rom = argv[1], movie;
+    int frames = atoi(argv[2]), interval = 1;
+    std::vector<std::string> settings[2];
+    for (int i = 3; i < argc - 1; i += 2) {
+        if (!strcmp(argv[i], "--movie")) {
+            movie = argv[i + 1];
+        } else if (!strcmp(argv[i], "--interval")) {
+            interval = atoi(argv[i + 1]);
+        } else if (!strcmp(argv[i], "--set")) {
+            settings[0].push_back(argv[i + 1]);
+            settings[1].push_back(argv[i + 1]);
+        } else if (!strcmp(argv[i], "--a") || !strcmp(argv[i], "--b")) {
+            settings[argv[i][2] - 'a'].push_back(argv[i + 1]);
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    // Boot the ROM on both cores, using the extension to tell NDS and GBA apart
+    Lockstep *lockstep;
+    try {
+        bool gba = rom.size() >= 4 && rom.compare(rom.size() - 4, 4, ".gba") == 0;
+        lockstep = new Lockstep(gba ? "" : rom, gba ? rom : "", settings[0], settings[1]);
+    } catch (CoreError e) {
+        fprintf(stderr, "Failed to boot %s\n", rom.c_str());
+        return 2;
+    }
+    if (!movie.empty() && !lockstep->startPlayback(movie)) {
+        fprintf(stderr, "Failed to load movie %s\n", movie.c_str());
+        delete lockstep;
+        return 2;
+    }
+
+    // Run the cores, reporting the first divergence if there is one
+    lockstep->setRegisterInterval(interval);
+    bool matched = lockstep->run(frames);
+    if (matched)
+        printf("Matched for %d frames\n", lockstep->getFrame());
+    else
+        printf("%s", lockstep->getReport().c_str());
+    delete lockstep;
+    return matched ? 0 : 1;
+}
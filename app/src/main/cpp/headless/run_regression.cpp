@@ -0,0 +1,17 @@
+#include <cstdio>
+#include <cstring>
+
+#include "../regression.h"
+
+int main(int argc, char **argv) {
+    // Run a regression corpus, or record its expected results, failing if any entry doesn't match
+    if (argc < 2 || (argc > 2 && strcmp(argv[2], "--record"))) {
+        fprintf(stderr, "Usage: %s corpus.txt [--record]\n", argv[0]);
+        return 2;
+    }
+
+    Regression regression(argv[1]);
+    bool passed = regression.run(argc > 2);
+    printf("%s", regression.getReport().c_str());
+    return passed ? 0 : 1;
+}
@@ -1,28 +1,221 @@
+#include <algorithm>
+
 #include "input.h"
 #include "core.h"
 
+#define MOVIE_MAGIC 0x564D5344 // "DSMV"
+#define MOVIE_VERSION 1
+#define SCREEN_BIT 12
+
+Input::~Input() {
+    // Finish any movie in progress
+    stopMovie();
+}
+
+void Input::queueEvent(InputEvent event) {
+    // Add an event to the ring if there's space, dropping it otherwise
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) == 256) {
+        LOG("Input queue is full; dropping event\n");
+        return;
+    }
+    events[t & 255] = event;
+    tail.store(t + 1, std::memory_order_release);
+}
+
 void Input::pressKey(int key) {
-    // Clear key bits to indicate presses
-    if (key < 10) // A, B, select, start, right, left, up, down, R, L
-        keyInput &= ~BIT(key);
-    else if (key < 12) // X, Y
-        extKeyIn &= ~BIT(key - 10);
+    // Queue a key press to be applied at the next V-blank
+    queueEvent({INPUT_PRESS_KEY, (uint8_t)key, 0, 0});
 }
 
 void Input::releaseKey(int key) {
-    // Set key bits to indicate releases
-    if (key < 10) // A, B, select, start, right, left, up, down, R, L
-        keyInput |= BIT(key);
-    else if (key < 12) // X, Y
-        extKeyIn |= BIT(key - 10);
+    // Queue a key release to be applied at the next V-blank
+    queueEvent({INPUT_RELEASE_KEY, (uint8_t)key, 0, 0});
 }
 
-void Input::pressScreen() {
-    // Clear the pen down bit to indicate a touch press
-    extKeyIn &= ~BIT(6);
+void Input::pressScreen(int x, int y) {
+    // Queue a touch press or move to be applied at the next V-blank, clamped to the touch screen
+    x = std::min(std::max(x, 0), 255);
+    y = std::min(std::max(y, 0), 191);
+    queueEvent({INPUT_PRESS_SCREEN, 0, (uint8_t)x, (uint8_t)y});
 }
 
 void Input::releaseScreen() {
-    // Set the pen down bit to indicate a touch release
-    extKeyIn |= BIT(6);
+    // Queue a touch release to be applied at the next V-blank
+    queueEvent({INPUT_RELEASE_SCREEN, 0, 0, 0});
+}
+
+int Input::getBit(InputEvent &event) {
+    // Get the state bit an event affects: 0-11 for keys, or the screen bit for touches
+    switch (event.type) {
+        case INPUT_PRESS_KEY: case INPUT_RELEASE_KEY:
+            return (event.key < 12) ? event.key : -1;
+        case INPUT_PRESS_SCREEN: case INPUT_RELEASE_SCREEN:
+            return SCREEN_BIT;
+        default:
+            return -1;
+    }
+}
+
+bool Input::isHeld(int bit) {
+    // Check if a key or the screen is currently pressed
+    if (bit < 10) // A, B, select, start, right, left, up, down, R, L
+        return !(keyInput & BIT(bit));
+    else if (bit < 12) // X, Y
+        return !(extKeyIn & BIT(bit - 10));
+    else // Pen down
+        return !(extKeyIn & BIT(6));
+}
+
+void Input::applyEvent(InputEvent &event) {
+    uint16_t lastKeys = keyInput, lastExt = extKeyIn;
+    uint8_t lastX = touchX, lastY = touchY;
+    int bit = getBit(event);
+    if (bit < 0) return;
+
+    switch (event.type) {
+        case INPUT_PRESS_KEY:
+            // Clear key bits to indicate presses
+            if (bit < 10) // A, B, select, start, right, left, up, down, R, L
+                keyInput &= ~BIT(bit);
+            else // X, Y
+                extKeyIn &= ~BIT(bit - 10);
+            break;
+
+        case INPUT_RELEASE_KEY:
+            // Set key bits to indicate releases
+            if (bit < 10) // A, B, select, start, right, left, up, down, R, L
+                keyInput |= BIT(bit);
+            else // X, Y
+                extKeyIn |= BIT(bit - 10);
+            break;
+
+        case INPUT_PRESS_SCREEN:
+            // Clear the pen down bit to indicate a touch press, and set the touch position
+            extKeyIn &= ~BIT(6);
+            touchX = event.x;
+            touchY = event.y;
+            core->spi.setTouch(touchX, touchY);
+            break;
+
+        case INPUT_RELEASE_SCREEN:
+            // Set the pen down bit to indicate a touch release, and clear the touch position
+            extKeyIn |= BIT(6);
+            core->spi.clearTouch();
+            break;
+    }
+
+    // Record events that changed something, skipping repeats
+    if (keyInput != lastKeys || extKeyIn != lastExt || touchX != lastX || touchY != lastY)
+        recordEvent(event);
+}
+
+void Input::recordEvent(InputEvent &event) {
+    if (!recordFile) return;
+
+    // Write an event stamped with its frame as an 8-byte LSB-first record
+    uint8_t data[8];
+    U32TO8(data, 0, frame);
+    data[4] = event.type;
+    data[5] = event.key;
+    data[6] = event.x;
+    data[7] = event.y;
+    fwrite(data, sizeof(uint8_t), 8, recordFile);
+}
+
+void Input::update() {
+    // Hold the current input during run-ahead frames, which will be replayed for real later
+    if (frozen) return;
+
+    // Apply input at a fixed point each frame, so it lands at the same cycle every run
+    if (playing) {
+        // Apply movie events stamped with the current frame, and discard live input
+        while (movieIndex < movie.size() && movie[movieIndex].frame <= frame)
+            applyEvent(movie[movieIndex++].event);
+        head.store(tail.load(std::memory_order_acquire), std::memory_order_release);
+
+        // Return to live input once the movie ends
+        if (movieIndex == movie.size())
+            stopMovie();
+    } else {
+        // Apply queued events in order, deferring the rest once one would undo a change from this frame
+        // This keeps quick taps visible for at least a frame instead of cancelling out
+        uint16_t changed = 0;
+        uint32_t h = head.load(std::memory_order_relaxed);
+        while (h != tail.load(std::memory_order_acquire)) {
+            InputEvent &event = events[h & 255];
+            int bit = getBit(event);
+            if (bit >= 0) {
+                bool press = (event.type == INPUT_PRESS_KEY || event.type == INPUT_PRESS_SCREEN);
+                if (press != isHeld(bit)) {
+                    if (changed & BIT(bit)) break;
+                    changed |= BIT(bit);
+                }
+                applyEvent(event);
+            }
+            h++;
+        }
+        head.store(h, std::memory_order_release);
+    }
+
+    frame++;
+}
+
+bool Input::startRecording(const std::string &path) {
+    // Open a new movie file and write its header
+    stopMovie();
+    if (!(recordFile = fopen(path.c_str(), "wb")))
+        return false;
+    uint8_t header[8];
+    U32TO8(header, 0, MOVIE_MAGIC);
+    U32TO8(header, 4, MOVIE_VERSION);
+    fwrite(header, sizeof(uint8_t), 8, recordFile);
+
+    // Record the current state as events on the first frame, so playback starts from it
+    frame = 0;
+    for (int i = 0; i < 12; i++) {
+        InputEvent event = {INPUT_PRESS_KEY, (uint8_t)i, 0, 0};
+        if (isHeld(i)) recordEvent(event);
+    }
+    InputEvent event = {INPUT_PRESS_SCREEN, 0, touchX, touchY};
+    if (isHeld(SCREEN_BIT)) recordEvent(event);
+    return true;
+}
+
+bool Input::startPlayback(const std::string &path) {
+    // Load a movie file and check its header
+    stopMovie();
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+    uint8_t data[8];
+    if (fread(data, sizeof(uint8_t), 8, file) != 8 || U8TO32(data, 0) != MOVIE_MAGIC ||
+            U8TO32(data, 4) != MOVIE_VERSION) {
+        fclose(file);
+        return false;
+    }
+
+    // Read the events, which are stored in frame order
+    while (fread(data, sizeof(uint8_t), 8, file) == 8)
+        movie.push_back({(uint32_t)U8TO32(data, 0), {data[4], data[5], data[6], data[7]}});
+    fclose(file);
+
+    // Release everything so playback starts from the same state the movie did
+    keyInput = 0x03FF;
+    extKeyIn |= BIT(0) | BIT(1) | BIT(6);
+    core->spi.clearTouch();
+    frame = 0;
+    movieIndex = 0;
+    playing = true;
+    return true;
+}
+
+void Input::stopMovie() {
+    // Close the movie being recorded or played
+    if (recordFile) {
+        fclose(recordFile);
+        recordFile = nullptr;
+    }
+    movie.clear();
+    movieIndex = 0;
+    playing = false;
 }
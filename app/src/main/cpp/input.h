@@ -1,31 +1,90 @@
 #ifndef INPUT_H
 #define INPUT_H
 
+#include <atomic>
 #include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
 
 class Core;
 
+enum InputEventType {
+    INPUT_PRESS_KEY,
+    INPUT_RELEASE_KEY,
+    INPUT_PRESS_SCREEN,
+    INPUT_RELEASE_SCREEN
+};
+
+struct InputEvent {
+    uint8_t type;
+    uint8_t key;
+    uint8_t x, y;
+};
+
 class Input {
 public:
     Input(Core *core) : core(core) {}
 
+    ~Input();
+
     void pressKey(int key);
 
     void releaseKey(int key);
 
-    void pressScreen();
+    void pressScreen(int x, int y);
 
     void releaseScreen();
 
+    void update();
+
+    bool startRecording(const std::string &path);
+
+    bool startPlayback(const std::string &path);
+
+    void stopMovie();
+
+    void setFrozen(bool value) { frozen = value; }
+
+    bool isPlaying() { return playing; }
+
     uint16_t readKeyInput() { return keyInput; }
 
     uint16_t readExtKeyIn() { return extKeyIn; }
 
 private:
+    struct MovieEvent {
+        uint32_t frame;
+        InputEvent event;
+    };
+
     Core *core;
 
+    // Single-producer, single-consumer ring of events from the UI thread to the core
+    InputEvent events[256] = {};
+    std::atomic<uint32_t> head{0}, tail{0};
+
+    // Movies are started and stopped while the core isn't running
+    FILE *recordFile = nullptr;
+    std::vector<MovieEvent> movie;
+    size_t movieIndex = 0;
+    bool playing = false;
+    uint32_t frame = 0;
+    bool frozen = false;
+
     uint16_t keyInput = 0x03FF;
     uint16_t extKeyIn = 0x007F;
+    uint8_t touchX = 0, touchY = 0;
+
+    void queueEvent(InputEvent event);
+
+    int getBit(InputEvent &event);
+
+    bool isHeld(int bit);
+
+    void applyEvent(InputEvent &event);
+
+    void recordEvent(InputEvent &event);
 };
 
 #endif // INPUT_H
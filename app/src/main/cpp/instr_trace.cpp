@@ -0,0 +1,69 @@
+#include <algorithm>
+#include <cstdio>
+
+#include "instr_trace.h"
+#include "lz.h"
+#include "settings.h"
+
+#define INSTR_TRACE_MAGIC 0x54495344 // "DSIT"
+#define INSTR_TRACE_VERSION 1
+#define INSTR_TRACE_SIZE 0x100000 // Opcodes kept per CPU
+
+InstrTrace::InstrTrace() {
+    // Only allocate the rings if tracing is enabled
+    path = Settings::getInstrTracePath();
+    trigger = Settings::getInstrTraceTrigger();
+    if (isEnabled()) {
+        entries[0].resize(INSTR_TRACE_SIZE);
+        entries[1].resize(INSTR_TRACE_SIZE);
+    }
+}
+
+bool InstrTrace::dump() {
+    // Write the trace while the core isn't running, or from the core's own thread at a trigger
+    // The file has a header, then for each CPU the opcode count, uncompressed size, compressed size, and data
+    if (!isEnabled()) return false;
+    FILE *file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+    uint8_t header[8];
+    U32TO8(header, 0, INSTR_TRACE_MAGIC);
+    U32TO8(header, 4, INSTR_TRACE_VERSION);
+    fwrite(header, sizeof(uint8_t), 8, file);
+
+    for (int i = 0; i < 2; i++) {
+        std::vector<uint8_t> columns, data;
+        writeColumns(i, columns);
+        Lz::compress(columns.data(), columns.size(), data);
+
+        uint8_t sizes[12];
+        U32TO8(sizes, 0, columns.size() / 13);
+        U32TO8(sizes, 4, columns.size());
+        U32TO8(sizes, 8, data.size());
+        fwrite(sizes, sizeof(uint8_t), 12, file);
+        fwrite(data.data(), sizeof(uint8_t), data.size(), file);
+    }
+
+    fclose(file);
+    LOG("Wrote instruction trace to %s\n", path.c_str());
+    return true;
+}
+
+void InstrTrace::writeColumns(bool cpu, std::vector<uint8_t> &data) {
+    // Lay out the opcodes oldest first as separate columns, since like values compress better together
+    // PCs are stored as differences from the last PC, then opcodes, cycles, and CPSR mode bits
+    size_t count = std::min<uint64_t>(counts[cpu], entries[cpu].size());
+    uint64_t start = counts[cpu] - count;
+    data.resize(count * 13);
+    uint8_t *pcs = &data[0], *opcodes = pcs + count * 4;
+    uint8_t *cycles = opcodes + count * 4, *modes = cycles + count * 4;
+    uint32_t lastPc = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        Entry &entry = entries[cpu][(start + i) & (entries[cpu].size() - 1)];
+        U32TO8(pcs, i * 4, entry.pc - lastPc);
+        U32TO8(opcodes, i * 4, entry.opcode);
+        U32TO8(cycles, i * 4, entry.cycles);
+        modes[i] = entry.mode;
+        lastPc = entry.pc;
+    }
+}
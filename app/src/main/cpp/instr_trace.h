@@ -0,0 +1,57 @@
+#ifndef INSTR_TRACE_H
+#define INSTR_TRACE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "defines.h"
+
+// Ring of the most recent opcodes run by each CPU, written to a compressed file on demand or at a trigger address
+// Cores only record when tracing is enabled, using a separate variant of the run loop so others pay nothing
+class InstrTrace {
+public:
+    InstrTrace();
+
+    bool isEnabled() { return !path.empty(); }
+
+    void record(bool cpu, uint32_t pc, uint32_t opcode, uint8_t mode, uint64_t cycles);
+
+    bool dump();
+
+private:
+    struct Entry {
+        uint32_t pc;
+        uint32_t opcode;
+        uint32_t cycles;
+        uint8_t mode;
+    };
+
+    std::string path;
+    uint32_t trigger = -1;
+
+    std::vector<Entry> entries[2];
+    uint64_t counts[2] = {};
+    uint64_t lastCycles[2] = {};
+
+    void writeColumns(bool cpu, std::vector<uint8_t> &data);
+};
+
+FORCE_INLINE void InstrTrace::record(bool cpu, uint32_t pc, uint32_t opcode, uint8_t mode, uint64_t cycles) {
+    // Add an opcode to the ring, with the cycles since the CPU's last opcode
+    // This includes any time spent halted or stalled, unlike the opcode's own timing
+    Entry &entry = entries[cpu][counts[cpu]++ & (entries[cpu].size() - 1)];
+    entry.pc = pc;
+    entry.opcode = opcode;
+    entry.cycles = (cycles > lastCycles[cpu]) ? (cycles - lastCycles[cpu]) : 0;
+    entry.mode = mode;
+    lastCycles[cpu] = cycles;
+
+    // Write the trace the first time the trigger address is reached
+    if (pc == trigger) {
+        trigger = -1;
+        dump();
+    }
+}
+
+#endif // INSTR_TRACE_H
@@ -12,7 +12,7 @@
 int screenFilter = 1;
 int showFpsCounter = 0;
 
-std::string ndsPath, gbaPath;
+std::string ndsPath, gbaPath, dataPath;
 Core *core = nullptr;
 ScreenLayout layout;
 uint32_t framebuffer[256 * 192 * 8];
@@ -45,6 +45,7 @@ Java_com_antique_dees_GameBrowser_loadSettings(JNIEnv *env, jobject object, jstr
     const char *str = env->GetStringUTFChars(string, nullptr);
     std::string path = str;
     env->ReleaseStringUTFChars(string, str);
+    dataPath = path;
 
     std::vector<Setting> platformSettings = {
             Setting("screenFilter", &screenFilter, false),
@@ -380,6 +381,11 @@ Java_com_antique_dees_DeeSActivity_getFps(JNIEnv *env, jclass clazz) {
     return core->getFps();
 }
 
+extern "C" JNIEXPORT jstring JNICALL
+Java_com_antique_dees_GameActivity_getStats(JNIEnv *env, jobject object) {
+    return env->NewStringUTF(Stats::toJson(core->stats.getSnapshot()).c_str());
+}
+
 extern "C" JNIEXPORT jboolean JNICALL
 Java_com_antique_dees_GameSurface_isGbaMode(JNIEnv *env, jobject object) {
     return core->isGbaMode();
@@ -390,17 +396,32 @@ Java_com_antique_dees_GameActivity_runFrame(JNIEnv *env, jobject object) {
     core->runFrame();
 }
 
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_antique_dees_GameActivity_rewindStepBack(JNIEnv *env, jobject object) {
+    return core->rewind.stepBack();
+}
+
 extern "C" JNIEXPORT jboolean JNICALL
 Java_com_antique_dees_GameSurface_isRunning(JNIEnv *env, jobject object) {
     return core->isRunning();
 }
 
-extern "C" JNIEXPORT void JNICALL
+extern "C" JNIEXPORT jboolean JNICALL
 Java_com_antique_dees_GameActivity_writeSave(JNIEnv *env, jobject object) {
     if (core->isGbaMode())
         core->cartridgeGba.writeSave();
     else
         core->cartridgeNds.writeSave();
+
+    // Write back SD image changes held in the DLDI cache, reporting if they couldn't be written
+    return core->dldi.flushCache();
+}
+
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_antique_dees_GameActivity_writeTrace(JNIEnv *env, jobject object) {
+    // Write whichever traces are enabled
+    bool instrWritten = core->instrTrace.dump();
+    return Trace::dump(dataPath + "/trace.json") || instrWritten;
 }
 
 extern "C" JNIEXPORT void JNICALL
@@ -412,14 +433,12 @@ Java_com_antique_dees_GameActivity_restartCore(JNIEnv *env, jclass clazz) {
 
 extern "C" JNIEXPORT void JNICALL
 Java_com_antique_dees_GameSurface_pressScreen(JNIEnv *env, jobject object, jint int1, jint int2) {
-    core->input.pressScreen();
-    core->spi.setTouch(layout.getTouchX(int1, int2), layout.getTouchY(int1, int2));
+    core->input.pressScreen(layout.getTouchX(int1, int2), layout.getTouchY(int1, int2));
 }
 
 extern "C" JNIEXPORT void JNICALL
 Java_com_antique_dees_GameSurface_releaseScreen(JNIEnv *env, jobject object) {
     core->input.releaseScreen();
-    core->spi.clearTouch();
 }
 
 extern "C" JNIEXPORT void JNICALL
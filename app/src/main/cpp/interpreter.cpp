@@ -2639,6 +2639,32 @@ void Interpreter::directBoot() {
     flushPipeline();
 }
 
+void Interpreter::syncState(State &state) {
+    // Sync the registers and CPU state, leaving out pointers and scheduler tasks
+    state.var(pipeline);
+    state.var(registersUsr);
+    state.var(registersFiq);
+    state.var(registersSvc);
+    state.var(registersAbt);
+    state.var(registersIrq);
+    state.var(registersUnd);
+    state.var(cpsr);
+    state.var(spsrFiq);
+    state.var(spsrSvc);
+    state.var(spsrAbt);
+    state.var(spsrIrq);
+    state.var(spsrUnd);
+    state.var(halted);
+    state.var(ime);
+    state.var(ie);
+    state.var(irf);
+    state.var(postFlg);
+
+    // Point the banked registers to the loaded mode
+    if (!state.isSaving())
+        swapRegisters(cpsr & 0x1F);
+}
+
 void Interpreter::sendInterrupt(int bit) {
     // Set the interrupt's request bit
     irf |= BIT(bit);
@@ -2690,82 +2716,86 @@ void Interpreter::flushPipeline() {
     }
 }
 
-void Interpreter::setCpsr(uint32_t value, bool save) {
-    // Swap banked registers if the CPU mode changed
-    if ((value & 0x1F) != (cpsr & 0x1F)) {
-        switch (value & 0x1F) {
-            case 0x10: // User
-            case 0x1F: // System
-                registers[8] = &registersUsr[8];
-                registers[9] = &registersUsr[9];
-                registers[10] = &registersUsr[10];
-                registers[11] = &registersUsr[11];
-                registers[12] = &registersUsr[12];
-                registers[13] = &registersUsr[13];
-                registers[14] = &registersUsr[14];
-                spsr = nullptr;
-                break;
+void Interpreter::swapRegisters(uint8_t mode) {
+    // Point the register and SPSR pointers to the banks used by a CPU mode
+    switch (mode) {
+        case 0x10: // User
+        case 0x1F: // System
+            registers[8] = &registersUsr[8];
+            registers[9] = &registersUsr[9];
+            registers[10] = &registersUsr[10];
+            registers[11] = &registersUsr[11];
+            registers[12] = &registersUsr[12];
+            registers[13] = &registersUsr[13];
+            registers[14] = &registersUsr[14];
+            spsr = nullptr;
+            break;
 
-            case 0x11: // FIQ
-                registers[8] = &registersFiq[0];
-                registers[9] = &registersFiq[1];
-                registers[10] = &registersFiq[2];
-                registers[11] = &registersFiq[3];
-                registers[12] = &registersFiq[4];
-                registers[13] = &registersFiq[5];
-                registers[14] = &registersFiq[6];
-                spsr = &spsrFiq;
-                break;
+        case 0x11: // FIQ
+            registers[8] = &registersFiq[0];
+            registers[9] = &registersFiq[1];
+            registers[10] = &registersFiq[2];
+            registers[11] = &registersFiq[3];
+            registers[12] = &registersFiq[4];
+            registers[13] = &registersFiq[5];
+            registers[14] = &registersFiq[6];
+            spsr = &spsrFiq;
+            break;
 
-            case 0x12: // IRQ
-                registers[8] = &registersUsr[8];
-                registers[9] = &registersUsr[9];
-                registers[10] = &registersUsr[10];
-                registers[11] = &registersUsr[11];
-                registers[12] = &registersUsr[12];
-                registers[13] = &registersIrq[0];
-                registers[14] = &registersIrq[1];
-                spsr = &spsrIrq;
-                break;
+        case 0x12: // IRQ
+            registers[8] = &registersUsr[8];
+            registers[9] = &registersUsr[9];
+            registers[10] = &registersUsr[10];
+            registers[11] = &registersUsr[11];
+            registers[12] = &registersUsr[12];
+            registers[13] = &registersIrq[0];
+            registers[14] = &registersIrq[1];
+            spsr = &spsrIrq;
+            break;
 
-            case 0x13: // Supervisor
-                registers[8] = &registersUsr[8];
-                registers[9] = &registersUsr[9];
-                registers[10] = &registersUsr[10];
-                registers[11] = &registersUsr[11];
-                registers[12] = &registersUsr[12];
-                registers[13] = &registersSvc[0];
-                registers[14] = &registersSvc[1];
-                spsr = &spsrSvc;
-                break;
+        case 0x13: // Supervisor
+            registers[8] = &registersUsr[8];
+            registers[9] = &registersUsr[9];
+            registers[10] = &registersUsr[10];
+            registers[11] = &registersUsr[11];
+            registers[12] = &registersUsr[12];
+            registers[13] = &registersSvc[0];
+            registers[14] = &registersSvc[1];
+            spsr = &spsrSvc;
+            break;
 
-            case 0x17: // Abort
-                registers[8] = &registersUsr[8];
-                registers[9] = &registersUsr[9];
-                registers[10] = &registersUsr[10];
-                registers[11] = &registersUsr[11];
-                registers[12] = &registersUsr[12];
-                registers[13] = &registersAbt[0];
-                registers[14] = &registersAbt[1];
-                spsr = &spsrAbt;
-                break;
+        case 0x17: // Abort
+            registers[8] = &registersUsr[8];
+            registers[9] = &registersUsr[9];
+            registers[10] = &registersUsr[10];
+            registers[11] = &registersUsr[11];
+            registers[12] = &registersUsr[12];
+            registers[13] = &registersAbt[0];
+            registers[14] = &registersAbt[1];
+            spsr = &spsrAbt;
+            break;
 
-            case 0x1B: // Undefined
-                registers[8] = &registersUsr[8];
-                registers[9] = &registersUsr[9];
-                registers[10] = &registersUsr[10];
-                registers[11] = &registersUsr[11];
-                registers[12] = &registersUsr[12];
-                registers[13] = &registersUnd[0];
-                registers[14] = &registersUnd[1];
-                spsr = &spsrUnd;
-                break;
+        case 0x1B: // Undefined
+            registers[8] = &registersUsr[8];
+            registers[9] = &registersUsr[9];
+            registers[10] = &registersUsr[10];
+            registers[11] = &registersUsr[11];
+            registers[12] = &registersUsr[12];
+            registers[13] = &registersUnd[0];
+            registers[14] = &registersUnd[1];
+            spsr = &spsrUnd;
+            break;
 
-            default:
-                LOG("Unknown ARM%d CPU mode: 0x%X\n", ((cpu == 0) ? 9 : 7), value & 0x1F);
-                break;
-        }
+        default:
+            LOG("Unknown ARM%d CPU mode: 0x%X\n", ((cpu == 0) ? 9 : 7), mode);
+            break;
     }
+}
+
+void Interpreter::setCpsr(uint32_t value, bool save) {
+    // Swap banked registers if the CPU mode changed
+    if ((value & 0x1F) != (cpsr & 0x1F))
+        swapRegisters(value & 0x1F);
 
     // Set the CPSR, saving the old value if requested
     if (save && spsr) *spsr = cpsr;
@@ -10,6 +10,8 @@ class Core;
 
 class Bios;
 
+class State;
+
 class Interpreter {
 public:
     Interpreter(Core *core, bool cpu);
@@ -18,8 +20,13 @@ public:
 
     void directBoot();
 
+    void syncState(State &state);
+
+    template<bool traced>
     int runOpcode();
 
+    uint32_t callGuest(uint32_t address, uint32_t arg0, uint32_t arg1 = 0, uint32_t arg2 = 0);
+
     void halt(int bit) { halted |= BIT(bit); }
 
     void unhalt(int bit) { halted &= ~BIT(bit); }
@@ -32,6 +39,10 @@ public:
 
     uint32_t getPC() { return *registers[15]; }
 
+    uint32_t getRegister(int index) { return *registers[index]; }
+
+    uint32_t getCpsr() { return cpsr; }
+
     void setBios(Bios *bios) { this->bios = bios; }
 
     int handleHleIrq();
@@ -92,6 +103,8 @@ private:
 
     void flushPipeline();
 
+    void swapRegisters(uint8_t mode);
+
     void setCpsr(uint32_t value, bool save = false);
 
     int handleReserved(uint32_t opcode);
@@ -1,6 +1,14 @@
 #include "ipc.h"
 #include "core.h"
 
+void Ipc::syncState(State &state) {
+    // Sync the FIFOs and registers
+    state.var(fifos);
+    state.var(ipcSync);
+    state.var(ipcFifoCnt);
+    state.var(ipcFifoRecv);
+}
+
 void Ipc::writeIpcSync(bool cpu, uint16_t mask, uint16_t value) {
     // Write to one of the IPCSYNC registers
     mask &= 0x4F00;
@@ -18,8 +26,7 @@ void Ipc::writeIpcFifoCnt(bool cpu, uint16_t mask, uint16_t value) {
     // Clear the FIFO if the clear bit is set
     if ((value & BIT(3)) && !fifos[cpu].empty()) {
         // Empty the FIFO
-        while (!fifos[cpu].empty())
-            fifos[cpu].pop();
+        fifos[cpu].clear();
         ipcFifoRecv[!cpu] = 0;
 
         // Set the FIFO empty bits and clear the FIFO full bits
@@ -52,7 +59,7 @@ void Ipc::writeIpcFifoCnt(bool cpu, uint16_t mask, uint16_t value) {
 void Ipc::writeIpcFifoSend(bool cpu, uint32_t mask, uint32_t value) {
     if (ipcFifoCnt[cpu] & BIT(15)) // FIFO enabled
     {
-        if (fifos[cpu].size() < 16) // FIFO not full
+        if (!fifos[cpu].full()) // FIFO not full
         {
             // Push a word to the FIFO
             fifos[cpu].push(value & mask);
@@ -65,7 +72,7 @@ void Ipc::writeIpcFifoSend(bool cpu, uint32_t mask, uint32_t value) {
                 // Trigger a receive FIFO not empty IRQ if enabled
                 if (ipcFifoCnt[!cpu] & BIT(10))
                     core->interpreter[!cpu].sendInterrupt(18);
-            } else if (fifos[cpu].size() == 16) {
+            } else if (fifos[cpu].full()) {
                 // If the FIFO is now full, set the full bits
                 ipcFifoCnt[cpu] |= BIT(1);
                 ipcFifoCnt[!cpu] |= BIT(9);
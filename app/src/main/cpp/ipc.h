@@ -2,14 +2,19 @@
 #define IPC_H
 
 #include <cstdint>
-#include <queue>
+
+#include "fifo.h"
 
 class Core;
 
+class State;
+
 class Ipc {
 public:
     Ipc(Core *core) : core(core) {}
 
+    void syncState(State &state);
+
     uint16_t readIpcSync(bool cpu) { return ipcSync[cpu]; }
 
     uint16_t readIpcFifoCnt(bool cpu) { return ipcFifoCnt[cpu]; }
@@ -25,7 +30,7 @@ public:
 private:
     Core *core;
 
-    std::queue<uint32_t> fifos[2];
+    Fifo<uint32_t, 16> fifos[2];
 
     uint16_t ipcSync[2] = {};
     uint16_t ipcFifoCnt[2] = {0x0101, 0x0101};
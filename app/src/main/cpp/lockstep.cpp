@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "lockstep.h"
+#include "core.h"
+#include "settings.h"
+
+Lockstep::Lockstep(const std::string &ndsPath, const std::string &gbaPath,
+                   const std::vector<std::string> &settings1, const std::vector<std::string> &settings2) {
+    // Create a core for each set of settings, applied first since some are only read at startup
+    settings[0] = settings1;
+    settings[1] = settings2;
+    for (int i = 0; i < 2; i++) {
+        applySettings(i);
+        try {
+            cores[i] = new Core(ndsPath, gbaPath, i);
+        } catch (...) {
+            delete cores[0];
+            throw;
+        }
+        cores[i]->spu.setSampleTap(&samples[i]);
+    }
+}
+
+Lockstep::~Lockstep() {
+    delete cores[0];
+    delete cores[1];
+}
+
+bool Lockstep::startPlayback(const std::string &path) {
+    // Play the same input movie on both cores
+    return cores[0]->input.startPlayback(path) && cores[1]->input.startPlayback(path);
+}
+
+void Lockstep::applySettings(int index) {
+    // Apply a core's setting overrides, given as name=value like in the settings file
+    for (size_t i = 0; i < settings[index].size(); i++) {
+        const std::string &line = settings[index][i];
+        size_t split = line.find('=');
+        if (split == std::string::npos || !Settings::set(line.substr(0, split), line.substr(split + 1)))
+            LOG("Invalid lockstep setting: %s\n", line.c_str());
+    }
+}
+
+bool Lockstep::run(int count) {
+    // Stay stopped once the cores have diverged
+    if (!report.empty()) return false;
+
+    for (int i = 0; i < count; i++) {
+        // Run a frame on each core with its own settings, keeping any frames they output
+        for (int j = 0; j < 2; j++) {
+            applySettings(j);
+            cores[j]->runFrame();
+            size_t size = 256 * 192 * 2 * (Settings::getHighRes3D() ? 4 : 1);
+            std::vector<uint32_t> buffer(size);
+            while (cores[j]->gpu.getFrame(buffer.data(), false))
+                frames[j].push_back(buffer);
+        }
+
+        // Compare the cores, checking registers only at the set interval
+        frame++;
+        if ((registerInterval > 0 && frame % registerInterval == 0 && !compareRegisters()) ||
+            !compareRam() || !compareFrames() || !compareSamples())
+            return false;
+    }
+    return true;
+}
+
+bool Lockstep::compareRegisters() {
+    // Compare the visible registers of each CPU
+    char buffer[256];
+    for (int i = 0; i < 2; i++) {
+        Interpreter &cpu1 = cores[0]->interpreter[i], &cpu2 = cores[1]->interpreter[i];
+        for (int j = 0; j < 16; j++) {
+            if (cpu1.getRegister(j) == cpu2.getRegister(j)) continue;
+            snprintf(buffer, sizeof(buffer), "ARM%d r%d differs: 0x%X vs 0x%X",
+                     ((i == 0) ? 9 : 7), j, cpu1.getRegister(j), cpu2.getRegister(j));
+            diverge(buffer);
+            return false;
+        }
+
+        if (cpu1.getCpsr() != cpu2.getCpsr()) {
+            snprintf(buffer, sizeof(buffer), "ARM%d CPSR differs: 0x%X vs 0x%X",
+                     ((i == 0) ? 9 : 7), cpu1.getCpsr(), cpu2.getCpsr());
+            diverge(buffer);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Lockstep::compareRam() {
+    // Compare main RAM directly, which finds the first differing address as cheaply as hashing would
+    uint8_t *ram1 = cores[0]->memory.getRam(), *ram2 = cores[1]->memory.getRam();
+    if (!memcmp(ram1, ram2, 0x400000)) return true;
+    uint32_t i = 0;
+    while (ram1[i] == ram2[i]) i++;
+
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer), "Main RAM differs at 0x%X: 0x%02X vs 0x%02X",
+             0x2000000 + i, ram1[i], ram2[i]);
+    diverge(buffer);
+    return false;
+}
+
+bool Lockstep::compareFrames() {
+    // Compare the frames that both cores have output so far, in order
+    char buffer[256];
+    while (!frames[0].empty() && !frames[1].empty()) {
+        std::vector<uint32_t> &frame1 = frames[0].front(), &frame2 = frames[1].front();
+        if (frame1.size() != frame2.size()) {
+            diverge("Frame sizes differ");
+            return false;
+        }
+
+        // Report the first differing pixel by screen and position, scaled to native resolution
+        for (size_t i = 0; i < frame1.size(); i++) {
+            if (frame1[i] == frame2[i]) continue;
+            int scale = (frame1.size() > 256 * 192 * 2) ? 2 : 1;
+            size_t pixel = i % (256 * 192 * scale * scale);
+            snprintf(buffer, sizeof(buffer), "Frame differs on screen %d at %d,%d: 0x%06X vs 0x%06X",
+                     (int)(i / (256 * 192 * scale * scale)), (int)(pixel % (256 * scale)) / scale,
+                     (int)(pixel / (256 * scale)) / scale, frame1[i] & 0xFFFFFF, frame2[i] & 0xFFFFFF);
+            diverge(buffer);
+            return false;
+        }
+
+        frames[0].erase(frames[0].begin());
+        frames[1].erase(frames[1].begin());
+    }
+    return true;
+}
+
+bool Lockstep::compareSamples() {
+    // Compare the audio output since the last check, which should be the same length for the same emulated time
+    char buffer[256];
+    size_t count = std::min(samples[0].size(), samples[1].size());
+    for (size_t i = 0; i < count; i++) {
+        if (samples[0][i] == samples[1][i]) continue;
+        snprintf(buffer, sizeof(buffer), "Audio differs at sample %zu of the frame: 0x%08X vs 0x%08X",
+                 i, samples[0][i], samples[1][i]);
+        diverge(buffer);
+        return false;
+    }
+
+    if (samples[0].size() != samples[1].size()) {
+        snprintf(buffer, sizeof(buffer), "Audio sample counts differ: %zu vs %zu",
+                 samples[0].size(), samples[1].size());
+        diverge(buffer);
+        return false;
+    }
+
+    samples[0].clear();
+    samples[1].clear();
+    return true;
+}
+
+void Lockstep::diverge(const char *message) {
+    // Describe a divergence, with where each core was for context
+    char buffer[512];
+    snprintf(buffer, sizeof(buffer), "Frame %d: %s\nARM9 PC: 0x%X vs 0x%X\nARM7 PC: 0x%X vs 0x%X\n"
+             "Cycles: %llu vs %llu\n", frame, message, cores[0]->interpreter[0].getPC(),
+             cores[1]->interpreter[0].getPC(), cores[0]->interpreter[1].getPC(), cores[1]->interpreter[1].getPC(),
+             (unsigned long long)cores[0]->getTotalCycles(), (unsigned long long)cores[1]->getTotalCycles());
+    report = buffer;
+    LOG("%s", buffer);
+}
@@ -0,0 +1,54 @@
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Core;
+
+// Runs two cores with different settings on the same ROM and input, stopping at the first point they diverge
+// Settings are global, so each core's overrides are applied before it runs; both lists should cover the same names
+class Lockstep {
+public:
+    Lockstep(const std::string &ndsPath, const std::string &gbaPath,
+             const std::vector<std::string> &settings1, const std::vector<std::string> &settings2);
+
+    ~Lockstep();
+
+    bool startPlayback(const std::string &path);
+
+    void setRegisterInterval(int frames) { registerInterval = frames; }
+
+    bool run(int frames);
+
+    Core *getCore(int index) { return cores[index]; }
+
+    int getFrame() { return frame; }
+
+    const std::string &getReport() { return report; }
+
+private:
+    Core *cores[2] = {};
+    std::vector<std::string> settings[2];
+    std::vector<std::vector<uint32_t>> frames[2];
+    std::vector<uint32_t> samples[2];
+
+    int registerInterval = 1;
+    int frame = 0;
+    std::string report;
+
+    void applySettings(int index);
+
+    bool compareRegisters();
+
+    bool compareRam();
+
+    bool compareFrames();
+
+    bool compareSamples();
+
+    void diverge(const char *message);
+};
+
+#endif // LOCKSTEP_H
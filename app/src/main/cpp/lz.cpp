@@ -0,0 +1,129 @@
+#include <cstring>
+
+#include "lz.h"
+
+#define HASH_BITS 12
+#define MIN_MATCH 4
+#define MAX_OFFSET 0xFFFF
+
+// Sequences are a token with 4-bit literal and match lengths, followed by any extra length bytes,
+// the literals, and a 16-bit match offset; the last sequence has only literals
+
+static inline uint32_t read32(const uint8_t *data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static inline uint64_t read64(const uint8_t *data) {
+    uint64_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+void Lz::writeLength(std::vector<uint8_t> &dst, size_t length) {
+    // Write the part of a length that doesn't fit in its token as a run of bytes
+    for (; length >= 0xFF; length -= 0xFF)
+        dst.push_back(0xFF);
+    dst.push_back(length);
+}
+
+void Lz::compress(const uint8_t *src, size_t size, std::vector<uint8_t> &dst) {
+    // Track the last position of each hashed 4-byte sequence, which is checked for a match
+    uint32_t table[1 << HASH_BITS] = {};
+    size_t anchor = 0, i = 1;
+
+    while (i + MIN_MATCH <= size) {
+        uint32_t value = read32(&src[i]);
+        uint32_t hash = (value * 2654435761U) >> (32 - HASH_BITS);
+        size_t ref = table[hash];
+        table[hash] = i;
+
+        // Skip ahead faster the longer no match is found, since the data is probably incompressible
+        if (i - ref > MAX_OFFSET || read32(&src[ref]) != value) {
+            i += 1 + ((i - anchor) >> 6);
+            continue;
+        }
+
+        // Extend the match 8 bytes at a time, then finish it byte by byte
+        size_t length = MIN_MATCH;
+        while (i + length + 8 <= size && read64(&src[ref + length]) == read64(&src[i + length]))
+            length += 8;
+        while (i + length < size && src[ref + length] == src[i + length])
+            length++;
+
+        // Write the sequence's token, literals, offset, and match length
+        size_t literals = i - anchor;
+        size_t extra = length - MIN_MATCH;
+        dst.push_back(((literals < 15 ? literals : 15) << 4) | (extra < 15 ? extra : 15));
+        if (literals >= 15) writeLength(dst, literals - 15);
+        dst.insert(dst.end(), &src[anchor], &src[i]);
+        dst.push_back((i - ref) >> 0);
+        dst.push_back((i - ref) >> 8);
+        if (extra >= 15) writeLength(dst, extra - 15);
+
+        i += length;
+        anchor = i;
+    }
+
+    // Write the remaining bytes as literals
+    size_t literals = size - anchor;
+    dst.push_back((literals < 15 ? literals : 15) << 4);
+    if (literals >= 15) writeLength(dst, literals - 15);
+    dst.insert(dst.end(), &src[anchor], &src[size]);
+}
+
+bool Lz::decompress(const uint8_t *src, size_t size, uint8_t *dst, size_t dstSize) {
+    // Decode sequences until the input runs out, failing if anything goes out of bounds
+    const uint8_t *end = src + size;
+    size_t out = 0;
+
+    while (src < end) {
+        // Read the token and the full literal length
+        uint8_t token = *src++;
+        size_t literals = token >> 4;
+        if (literals == 15) {
+            uint8_t value;
+            do {
+                if (src >= end) return false;
+                literals += (value = *src++);
+            } while (value == 0xFF);
+        }
+
+        // Copy the literals
+        if (literals > (size_t)(end - src) || literals > dstSize - out)
+            return false;
+        memcpy(&dst[out], src, literals);
+        src += literals;
+        out += literals;
+
+        // Stop after the last sequence, which has no match
+        if (src == end) break;
+
+        // Read the match offset and the full match length
+        if (end - src < 2) return false;
+        size_t offset = src[0] | (src[1] << 8);
+        src += 2;
+        size_t length = (token & 0x0F) + MIN_MATCH;
+        if ((token & 0x0F) == 15) {
+            uint8_t value;
+            do {
+                if (src >= end) return false;
+                length += (value = *src++);
+            } while (value == 0xFF);
+        }
+
+        // Copy the match, byte by byte if it overlaps itself
+        if (offset == 0 || offset > out || length > dstSize - out)
+            return false;
+        if (offset >= length) {
+            memcpy(&dst[out], &dst[out - offset], length);
+        } else {
+            for (size_t i = 0; i < length; i++)
+                dst[out + i] = dst[out + i - offset];
+        }
+        out += length;
+    }
+
+    return out == dstSize;
+}
@@ -0,0 +1,22 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Fast LZ77 codec in the style of LZ4 blocks, for in-memory data that favors speed over ratio
+// Compressed data is appended to the destination, so it can follow a header
+class Lz {
+public:
+    static void compress(const uint8_t *src, size_t size, std::vector<uint8_t> &dst);
+
+    static bool decompress(const uint8_t *src, size_t size, uint8_t *dst, size_t dstSize);
+
+private:
+    Lz() {} // Private to prevent instantiation
+
+    static void writeLength(std::vector<uint8_t> &dst, size_t length);
+};
+
+#endif // LZ_H
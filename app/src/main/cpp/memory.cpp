@@ -1,7 +1,9 @@
+#include <algorithm>
 #include <cstring>
 
 #include "memory.h"
 #include "core.h"
+#include "file_cache.h"
 #include "settings.h"
 
 // Defines an 8-bit register in an I/O switch statement
@@ -65,13 +67,12 @@ void VramMapping::write(uint32_t address, T value) {
 
 bool Memory::loadBios9() {
     // Load the ARM9 BIOS if the file is found
-    if (FILE *file = fopen(Settings::getBios9Path().c_str(), "rb")) {
-        fread(bios9, sizeof(uint8_t), 0x1000, file);
-        fclose(file);
+    size_t size = 0x8000;
+    if ((bios9 = FileCache::load(Settings::getBios9Path(), size)))
         return true;
-    }
 
     // Prepare HLE BIOS with a special opcode for interrupt return
+    bios9.reset(new uint8_t[0x8000]());
     bios9[3] = 0xFF;
     core->interpreter[0].setBios(&core->bios9);
     return false;
@@ -79,13 +80,12 @@ bool Memory::loadBios9() {
 
 bool Memory::loadBios7() {
     // Load the ARM7 BIOS if the file is found
-    if (FILE *file = fopen(Settings::getBios7Path().c_str(), "rb")) {
-        fread(bios7, sizeof(uint8_t), 0x4000, file);
-        fclose(file);
+    size_t size = 0x4000;
+    if ((bios7 = FileCache::load(Settings::getBios7Path(), size)))
         return true;
-    }
 
     // Prepare HLE BIOS with a special opcode for interrupt return
+    bios7.reset(new uint8_t[0x4000]());
     bios7[3] = 0xFF;
     core->interpreter[1].setBios(&core->bios7);
     return false;
@@ -93,15 +93,26 @@ bool Memory::loadBios7() {
 
 bool Memory::loadGbaBios() {
     // Load the GBA BIOS if the file is found
-    if (FILE *file = fopen(Settings::getGbaBiosPath().c_str(), "rb")) {
-        fread(gbaBios, sizeof(uint8_t), 0x4000, file);
-        fclose(file);
+    size_t size = 0x4000;
+    if ((gbaBios = FileCache::load(Settings::getGbaBiosPath(), size)))
         return true;
-    }
 
+    // Leave the GBA BIOS empty if it isn't provided
+    gbaBios.reset(new uint8_t[0x4000]());
     return false;
 }
 
+void Memory::initMaps() {
+    // Build the memory maps only where memory can be mapped at startup
+    // The maps start out null, so the rest of the address space is left untouched
+    updateMap9(0x02000000, 0x04000000); // Main RAM, shared WRAM
+    updateMap9(0x06000000, 0x0A000000); // VRAM, GBA ROM
+    updateMap9(0xFFFF0000, 0xFFFFFFFF); // ARM9 BIOS
+    updateMap7(0x00000000, 0x04000000); // ARM7 BIOS, main RAM, WRAM
+    updateMap7(0x04800000, 0x05000000); // WiFi RAM
+    updateMap7(0x06000000, 0x0A000000); // VRAM, GBA ROM
+}
+
 void Memory::updateMap9(uint32_t start, uint32_t end) {
     // Update the ARM9 read memory map in the given range
     for (uint64_t address = start; address < end; address += 0x1000) {
@@ -173,7 +184,7 @@ void Memory::updateMap9(uint32_t start, uint32_t end) {
             }
         }
 
-        readMap9[address >> 12] = data;
+        readMap9[address >> 12] = mapBlock(0, address, data);
     }
 
     // Update the ARM9 write memory map in the given range
@@ -234,7 +245,7 @@ void Memory::updateMap9(uint32_t start, uint32_t end) {
             }
         }
 
-        writeMap9[address >> 12] = data;
+        writeMap9[address >> 12] = mapBlock(2, address, data);
     }
 }
 
@@ -323,7 +334,7 @@ void Memory::updateMap7(uint32_t start, uint32_t end) {
             }
         }
 
-        readMap7[address >> 12] = data;
+        readMap7[address >> 12] = mapBlock(1, address, data);
     }
 
     // Update the ARM7 write memory map in the given range
@@ -395,12 +406,199 @@ void Memory::updateMap7(uint32_t start, uint32_t end) {
             }
         }
 
-        writeMap7[address >> 12] = data;
+        writeMap7[address >> 12] = mapBlock(3, address, data);
+    }
+}
+
+uint8_t *Memory::mapBlock(int map, uint32_t address, uint8_t *data) {
+    // Get the pointer to put in a memory map for a 4KB block, or null if the block is watched
+    // Watched blocks keep their pointer on the side, so the fallbacks can still serve their accesses
+    if (!watchedBlocks[map].empty()) {
+        auto block = watchedBlocks[map].find(address >> 12);
+        if (block != watchedBlocks[map].end()) {
+            block->second = data;
+            return nullptr;
+        }
+    }
+
+    // Leave out tracked main RAM blocks that haven't been written yet, so the write fallback can mark them
+    if ((map & 2) && ramTracked && data >= ram && data < ram + sizeof(ram) && !ramWritten[(data - ram) >> 12])
+        return nullptr;
+    return data;
+}
+
+uint8_t *Memory::getBlock(uint8_t **map, uint32_t address, uint32_t size) {
+    // Check that a range of memory is plain and contiguous in host memory
+    // Ranges that wrap around the address space are never considered contiguous
+    uint8_t *base = map[address >> 12];
+    if (!base || (uint64_t)address + size > 0x100000000ULL) return nullptr;
+    for (uint32_t i = 1; i < ((address & 0xFFF) + size + 0xFFF) >> 12; i++) {
+        if (map[(address >> 12) + i] != base + (i << 12))
+            return nullptr;
+    }
+
+    return &base[address & 0xFFF];
+}
+
+uint8_t *Memory::getReadBlock(bool cpu, uint32_t address, uint32_t size) {
+    // Get a pointer to a range of plain readable memory, or null if any of it needs special handling
+    return getBlock((cpu == 0) ? readMap9 : readMap7, address, size);
+}
+
+uint8_t *Memory::getWriteBlock(bool cpu, uint32_t address, uint32_t size) {
+    // Mark tracked main RAM in the range as written first, since writes through the pointer bypass the maps
+    if (ramTracked) {
+        for (uint64_t block = address & ~0xFFF; block < (uint64_t)address + size; block += 0x1000) {
+            if ((block & 0xFF000000) == 0x02000000)
+                markRamWritten(cpu, block);
+        }
+    }
+
+    // Get a pointer to a range of plain writable memory, or null if any of it needs special handling
+    return getBlock((cpu == 0) ? writeMap9 : writeMap7, address, size);
+}
+
+void Memory::trackRamWrites() {
+    // Start tracking main RAM writes from here, taking all blocks out of the write maps until they're written
+    if (!ramTracked) {
+        ramTracked = true;
+        std::fill(ramWritten, ramWritten + sizeof(ramWritten), false);
+        updateMap9(0x02000000, 0x03000000);
+        updateMap7(0x02000000, 0x03000000);
+        return;
+    }
+
+    // If already tracking, only the blocks written since then are mapped, so only unmap those and their mirrors
+    uint32_t mirror = (core->isGbaMode() ? 0x40000 : 0x400000);
+    for (uint32_t i = 0; i < mirror >> 12; i++) {
+        if (!ramWritten[i]) continue;
+        ramWritten[i] = false;
+        for (uint32_t address = 0x02000000 + (i << 12); address < 0x03000000; address += mirror) {
+            updateMap9(address, address + 0x1000);
+            updateMap7(address, address + 0x1000);
+        }
+    }
+}
+
+bool Memory::markRamWritten(bool cpu, uint32_t address) {
+    // Mark the main RAM block at an address as written and put it back in the write map
+    // Returns whether the block is now mapped, which it won't be if it's watched
+    uint8_t **writeMap = (cpu == 0) ? writeMap9 : writeMap7;
+    ramWritten[(address & (core->isGbaMode() ? 0x3FFFF : 0x3FFFFF)) >> 12] = true;
+    if (!writeMap[address >> 12]) {
+        uint32_t start = address & ~0xFFF;
+        if (cpu == 0)
+            updateMap9(start, start + 0x1000);
+        else
+            updateMap7(start, start + 0x1000);
+    }
+    return writeMap[address >> 12];
+}
+
+int Memory::addWatchpoint(bool cpu, uint32_t address, uint32_t size, uint8_t type, bool breaks) {
+    // Watch a range of memory for accesses by a CPU, or DMA running on its bus
+    if (size == 0 || !(type & (WATCH_READ | WATCH_WRITE))) return -1;
+    Watchpoint watch;
+    watch.id = nextWatchId++;
+    watch.cpu = cpu;
+    watch.address = address;
+    watch.size = size;
+    watch.type = type;
+    watch.breaks = breaks;
+    watchpoints.push_back(watch);
+    updateWatchedBlocks();
+    return watch.id;
+}
+
+void Memory::removeWatchpoint(int id) {
+    // Stop watching a range of memory, putting its blocks back in the memory maps if nothing else watches them
+    for (size_t i = 0; i < watchpoints.size(); i++) {
+        if (watchpoints[i].id != id) continue;
+        watchpoints.erase(watchpoints.begin() + i);
+        updateWatchedBlocks();
+        return;
+    }
+}
+
+bool Memory::takeWatchBreak() {
+    // Check if a watchpoint broke execution since the last check
+    bool value = watchBreak;
+    watchBreak = false;
+    return value;
+}
+
+void Memory::updateWatchedBlocks() {
+    // Collect the blocks that were watched, then mark the blocks overlapped by each watchpoint
+    std::vector<uint32_t> blocks[2];
+    for (int i = 0; i < 4; i++) {
+        for (auto &block: watchedBlocks[i])
+            blocks[i & 1].push_back(block.first);
+        watchedBlocks[i].clear();
+    }
+    for (size_t i = 0; i < watchpoints.size(); i++) {
+        Watchpoint &watch = watchpoints[i];
+        uint64_t end = (uint64_t)watch.address + watch.size - 1;
+        for (uint64_t block = watch.address >> 12; block <= std::min<uint64_t>(end, 0xFFFFFFFF) >> 12; block++) {
+            if (watch.type & WATCH_READ) watchedBlocks[watch.cpu][block] = nullptr;
+            if (watch.type & WATCH_WRITE) watchedBlocks[2 | watch.cpu][block] = nullptr;
+            blocks[watch.cpu].push_back(block);
+        }
+    }
+
+    // Rebuild the memory maps for blocks that were or are now watched, which moves their pointers as needed
+    for (int i = 0; i < 2; i++) {
+        for (size_t j = 0; j < blocks[i].size(); j++) {
+            uint32_t start = blocks[i][j] << 12;
+            uint32_t end = (start == 0xFFFFF000) ? 0xFFFFFFFF : (start + 0x1000);
+            if (i == 0)
+                updateMap9(start, end);
+            else
+                updateMap7(start, end);
+        }
+    }
+}
+
+void Memory::checkWatchpoints(bool cpu, uint32_t address, uint32_t size, uint8_t type) {
+    // Count hits on watchpoints that overlap an access, by the opcode running when it happened
+    // The program counter is two fetches ahead of the opcode while it runs
+    Interpreter &interpreter = core->interpreter[cpu];
+    uint32_t pc = interpreter.getPC() - (interpreter.isThumb() ? 4 : 8);
+    for (size_t i = 0; i < watchpoints.size(); i++) {
+        Watchpoint &watch = watchpoints[i];
+        if (watch.cpu != cpu || !(watch.type & type) || address >= (uint64_t)watch.address + watch.size ||
+            (uint64_t)address + size <= watch.address)
+            continue;
+
+        // Log the first hit from each opcode, so heavy access from a loop doesn't flood the log
+        if (watch.hits[pc]++ == 0) {
+            LOG("ARM%d watchpoint %s: 0x%X from PC 0x%X\n", ((cpu == 0) ? 9 : 7),
+                ((type & WATCH_WRITE) ? "write" : "read"), address, pc);
+        }
+
+        // Stop running at the next scheduler boundary if requested
+        if (watch.breaks) {
+            watchBreak = true;
+            core->breakExecution();
+        }
     }
 }
 
 template<typename T>
 T Memory::readFallback(bool cpu, uint32_t address) {
+    // Check watchpoints on blocks that were kept out of the read map for them, then read plain memory directly
+    if (!watchedBlocks[cpu].empty()) {
+        auto block = watchedBlocks[cpu].find(address >> 12);
+        if (block != watchedBlocks[cpu].end()) {
+            checkWatchpoints(cpu, address, sizeof(T), WATCH_READ);
+            if (uint8_t *data = block->second) {
+                T value = 0;
+                for (size_t i = 0; i < sizeof(T); i++)
+                    value |= data[(address & 0xFFF) + i] << (i * 8);
+                return value;
+            }
+        }
+    }
+
     uint8_t *data = nullptr;
 
     // Handle special memory reads that can't be done with the read map
@@ -530,6 +728,23 @@ T Memory::readFallback(bool cpu, uint32_t address) {
 
 template<typename T>
 void Memory::writeFallback(bool cpu, uint32_t address, T value) {
+    // Put tracked main RAM blocks back in the write map on their first write, then write normally
+    if (ramTracked && (address & 0xFF000000) == 0x02000000 && markRamWritten(cpu, address))
+        return write<T>(cpu, address, value);
+
+    // Check watchpoints on blocks that were kept out of the write map for them, then write plain memory directly
+    if (!watchedBlocks[2 | cpu].empty()) {
+        auto block = watchedBlocks[2 | cpu].find(address >> 12);
+        if (block != watchedBlocks[2 | cpu].end()) {
+            checkWatchpoints(cpu, address, sizeof(T), WATCH_WRITE);
+            if (uint8_t *data = block->second) {
+                for (size_t i = 0; i < sizeof(T); i++)
+                    data[(address & 0xFFF) + i] = value >> (i * 8);
+                return;
+            }
+        }
+    }
+
     uint8_t *data = nullptr;
 
     // Handle special memory writes that can't be done with the write map
@@ -1824,6 +2039,47 @@ void Memory::ioWriteGba(uint32_t address, T value) {
     }
 }
 
+void Memory::syncState(State &state) {
+    // Sync the memory contents and registers, leaving out main RAM and VRAM if rewind is tracking them separately
+    if (state.hasMemory()) {
+        state.var(ram);
+        for (int i = 0; i < 9; i++)
+            state.block(getVram(i), getVramSize(i));
+    }
+    state.var(wram);
+    state.var(instrTcm);
+    state.var(dataTcm);
+    state.var(wram7);
+    state.var(wifiRam);
+    state.var(palette);
+    state.var(oam);
+    state.var(dmaFill);
+    state.var(vramCnt);
+    state.var(wramCnt);
+    state.var(haltCnt);
+
+    // Sync the last GBA BIOS read as an offset, since the BIOS isn't part of the state
+    int32_t biosOffset = lastGbaBios ? (lastGbaBios - &gbaBios[0]) : -1;
+    state.var(biosOffset);
+
+    if (!state.isSaving()) {
+        // Rebuild the VRAM mappings and the memory maps that depend on the loaded registers
+        // Cp15 updates the TCM locations when it loads after this
+        lastGbaBios = (biosOffset >= 0) ? &gbaBios[biosOffset] : nullptr;
+        remapVram();
+        updateMap9(0x03000000, 0x04000000);
+        updateMap7(0x03000000, 0x04000000);
+
+        // Count all of main RAM as written if it was loaded, since that bypasses the write maps
+        // This is skipped if the loaded RAM can only differ in blocks that are already marked
+        if (state.hasMemory() && ramTracked && !ramWrittenKept) {
+            std::fill(ramWritten, ramWritten + sizeof(ramWritten), true);
+            updateMap9(0x02000000, 0x03000000);
+            updateMap7(0x02000000, 0x03000000);
+        }
+    }
+}
+
 void Memory::writeDmaFill(int channel, uint32_t mask, uint32_t value) {
     // Write to one of the DMAFILL registers
     dmaFill[channel] = (dmaFill[channel] & ~mask) | (value & mask);
@@ -1834,7 +2090,22 @@ void Memory::writeVramCnt(int index, uint8_t value) {
     const uint8_t masks[] = {0x9B, 0x9B, 0x9F, 0x9F, 0x87, 0x9F, 0x9F, 0x83, 0x83};
     if ((value & masks[index]) == (vramCnt[index] & masks[index])) return;
     vramCnt[index] = value & masks[index];
+    remapVram();
+}
+
+uint8_t *Memory::getVram(int block) {
+    // Get one of the VRAM blocks, A to I
+    uint8_t *blocks[] = { vramA, vramB, vramC, vramD, vramE, vramF, vramG, vramH, vramI };
+    return blocks[block];
+}
+
+size_t Memory::getVramSize(int block) {
+    // Get the size of one of the VRAM blocks, A to I
+    static const size_t sizes[] = { 0x20000, 0x20000, 0x20000, 0x20000, 0x10000, 0x4000, 0x4000, 0x8000, 0x4000 };
+    return sizes[block];
+}
 
+void Memory::remapVram() {
     // Clear the previous mappings
     memset(engABg, 0, sizeof(engABg));
     memset(engBBg, 0, sizeof(engBBg));
@@ -2,11 +2,30 @@
 #define MEMORY_H
 
 #include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
 
 #include "defines.h"
 
 class Core;
 
+class State;
+
+enum WatchType {
+    WATCH_READ = BIT(0),
+    WATCH_WRITE = BIT(1)
+};
+
+struct Watchpoint {
+    int id;
+    bool cpu;
+    uint32_t address, size;
+    uint8_t type; // WATCH_READ and/or WATCH_WRITE
+    bool breaks; // Whether a hit breaks execution
+    std::unordered_map<uint32_t, uint64_t> hits; // Hit counts by the PC of the opcode that made the access
+};
+
 class VramMapping {
 public:
     void add(uint8_t *mapping);
@@ -36,16 +55,42 @@ public:
 
     bool loadGbaBios();
 
+    void initMaps();
+
     void updateMap9(uint32_t start, uint32_t end);
 
     void updateMap7(uint32_t start, uint32_t end);
 
+    void syncState(State &state);
+
     template<typename T>
     T read(bool cpu, uint32_t address);
 
     template<typename T>
     void write(bool cpu, uint32_t address, T value);
 
+    uint8_t *getReadPointer(bool cpu, uint32_t address);
+
+    uint8_t *getWritePointer(bool cpu, uint32_t address);
+
+    uint8_t *getReadBlock(bool cpu, uint32_t address, uint32_t size);
+
+    uint8_t *getWriteBlock(bool cpu, uint32_t address, uint32_t size);
+
+    uint8_t *getRam() { return ram; }
+
+    const bool *getRamWritten() { return ramWritten; }
+
+    uint8_t *getVram(int block);
+
+    size_t getVramSize(int block);
+
+    void trackRamWrites();
+
+    void setRamWrittenKept(bool kept) { ramWrittenKept = kept; }
+
+    uint8_t *getWifiRam() { return wifiRam; }
+
     uint8_t *getPalette() { return palette; }
 
     uint8_t *getOam() { return oam; }
@@ -58,18 +103,28 @@ public:
 
     uint8_t **getPal3D() { return pal3D; }
 
+    int addWatchpoint(bool cpu, uint32_t address, uint32_t size, uint8_t type, bool breaks = false);
+
+    void removeWatchpoint(int id);
+
+    const std::vector<Watchpoint> &getWatchpoints() { return watchpoints; }
+
+    bool takeWatchBreak();
+
 private:
     Core *core;
 
     // 32-bit address space, split into 4KB blocks
-    uint8_t *readMap9[0x100000] = {};
-    uint8_t *readMap7[0x100000] = {};
-    uint8_t *writeMap9[0x100000] = {};
-    uint8_t *writeMap7[0x100000] = {};
+    // The maps are left uninitialized here because cores are allocated zeroed, which saves touching 32MB at boot
+    uint8_t *readMap9[0x100000];
+    uint8_t *readMap7[0x100000];
+    uint8_t *writeMap9[0x100000];
+    uint8_t *writeMap7[0x100000];
 
-    uint8_t bios9[0x8000] = {}; // 32KB ARM9 BIOS
-    uint8_t bios7[0x4000] = {}; // 16KB ARM7 BIOS
-    uint8_t gbaBios[0x4000] = {}; // 16KB GBA BIOS
+    // BIOS images loaded from files are shared read-only between instances
+    std::shared_ptr<uint8_t[]> bios9; // 32KB ARM9 BIOS
+    std::shared_ptr<uint8_t[]> bios7; // 16KB ARM7 BIOS
+    std::shared_ptr<uint8_t[]> gbaBios; // 16KB GBA BIOS
 
     uint8_t ram[0x400000] = {}; //  4MB main RAM
     uint8_t wram[0x8000] = {}; // 32KB shared WRAM
@@ -104,12 +159,35 @@ private:
 
     uint8_t *lastGbaBios = nullptr;
 
+    // Watched 4KB blocks are kept out of the memory maps so their accesses always reach the fallbacks
+    // The pointers they would have been mapped to are kept here instead, indexed by write bit and CPU
+    std::vector<Watchpoint> watchpoints;
+    std::unordered_map<uint32_t, uint8_t*> watchedBlocks[4];
+    int nextWatchId = 0;
+    bool watchBreak = false;
+
+    // Main RAM blocks written since tracking last started, which lets rewind skip the rest
+    // While tracking, blocks are kept out of the write maps until they're written, so only the first write is slower
+    bool ramTracked = false;
+    bool ramWritten[0x400] = {};
+    bool ramWrittenKept = false; // Set for loads that only differ in blocks already marked, like run-ahead's
+
     uint32_t dmaFill[4] = {};
     uint8_t vramCnt[9] = {};
     uint8_t vramStat = 0;
     uint8_t wramCnt = 0;
     uint8_t haltCnt = 0;
 
+    uint8_t *getBlock(uint8_t **map, uint32_t address, uint32_t size);
+
+    uint8_t *mapBlock(int map, uint32_t address, uint8_t *data);
+
+    void updateWatchedBlocks();
+
+    bool markRamWritten(bool cpu, uint32_t address);
+
+    void checkWatchpoints(bool cpu, uint32_t address, uint32_t size, uint8_t type);
+
     template<typename T>
     T readFallback(bool cpu, uint32_t address);
 
@@ -148,6 +226,8 @@ private:
 
     void writeVramCnt(int index, uint8_t value);
 
+    void remapVram();
+
     void writeWramCnt(uint8_t value);
 
     void writeHaltCnt(uint8_t value);
@@ -206,4 +286,18 @@ FORCE_INLINE void Memory::write(bool cpu, uint32_t address, T value) {
     return writeFallback<T>(cpu, address, value);
 }
 
+FORCE_INLINE uint8_t *Memory::getReadPointer(bool cpu, uint32_t address) {
+    // Get a pointer to plain readable memory at the given address, or null if it needs special handling
+    // The pointer is only valid up to the end of its 4KB block
+    uint8_t **readMap = (cpu == 0) ? readMap9 : readMap7;
+    return readMap[address >> 12] ? &readMap[address >> 12][address & 0xFFF] : nullptr;
+}
+
+FORCE_INLINE uint8_t *Memory::getWritePointer(bool cpu, uint32_t address) {
+    // Get a pointer to plain writable memory at the given address, or null if it needs special handling
+    // The pointer is only valid up to the end of its 4KB block
+    uint8_t **writeMap = (cpu == 0) ? writeMap9 : writeMap7;
+    return writeMap[address >> 12] ? &writeMap[address >> 12][address & 0xFFF] : nullptr;
+}
+
 #endif // MEMORY_H
@@ -0,0 +1,113 @@
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "perf_counters.h"
+#include "settings.h"
+
+thread_local PerfCounters::ThreadCounters PerfCounters::threadCounters;
+
+PerfCounters::PerfCounters() {
+    // Only count when requested, since every phase switch costs a system call
+    enabled = Settings::getPerfCounters();
+}
+
+PerfCounters::ThreadCounters::~ThreadCounters() {
+    // Close the counters when the thread exits
+    for (int i = 0; i < count; i++)
+        close(fds[i]);
+}
+
+void PerfCounters::ThreadCounters::open() {
+    static const uint64_t configs[EVENT_COUNT] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_BRANCH_MISSES,
+        PERF_COUNT_HW_CACHE_MISSES
+    };
+
+    // Open a counter for each event on this thread, grouped under the first one that opens
+    // Events the host doesn't support or allow are skipped, and stay at zero
+    count = 0;
+    for (int i = 0; i < EVENT_COUNT; i++) {
+        perf_event_attr attr = {};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[i];
+        attr.read_format = PERF_FORMAT_GROUP;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        int fd = syscall(SYS_perf_event_open, &attr, 0, -1, count ? fds[0] : -1, 0);
+        if (fd < 0) continue;
+        fds[count] = fd;
+        events[count++] = i;
+        mask |= BIT(i);
+    }
+
+    if (count == 0)
+        LOG("Hardware performance counters are unavailable\n");
+}
+
+bool PerfCounters::ThreadCounters::sample(uint64_t *values) {
+    // Read all counters in the group at once, which come back in the order they were opened
+    uint64_t data[EVENT_COUNT + 1];
+    size_t size = sizeof(uint64_t) * (count + 1);
+    if (count <= 0 || ::read(fds[0], data, size) != (ssize_t)size)
+        return false;
+
+    for (int i = 0; i < count; i++)
+        values[events[i]] = data[i + 1];
+    return true;
+}
+
+PerfPhase PerfCounters::switchPhase(PerfPhase phase) {
+    // Open counters the first time a thread switches phases
+    ThreadCounters &thread = threadCounters;
+    if (thread.count < 0)
+        thread.open();
+
+    // Attribute events since the last switch to the phase that was running on this thread
+    uint64_t values[EVENT_COUNT] = {};
+    if (thread.sample(values)) {
+        if (thread.owner && thread.phase != PHASE_NONE) {
+            for (int i = 0; i < EVENT_COUNT; i++)
+                thread.owner->counts[thread.phase][i].fetch_add(values[i] - thread.last[i], std::memory_order_relaxed);
+        }
+        memcpy(thread.last, values, sizeof(values));
+    }
+
+    // Switch phases, returning the last one so it can be restored
+    // Events the thread could open are recorded the first time it counts for this
+    PerfPhase last = (thread.owner == this) ? thread.phase : PHASE_NONE;
+    if (thread.owner != this)
+        available.fetch_or(thread.mask, std::memory_order_relaxed);
+    thread.owner = this;
+    thread.phase = phase;
+    return last;
+}
+
+void PerfCounters::endFrame() {
+    if (!enabled) return;
+
+    // Flush events from the phase running on this thread, so they count toward the frame that's ending
+    switchPhase((threadCounters.owner == this) ? threadCounters.phase : PHASE_NONE);
+
+    // Move the totals to the frame counts and start counting the next frame
+    // Events from other threads that are still in a phase will count toward the next frame
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        for (int j = 0; j < EVENT_COUNT; j++)
+            frameCounts[i][j].store(counts[i][j].exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+}
+
+const char *PerfCounters::getPhaseName(PerfPhase phase) {
+    static const char *names[PHASE_COUNT] = { "CPU", "Scheduler", "GPU 2D", "GPU 3D", "SPU", "Get frame" };
+    return (phase < PHASE_COUNT) ? names[phase] : "None";
+}
+
+const char *PerfCounters::getEventName(PerfEvent event) {
+    static const char *names[EVENT_COUNT] = { "Cycles", "Instructions", "Branch misses", "Cache misses" };
+    return (event < EVENT_COUNT) ? names[event] : "None";
+}
@@ -0,0 +1,85 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <atomic>
+#include <cstdint>
+
+#include "defines.h"
+
+enum PerfPhase {
+    PHASE_CPU, // ARM9 and ARM7 execution, which are interleaved per opcode
+    PHASE_SCHEDULER, // Scheduled tasks not covered by another phase
+    PHASE_GPU_2D, // Gpu2D::drawScanline
+    PHASE_GPU_3D, // Gpu3DRenderer rasterization and finishing
+    PHASE_SPU, // Spu::runSample
+    PHASE_GET_FRAME, // Gpu::getFrame
+    PHASE_COUNT,
+    PHASE_NONE = PHASE_COUNT
+};
+
+enum PerfEvent {
+    EVENT_CYCLES,
+    EVENT_INSTRUCTIONS,
+    EVENT_BRANCH_MISSES,
+    EVENT_CACHE_MISSES,
+    EVENT_COUNT
+};
+
+// Optional hardware counters that attribute host CPU events to emulation phases
+// Each thread counts in its own perf_event_open group, and events it can't open are counted as zero
+class PerfCounters {
+public:
+    PerfCounters();
+
+    bool isEnabled() { return enabled; }
+
+    PerfPhase enter(PerfPhase phase) { return enabled ? switchPhase(phase) : PHASE_NONE; }
+
+    void endFrame();
+
+    uint64_t getFrameCount(PerfPhase phase, PerfEvent event) { return frameCounts[phase][event].load(std::memory_order_relaxed); }
+
+    bool isAvailable(PerfEvent event) { return available.load(std::memory_order_relaxed) & BIT(event); }
+
+    static const char *getPhaseName(PerfPhase phase);
+
+    static const char *getEventName(PerfEvent event);
+
+private:
+    struct ThreadCounters {
+        PerfCounters *owner = nullptr;
+        PerfPhase phase = PHASE_NONE;
+        int fds[EVENT_COUNT] = {};
+        int events[EVENT_COUNT] = {};
+        int count = -1;
+        uint32_t mask = 0; // Events that opened, as bits
+        uint64_t last[EVENT_COUNT] = {};
+
+        ~ThreadCounters();
+        void open();
+        bool sample(uint64_t *values);
+    };
+
+    static thread_local ThreadCounters threadCounters;
+
+    bool enabled = false;
+    std::atomic<uint32_t> available = {}; // Events that opened on any thread counting for this, as bits
+    std::atomic<uint64_t> counts[PHASE_COUNT][EVENT_COUNT] = {};
+    std::atomic<uint64_t> frameCounts[PHASE_COUNT][EVENT_COUNT] = {}; // Read from other threads
+
+    PerfPhase switchPhase(PerfPhase phase);
+};
+
+// Counts events in a phase for the lifetime of the scope, then returns to the enclosing phase
+class PerfScope {
+public:
+    PerfScope(PerfCounters &counters, PerfPhase phase) : counters(counters), last(counters.enter(phase)) {}
+
+    ~PerfScope() { counters.enter(last); }
+
+private:
+    PerfCounters &counters;
+    PerfPhase last;
+};
+
+#endif // PERF_COUNTERS_H
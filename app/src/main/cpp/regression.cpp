@@ -0,0 +1,199 @@
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+
+#include "regression.h"
+#include "core.h"
+#include "settings.h"
+
+#define HASH_BASIS 0xCBF29CE484222325ULL // FNV-1a offset basis
+#define HASH_PRIME 0x100000001B3ULL // FNV-1a prime
+
+Regression::Regression(const std::string &corpusPath) {
+    // Read the corpus entries, skipping blank lines and comments
+    size_t split = corpusPath.find_last_of('/');
+    directory = (split == std::string::npos) ? "" : corpusPath.substr(0, split + 1);
+    FILE *file = fopen(corpusPath.c_str(), "r");
+    if (!file) return;
+
+    char data[1024];
+    while (fgets(data, 1024, file) != nullptr) {
+        char name[256], rom[256], movie[256] = {};
+        int frames = 0;
+        if (data[0] == '#' || sscanf(data, "%255s %255s %d %255s", name, rom, &frames, movie) < 3 || frames <= 0)
+            continue;
+        entries.push_back({name, directory + rom, movie[0] ? (directory + movie) : "", frames});
+    }
+    fclose(file);
+}
+
+uint64_t Regression::hash(uint64_t value, const uint32_t *data, size_t count) {
+    // Add 32-bit words to an FNV-1a hash
+    for (size_t i = 0; i < count; i++) {
+        for (int j = 0; j < 32; j += 8) {
+            value ^= (data[i] >> j) & 0xFF;
+            value *= HASH_PRIME;
+        }
+    }
+    return value;
+}
+
+bool Regression::run(bool record) {
+    // Save the settings that get pinned, so they can be restored for whatever runs next
+    bool directBoot = Settings::getDirectBoot();
+    std::string bios9Path = Settings::getBios9Path();
+    std::string bios7Path = Settings::getBios7Path();
+    std::string firmwarePath = Settings::getFirmwarePath();
+    std::string gbaBiosPath = Settings::getGbaBiosPath();
+    std::string sdImagePath = Settings::getSdImagePath();
+    std::string wifiSocketDir = Settings::getWifiSocketDir();
+    int rtcEpoch = Settings::getRtcEpoch();
+    int fpsLimiter = Settings::getFpsLimiter();
+    int rewindLength = Settings::getRewindLength();
+    int runAhead = Settings::getRunAhead();
+
+    // Pin the settings that would make output depend on the host, and use HLE BIOS so no system files are needed
+    // Settings that change how emulation runs are left alone, since those are what a run is meant to check
+    Settings::setDirectBoot(true);
+    Settings::setBios9Path("");
+    Settings::setBios7Path("");
+    Settings::setFirmwarePath("");
+    Settings::setGbaBiosPath("");
+    Settings::setSdImagePath("");
+    Settings::setWifiSocketDir("");
+    Settings::setRtcEpoch(0);
+    Settings::setFpsLimiter(0);
+    Settings::setRewindLength(0);
+    Settings::setRunAhead(0);
+
+    // Run each entry, building a table of results with the FPS change from the baseline
+    char buffer[512];
+    snprintf(buffer, sizeof(buffer), "%-24s %-8s %10s %10s %8s\n", "ROM", "Result", "FPS", "Base FPS", "Delta");
+    report = buffer;
+    bool passed = !entries.empty();
+    for (size_t i = 0; i < entries.size(); i++) {
+        std::string result;
+        double fps = 0, baseFps = 0;
+        passed &= runEntry(entries[i], record, result, fps, baseFps);
+        if (baseFps > 0) {
+            snprintf(buffer, sizeof(buffer), "%-24s %-8s %10.1f %10.1f %+7.1f%%\n", entries[i].name.c_str(),
+                     result.c_str(), fps, baseFps, (fps - baseFps) * 100 / baseFps);
+        } else {
+            snprintf(buffer, sizeof(buffer), "%-24s %-8s %10.1f %10s %8s\n", entries[i].name.c_str(),
+                     result.c_str(), fps, "-", "-");
+        }
+        report += buffer;
+    }
+
+    report += passed ? "PASS\n" : "FAIL\n";
+
+    // Restore the pinned settings
+    Settings::setDirectBoot(directBoot);
+    Settings::setBios9Path(bios9Path);
+    Settings::setBios7Path(bios7Path);
+    Settings::setFirmwarePath(firmwarePath);
+    Settings::setGbaBiosPath(gbaBiosPath);
+    Settings::setSdImagePath(sdImagePath);
+    Settings::setWifiSocketDir(wifiSocketDir);
+    Settings::setRtcEpoch(rtcEpoch);
+    Settings::setFpsLimiter(fpsLimiter);
+    Settings::setRewindLength(rewindLength);
+    Settings::setRunAhead(runAhead);
+    return passed;
+}
+
+bool Regression::runEntry(Entry &entry, bool record, std::string &result, double &fps, double &baseFps) {
+    // Load the expected results unless recording new ones
+    std::string hashPath = directory + entry.name + ".hashes";
+    std::vector<std::pair<uint64_t, uint64_t>> expected;
+    if (!record) {
+        FILE *file = fopen(hashPath.c_str(), "r");
+        if (!file) {
+            result = "NO HASH";
+            return false;
+        }
+
+        char data[256];
+        uint64_t video, audio;
+        if (fgets(data, 256, file) == nullptr || sscanf(data, "fps %lf", &baseFps) < 1)
+            baseFps = 0;
+        while (fgets(data, 256, file) != nullptr) {
+            if (sscanf(data, "%*d %" SCNx64 " %" SCNx64, &video, &audio) == 2)
+                expected.push_back({video, audio});
+        }
+        fclose(file);
+    }
+
+    // Check that the ROM exists, since a missing one isn't caught until after loading has started
+    FILE *romFile = fopen(entry.romPath.c_str(), "rb");
+    if (!romFile) {
+        result = "NO ROM";
+        return false;
+    }
+    fclose(romFile);
+
+    // Boot the ROM, using the extension to tell NDS and GBA apart
+    Core *core;
+    try {
+        bool gba = entry.romPath.size() >= 4 && entry.romPath.compare(entry.romPath.size() - 4, 4, ".gba") == 0;
+        core = new Core(gba ? "" : entry.romPath, gba ? entry.romPath : "");
+    } catch (CoreError e) {
+        result = "NO BOOT";
+        return false;
+    }
+    if (!entry.moviePath.empty() && !core->input.startPlayback(entry.moviePath)) {
+        delete core;
+        result = "NO MOVIE";
+        return false;
+    }
+
+    // Run the frames, hashing everything displayed and played during each
+    std::vector<uint32_t> samples;
+    std::vector<uint32_t> buffer(256 * 192 * 2 * 4);
+    std::vector<std::pair<uint64_t, uint64_t>> hashes;
+    core->spu.setSampleTap(&samples);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < entry.frames; i++) {
+        core->runFrame();
+        uint64_t video = HASH_BASIS;
+        size_t size = core->isGbaMode() ? (240 * 160) : (256 * 192 * 2);
+        if (Settings::getHighRes3D()) size *= 4;
+        while (core->gpu.getFrame(buffer.data(), core->isGbaMode()))
+            video = hash(video, buffer.data(), size);
+        hashes.push_back({video, hash(HASH_BASIS, samples.data(), samples.size())});
+        samples.clear();
+    }
+    fps = entry.frames / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    delete core;
+
+    if (record) {
+        // Write the results as the new expected ones
+        FILE *file = fopen(hashPath.c_str(), "w");
+        if (!file) {
+            result = "NO WRITE";
+            return false;
+        }
+        fprintf(file, "fps %.1f\n", fps);
+        for (size_t i = 0; i < hashes.size(); i++)
+            fprintf(file, "%zu %016" PRIx64 " %016" PRIx64 "\n", i, hashes[i].first, hashes[i].second);
+        fclose(file);
+        result = "RECORDED";
+        return true;
+    }
+
+    // Report the first frame that doesn't match, and which stream differed
+    for (size_t i = 0; i < hashes.size(); i++) {
+        if (i >= expected.size()) {
+            result = "SHORT";
+            return false;
+        }
+        if (hashes[i] != expected[i]) {
+            bool video = hashes[i].first != expected[i].first;
+            bool audio = hashes[i].second != expected[i].second;
+            result = std::string(video ? "V" : "") + (audio ? "A" : "") + "@" + std::to_string(i);
+            return false;
+        }
+    }
+    result = "OK";
+    return true;
+}
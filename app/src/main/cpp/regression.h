@@ -0,0 +1,34 @@
+#ifndef REGRESSION_H
+#define REGRESSION_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Runs a corpus of ROMs and checks their per-frame video and audio hashes against expected ones, timing each run
+// Each corpus line is "name rom frames [movie]", with paths relative to the corpus file
+// Expected results are kept next to the corpus as name.hashes, holding the baseline FPS and a line per frame
+class Regression {
+public:
+    Regression(const std::string &corpusPath);
+
+    bool run(bool record = false);
+
+    const std::string &getReport() { return report; }
+
+private:
+    struct Entry {
+        std::string name, romPath, moviePath;
+        int frames;
+    };
+
+    std::string directory;
+    std::vector<Entry> entries;
+    std::string report;
+
+    bool runEntry(Entry &entry, bool record, std::string &result, double &fps, double &baseFps);
+
+    static uint64_t hash(uint64_t value, const uint32_t *data, size_t count);
+};
+
+#endif // REGRESSION_H
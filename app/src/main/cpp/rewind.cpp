@@ -0,0 +1,230 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "rewind.h"
+#include "core.h"
+#include "lz.h"
+#include "settings.h"
+
+#define CAPTURE_FRAMES 4
+#define RAM_SIZE 0x400000 // Size of main RAM, which is the largest part of the state
+
+Rewind::Rewind(Core *core) : core(core) {
+    // Keep enough snapshots to cover the requested number of seconds, or none if disabled
+    capacity = std::max(Settings::getRewindLength(), 0) * 60 / CAPTURE_FRAMES;
+    deltas.resize(capacity);
+    if (capacity == 0) return;
+
+    // Diff main RAM and VRAM separately, using the written blocks tracked for main RAM to skip the rest of it
+    size_t size = 0;
+    buffers.push_back({core->memory.getRam(), RAM_SIZE, core->memory.getRamWritten(), 0});
+    for (int i = 0; i < 9; i++)
+        buffers.push_back({core->memory.getVram(i), core->memory.getVramSize(i), nullptr, 0});
+    for (auto &buffer: buffers) {
+        buffer.copy = size;
+        size += buffer.size;
+    }
+    copies.resize(size);
+}
+
+void Rewind::update() {
+    // Capture a snapshot every few frames while rewind is enabled
+    if (capacity == 0 || ++frames < CAPTURE_FRAMES) return;
+    frames = 0;
+    capture();
+}
+
+void Rewind::capture() {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // Start over if the mode changed, since states can't be loaded across it
+    if (gbaMode != core->isGbaMode()) {
+        gbaMode = core->isGbaMode();
+        valid = false;
+        count = 0;
+    }
+
+    // Save the new state over the older of the two full states, leaving out main RAM and VRAM
+    State &last = states[current];
+    State &next = states[current ^ 1];
+    core->saveState(next, false);
+    current ^= 1;
+
+    if (valid) {
+        // Pad both states to the same whole number of words, so they can be compared word by word
+        size_t lastSize = last.getSize();
+        size_t size = (std::max(lastSize, next.getSize()) + 7) & ~7;
+        last.setSize(size);
+        next.setSize(size);
+
+        // Store the difference that turns the new state back into the last one, replacing the oldest if full
+        // The header has the last state's size and where the runs for the state and each buffer end
+        size_t end = encodeRuns(sizeof(uint64_t) * (buffers.size() + 2), (uint64_t*)last.getData(),
+                                (uint64_t*)next.getData(), size / 8);
+        memcpy(&runs[0], &lastSize, sizeof(uint64_t));
+        memcpy(&runs[sizeof(uint64_t)], &end, sizeof(uint64_t));
+
+        // Store the differences in the buffers after, and apply them to the copies to bring those up to date
+        for (size_t i = 0; i < buffers.size(); i++) {
+            Buffer &buffer = buffers[i];
+            uint64_t *copy = (uint64_t*)&copies[buffer.copy];
+            size_t begin = end;
+            end = encodeRuns(begin, copy, (uint64_t*)buffer.data, buffer.size / 8, buffer.written);
+            memcpy(&runs[sizeof(uint64_t) * (i + 2)], &end, sizeof(uint64_t));
+            applyRuns(begin, end, copy, buffer.size / 8);
+        }
+        newest = (newest + 1) % capacity;
+        count = std::min(count + 1, capacity);
+
+        // Compress the difference after a header with its uncompressed size
+        std::vector<uint8_t> &delta = deltas[newest];
+        delta.resize(sizeof(uint64_t));
+        memcpy(&delta[0], &end, sizeof(uint64_t));
+        Lz::compress(runs.data(), end, delta);
+        captureBytes = delta.size();
+    } else {
+        // Use the first state and copies of the buffers as a base for the differences that follow
+        for (auto &buffer: buffers)
+            memcpy(&copies[buffer.copy], buffer.data, buffer.size);
+        valid = true;
+        captureBytes = 0;
+    }
+
+    // Track which main RAM blocks are written until the next snapshot
+    core->memory.trackRamWrites();
+
+    std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+    captureTime = time.count() * 1000000;
+}
+
+size_t Rewind::encodeRuns(size_t offset, const uint64_t *last, const uint64_t *next, size_t words,
+                          const bool *written) {
+    // Encode the difference as runs of matching words to skip, each followed by differing words to XOR
+    // Runs are 2 32-bit counts followed by the XORed words, and are written to the buffer at the given offset
+    // The buffer only grows, since resizing it smaller and back would clear it every time
+    size_t maxSize = offset + sizeof(uint64_t) * (words + words / 2 + 2);
+    if (runs.size() < maxSize) runs.resize(maxSize);
+    uint8_t *out = &runs[offset];
+    size_t i = 0;
+
+    while (i < words) {
+        // Skip 4KB blocks that weren't written, then matching aligned groups of 64 and 8 words, then matching words
+        // Groups are only compared when aligned, so a difference isn't scanned up to again from every word before it
+        // Most of the state doesn't change between snapshots
+        size_t start = i;
+        while (i < words) {
+            if (written && !written[i >> 9])
+                i = (i | 0x1FF) + 1;
+            else if (!(i & 63) && i + 64 <= words && !memcmp(&last[i], &next[i], 64 * sizeof(uint64_t)))
+                i += 64;
+            else if (!(i & 7) && i + 8 <= words && !memcmp(&last[i], &next[i], 8 * sizeof(uint64_t)))
+                i += 8;
+            else if (last[i] == next[i])
+                i++;
+            else
+                break;
+        }
+        if (i >= words) break;
+
+        // Only end a run of differing words at 2 matching words, so single gaps don't cost a new run
+        size_t diff = i;
+        while (i < words && (last[i] != next[i] || (i + 1 < words && last[i + 1] != next[i + 1])))
+            i++;
+
+        uint32_t counts[2] = {(uint32_t)(diff - start), (uint32_t)(i - diff)};
+        memcpy(out, counts, sizeof(counts));
+        out += sizeof(counts);
+        for (size_t j = diff; j < i; j++) {
+            uint64_t value = last[j] ^ next[j];
+            memcpy(out, &value, sizeof(value));
+            out += sizeof(value);
+        }
+    }
+
+    return out - &runs[0];
+}
+
+bool Rewind::applyRuns(size_t offset, size_t end, uint64_t *data, size_t words, bool *touched) {
+    // XOR the differing words from each run into the data, failing if a run goes out of bounds
+    // The 4KB blocks that change are marked if requested
+    const uint8_t *in = &runs[offset];
+    const uint8_t *stop = &runs[0] + end;
+    size_t i = 0;
+
+    while (in < stop) {
+        uint32_t counts[2];
+        if (stop - in < (ptrdiff_t)sizeof(counts)) return false;
+        memcpy(counts, in, sizeof(counts));
+        in += sizeof(counts);
+
+        i += counts[0];
+        if (i + counts[1] > words || (size_t)(stop - in) < counts[1] * sizeof(uint64_t))
+            return false;
+        for (size_t j = 0; j < counts[1]; j++, i++) {
+            uint64_t value;
+            memcpy(&value, in, sizeof(value));
+            data[i] ^= value;
+            in += sizeof(value);
+            if (touched) touched[i >> 9] = true;
+        }
+    }
+
+    return true;
+}
+
+bool Rewind::stepBack() {
+    // Go back to the previous snapshot, if there is one
+    if (count == 0) return false;
+    std::vector<uint8_t> &delta = deltas[newest];
+    State &state = states[current];
+
+    // Decompress the difference from the previous snapshot and apply it to the current one and the buffer copies
+    // If that fails, the current snapshot can't be trusted as a base anymore, so start over
+    size_t header = sizeof(uint64_t) * (buffers.size() + 2);
+    uint64_t runsSize, lastSize, end;
+    bool touched[RAM_SIZE >> 12] = {};
+    memcpy(&runsSize, &delta[0], sizeof(uint64_t));
+    if (runs.size() < runsSize) runs.resize(runsSize);
+    bool decoded = runsSize >= header &&
+                   Lz::decompress(&delta[sizeof(uint64_t)], delta.size() - sizeof(uint64_t), runs.data(), runsSize);
+    for (size_t i = 0, begin = header; decoded && i <= buffers.size(); i++, begin = end) {
+        memcpy(&end, &runs[sizeof(uint64_t) * (i + 1)], sizeof(uint64_t));
+        decoded = end >= begin && end <= runsSize && (i == 0 ?
+                  applyRuns(begin, end, (uint64_t*)state.getData(), state.getSize() / 8) :
+                  applyRuns(begin, end, (uint64_t*)&copies[buffers[i - 1].copy], buffers[i - 1].size / 8,
+                            buffers[i - 1].written ? touched : nullptr));
+    }
+    if (!decoded) {
+        LOG("Failed to decode rewind snapshot\n");
+        valid = false;
+        count = 0;
+        return false;
+    }
+
+    // Load the previous snapshot, which becomes the base for future captures
+    memcpy(&lastSize, &runs[0], sizeof(uint64_t));
+    state.setSize(lastSize);
+    newest = (newest + capacity - 1) % capacity;
+    count--;
+    frames = 0;
+    if (!core->loadState(state)) {
+        valid = false;
+        count = 0;
+        return false;
+    }
+
+    // Restore the buffers from their copies, only copying main RAM blocks written since or changed by going back
+    for (auto &buffer: buffers) {
+        if (!buffer.written) {
+            memcpy(buffer.data, &copies[buffer.copy], buffer.size);
+            continue;
+        }
+        for (size_t i = 0; i < buffer.size; i += 0x1000) {
+            if (buffer.written[i >> 12] || touched[i >> 12])
+                memcpy(&buffer.data[i], &copies[buffer.copy + i], 0x1000);
+        }
+    }
+    core->memory.trackRamWrites();
+    return true;
+}
@@ -0,0 +1,66 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "state.h"
+
+class Core;
+
+// Ring of recent snapshots for stepping emulation back in time
+// Only the newest snapshot is kept in full; older ones are compressed differences from the next newer one
+// Main RAM and VRAM are diffed against copies of themselves instead, so they aren't saved with every snapshot
+class Rewind {
+public:
+    Rewind(Core *core);
+
+    void update();
+
+    bool stepBack();
+
+    size_t getCount() { return count; }
+
+    uint32_t getCaptureTime() { return captureTime; }
+
+    size_t getCaptureBytes() { return captureBytes; }
+
+private:
+    Core *core;
+
+    size_t capacity = 0;
+    int frames = 0;
+    bool gbaMode = false;
+
+    // Full states are swapped between captures, so the last one is kept to diff against
+    State states[2];
+    int current = 0;
+    bool valid = false;
+
+    // Large buffers that are kept out of the states, with copies of them as of the newest snapshot
+    struct Buffer {
+        uint8_t *data;
+        size_t size;
+        const bool *written; // 4KB blocks written since the last snapshot, or null if they aren't tracked
+        size_t copy;
+    };
+    std::vector<Buffer> buffers;
+    std::vector<uint8_t> copies;
+
+    std::vector<std::vector<uint8_t>> deltas;
+    std::vector<uint8_t> runs;
+    size_t newest = 0, count = 0;
+
+    uint32_t captureTime = 0; // Microseconds
+    size_t captureBytes = 0;
+
+    void capture();
+
+    size_t encodeRuns(size_t offset, const uint64_t *last, const uint64_t *next, size_t words,
+                      const bool *written = nullptr);
+
+    bool applyRuns(size_t offset, size_t end, uint64_t *data, size_t words, bool *touched = nullptr);
+};
+
+#endif // REWIND_H
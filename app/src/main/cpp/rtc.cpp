@@ -2,6 +2,33 @@
 
 #include "rtc.h"
 #include "core.h"
+#include "settings.h"
+
+#define NDS_CLOCK 33513982 // Scheduler cycles per second in NDS mode
+#define GBA_CLOCK 16777216 // Scheduler cycles per second in GBA mode
+#define EPOCH_2000 946684800 // Unix time of 2000-01-01 00:00:00
+
+void Rtc::syncState(State &state) {
+    // Sync the serial state, the emulated clock, and the GPIO registers
+    state.var(gpRtc);
+    state.var(csCur);
+    state.var(sckCur);
+    state.var(sioCur);
+    state.var(writeCount);
+    state.var(command);
+    state.var(control);
+    state.var(dateTime);
+    state.var(clockCycles);
+    state.var(clockTime);
+    state.var(clockGba);
+    state.var(rtc);
+    state.var(gpDirection);
+    state.var(gpControl);
+
+    // Update the memory map to reflect the read status of the GP registers
+    if (!state.isSaving() && core->isGbaMode())
+        core->memory.updateMap7(0x8000000, 0x8001000);
+}
 
 void Rtc::updateRtc(bool cs, bool sck, bool sio) {
     if (cs) {
@@ -40,32 +67,54 @@ void Rtc::updateRtc(bool cs, bool sck, bool sio) {
     sioCur = sio;
 }
 
+void Rtc::updateClock() {
+    // Add the time emulated since the last update, at the cycle rate of the mode it ran in
+    uint64_t cycles = core->getTotalCycles() - clockCycles;
+    uint64_t rate = clockGba ? GBA_CLOCK : NDS_CLOCK;
+    clockTime += (cycles / rate) * 1000000 + (cycles % rate) * 1000000 / rate;
+    clockCycles += cycles;
+    clockGba = core->isGbaMode();
+}
+
 void Rtc::updateDateTime() {
-    // Get the local time
-    std::time_t t = std::time(nullptr);
-    std::tm *time = std::localtime(&t);
-    time->tm_year %= 100; // The DS only counts years 2000-2099
-    time->tm_mon++; // The DS starts month values at 1, not 0
+    std::tm time;
+    if (Settings::getRtcEpoch() < 0) {
+        // Get the local time from the host
+        std::time_t t = std::time(nullptr);
+        localtime_r(&t, &time);
+    } else {
+        // Get the emulated time, counted from the configured epoch
+        // This doesn't depend on the host in any way, so runs with the same input see the same time
+        updateClock();
+        std::time_t t = EPOCH_2000 + Settings::getRtcEpoch() + clockTime / 1000000;
+        gmtime_r(&t, &time);
+    }
+
+    time.tm_year %= 100; // The DS only counts years 2000-2099
+    time.tm_mon++; // The DS starts month values at 1, not 0
 
     // Convert to 12-hour format if enabled
     if (!(control & BIT(core->isGbaMode() ? 6 : 1)))
-        time->tm_hour %= 12;
+        time.tm_hour %= 12;
 
     // Save to the date and time registers in BCD format
     // Index 3 contains the day of the week, but most things don't care
-    dateTime[0] = ((time->tm_year / 10) << 4) | (time->tm_year % 10);
-    dateTime[1] = ((time->tm_mon / 10) << 4) | (time->tm_mon % 10);
-    dateTime[2] = ((time->tm_mday / 10) << 4) | (time->tm_mday % 10);
-    dateTime[4] = ((time->tm_hour / 10) << 4) | (time->tm_hour % 10);
-    dateTime[5] = ((time->tm_min / 10) << 4) | (time->tm_min % 10);
-    dateTime[6] = ((time->tm_sec / 10) << 4) | (time->tm_sec % 10);
+    dateTime[0] = ((time.tm_year / 10) << 4) | (time.tm_year % 10);
+    dateTime[1] = ((time.tm_mon / 10) << 4) | (time.tm_mon % 10);
+    dateTime[2] = ((time.tm_mday / 10) << 4) | (time.tm_mday % 10);
+    dateTime[4] = ((time.tm_hour / 10) << 4) | (time.tm_hour % 10);
+    dateTime[5] = ((time.tm_min / 10) << 4) | (time.tm_min % 10);
+    dateTime[6] = ((time.tm_sec / 10) << 4) | (time.tm_sec % 10);
 
     // Set the AM/PM bit
-    if (time->tm_hour >= 12)
+    if (time.tm_hour >= 12)
         dateTime[4] |= BIT(6 << core->isGbaMode());
 }
 
 void Rtc::reset() {
+    // Bring the emulated clock up to date, in case the cycle rate is changing
+    updateClock();
+
     // Reset the RTC registers
     updateRtc(0, 0, 0);
     control = 0;
@@ -7,10 +7,14 @@
 
 class Core;
 
+class State;
+
 class Rtc {
 public:
     Rtc(Core *core) : core(core) {}
 
+    void syncState(State &state);
+
     void enableGpRtc() { gpRtc = true; }
 
     void reset();
@@ -44,12 +48,18 @@ private:
     uint8_t control = 0;
     uint8_t dateTime[7] = {};
 
+    uint64_t clockCycles = 0;
+    uint64_t clockTime = 0; // Microseconds
+    bool clockGba = false;
+
     uint8_t rtc = 0;
     uint16_t gpDirection = 0;
     uint16_t gpControl = 0;
 
     void updateRtc(bool cs, bool sck, bool sio);
 
+    void updateClock();
+
     void updateDateTime();
 
     bool readRegister(uint8_t index);
@@ -13,6 +13,15 @@ std::string Settings::bios7Path = "core/bios7.bin";
 std::string Settings::firmwarePath = "core/firmware.bin";
 std::string Settings::gbaBiosPath = "core/gba_bios.bin";
 std::string Settings::sdImagePath = "core/sd.img";
+int Settings::sdImageMapped = 0;
+int Settings::sdCacheSize = 1024; // KB
+std::string Settings::wifiSocketDir = ""; // Empty to only link cores in this process
+int Settings::perfCounters = 0;
+int Settings::rtcEpoch = -1; // Seconds since 2000 for an emulated clock, or -1 for the host clock
+int Settings::rewindLength = 0; // Seconds, or 0 to disable rewind
+int Settings::runAhead = 0; // Frames, or 0 to disable run-ahead
+std::string Settings::instrTracePath = ""; // Empty to disable instruction tracing
+int Settings::instrTraceTrigger = -1; // Address that writes the trace when run, or -1 for none
 
 std::vector<Setting> Settings::settings =
         {
@@ -25,7 +34,16 @@ std::vector<Setting> Settings::settings =
                 Setting("bios7Path", &bios7Path, true),
                 Setting("firmwarePath", &firmwarePath, true),
                 Setting("gbaBiosPath", &gbaBiosPath, true),
-                Setting("sdImagePath", &sdImagePath, true)
+                Setting("sdImagePath", &sdImagePath, true),
+                Setting("sdImageMapped", &sdImageMapped, false),
+                Setting("sdCacheSize", &sdCacheSize, false),
+                Setting("wifiSocketDir", &wifiSocketDir, true),
+                Setting("perfCounters", &perfCounters, false),
+                Setting("rtcEpoch", &rtcEpoch, false),
+                Setting("rewindLength", &rewindLength, false),
+                Setting("runAhead", &runAhead, false),
+                Setting("instrTracePath", &instrTracePath, true),
+                Setting("instrTraceTrigger", &instrTraceTrigger, false)
         };
 
 void Settings::add(std::vector<Setting> platformSettings) {
@@ -46,24 +64,29 @@ bool Settings::load(const std::string &file_name) {
     while (fgets(data, 1024, settingsFile) != nullptr) {
         std::string line = data;
         int split = line.find('=');
-        std::string name = line.substr(0, split);
-
-        for (auto &setting: settings) {
-            if (name == setting.name) {
-                std::string value = line.substr(split + 1, line.size() - split - 2);
-                if (setting.isString)
-                    *(std::string *) setting.value = value;
-                else if (value[0] >= 0x30 && value[0] <= 0x39)
-                    *(int *) setting.value = stoi(value);
-                break;
-            }
-        }
+        set(line.substr(0, split), line.substr(split + 1, line.size() - split - 2));
     }
 
     fclose(settingsFile);
     return true;
 }
 
+bool Settings::set(const std::string &name, const std::string &value) {
+    // Set a setting by name from its text form, as used in the settings file
+    for (auto &setting: settings) {
+        if (name == setting.name) {
+            if (setting.isString)
+                *(std::string *) setting.value = value;
+            else if (value[0] >= 0x30 && value[0] <= 0x39)
+                *(int *) setting.value = stoi(value);
+            else
+                return false;
+            return true;
+        }
+    }
+    return false;
+}
+
 bool Settings::save() {
     // Attempt to open the settings file
     FILE *settingsFile = fopen(filename.c_str(), "w");
@@ -21,6 +21,8 @@ public:
 
     static bool save();
 
+    static bool set(const std::string &name, const std::string &value);
+
     static bool getDirectBoot() { return directBoot; }
 
     static int getFpsLimiter() { return fpsLimiter; }
@@ -41,6 +43,24 @@ public:
 
     static std::string getSdImagePath() { return sdImagePath; }
 
+    static int getSdImageMapped() { return sdImageMapped; }
+
+    static int getSdCacheSize() { return sdCacheSize; }
+
+    static std::string getWifiSocketDir() { return wifiSocketDir; }
+
+    static int getPerfCounters() { return perfCounters; }
+
+    static int getRtcEpoch() { return rtcEpoch; }
+
+    static int getRewindLength() { return rewindLength; }
+
+    static int getRunAhead() { return runAhead; }
+
+    static std::string getInstrTracePath() { return instrTracePath; }
+
+    static int getInstrTraceTrigger() { return instrTraceTrigger; }
+
     static void setDirectBoot(int value) { directBoot = value; }
 
     static void setFpsLimiter(int value) { fpsLimiter = value; }
@@ -61,6 +81,24 @@ public:
 
     static void setSdImagePath(std::string value) { sdImagePath = value; }
 
+    static void setSdImageMapped(int value) { sdImageMapped = value; }
+
+    static void setSdCacheSize(int value) { sdCacheSize = value; }
+
+    static void setWifiSocketDir(std::string value) { wifiSocketDir = value; }
+
+    static void setPerfCounters(int value) { perfCounters = value; }
+
+    static void setRtcEpoch(int value) { rtcEpoch = value; }
+
+    static void setRewindLength(int value) { rewindLength = value; }
+
+    static void setRunAhead(int value) { runAhead = value; }
+
+    static void setInstrTracePath(std::string value) { instrTracePath = value; }
+
+    static void setInstrTraceTrigger(int value) { instrTraceTrigger = value; }
+
 private:
     Settings() {} // Private to prevent instantiation
 
@@ -76,6 +114,15 @@ private:
     static std::string firmwarePath;
     static std::string gbaBiosPath;
     static std::string sdImagePath;
+    static int sdImageMapped;
+    static int sdCacheSize;
+    static std::string wifiSocketDir;
+    static int perfCounters;
+    static int rtcEpoch;
+    static int rewindLength;
+    static int runAhead;
+    static std::string instrTracePath;
+    static int instrTraceTrigger;
 
     static std::vector<Setting> settings;
 };
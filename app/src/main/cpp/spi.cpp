@@ -2,6 +2,7 @@
 
 #include "spi.h"
 #include "core.h"
+#include "crc16.h"
 #include "settings.h"
 
 Spi::~Spi() {
@@ -10,18 +11,15 @@ Spi::~Spi() {
     if (micBuffer) delete[] micBuffer;
 }
 
-uint16_t Spi::crc16(uint32_t value, uint8_t *data, size_t size) {
-    static const uint16_t table[] = {0xC0C1, 0xC181, 0xC301, 0xC601, 0xCC01, 0xD801, 0xF001,
-                                     0xA001};
-
-    // Calculate a CRC16 value for the given data
-    for (size_t i = 0; i < size; i++) {
-        value ^= data[i];
-        for (size_t j = 0; j < 8; j++)
-            value = (value >> 1) ^ ((value & 1) ? (table[j] << (7 - j)) : 0);
-    }
-
-    return value;
+void Spi::syncState(State &state) {
+    // Sync the transfer state, leaving out the firmware since it's never written
+    // Touch and microphone input come from outside the core, so they're left out too
+    state.var(writeCount);
+    state.var(address);
+    state.var(command);
+    state.var(micSample);
+    state.var(spiCnt);
+    state.var(spiData);
 }
 
 bool Spi::loadFirmware() {
@@ -44,7 +42,7 @@ bool Spi::loadFirmware() {
             firmware[0x36] += core->getId();
 
             // Recalculate the WiFi config CRC
-            uint16_t crc = crc16(0, &firmware[0x2C], 0x138);
+            uint16_t crc = Crc16::calculate(0, &firmware[0x2C], 0x138);
             firmware[0x2A] = crc >> 0;
             firmware[0x2B] = crc >> 8;
         }
@@ -74,7 +72,7 @@ bool Spi::loadFirmware() {
     firmware[0x3D] = 0x3F; // Enabled channels, byte 2
 
     // Calculate the WiFi config CRC
-    uint16_t crc = crc16(0, &firmware[0x2C], 0x138);
+    uint16_t crc = Crc16::calculate(0, &firmware[0x2C], 0x138);
     firmware[0x2A] = crc >> 0;
     firmware[0x2B] = crc >> 8;
 
@@ -85,7 +83,7 @@ bool Spi::loadFirmware() {
         firmware[addr + 0xF5] = 0x28; // Unknown
 
         // Calculate the access point CRC
-        crc = crc16(0, &firmware[addr], 0xFE);
+        crc = Crc16::calculate(0, &firmware[addr], 0xFE);
         firmware[addr + 0xFE] = crc >> 0;
         firmware[addr + 0xFF] = crc >> 8;
     }
@@ -113,7 +111,7 @@ bool Spi::loadFirmware() {
         firmware[addr + 0x63] = 0xBF; // SCR Y2
 
         // Calculate the user settings CRC
-        crc = crc16(0xFFFF, &firmware[addr], 0x70);
+        crc = Crc16::calculate(0xFFFF, &firmware[addr], 0x70);
         firmware[addr + 0x72] = crc >> 0;
         firmware[addr + 0x73] = crc >> 8;
     }
@@ -6,10 +6,14 @@
 
 class Core;
 
+class State;
+
 class Spi {
 public:
     Spi(Core *core) : core(core) {}
 
+    void syncState(State &state);
+
     ~Spi();
 
     bool loadFirmware();
@@ -50,8 +54,6 @@ private:
     uint16_t touchX = 0x000, touchY = 0xFFF;
     uint16_t spiCnt = 0;
     uint8_t spiData = 0;
-
-    static uint16_t crc16(uint32_t value, uint8_t *data, size_t size);
 };
 
 #endif // SPI_H
@@ -44,6 +44,51 @@ Spu::~Spu() {
     delete[] bufferOut;
 }
 
+void Spu::syncState(State &state) {
+    // Sync the sound channels and registers, leaving out the host output buffers
+    state.var(gbaFrameSequencer);
+    state.var(gbaSoundTimers);
+    state.var(gbaEnvelopes);
+    state.var(gbaEnvTimers);
+    state.var(gbaSweepTimer);
+    state.var(gbaWaveDigit);
+    state.var(gbaNoiseValue);
+    state.var(gbaWaveRam);
+    state.var(gbaFifoA);
+    state.var(gbaFifoB);
+    state.var(gbaSampleA);
+    state.var(gbaSampleB);
+    state.var(enabled);
+    state.var(adpcmValue);
+    state.var(adpcmLoopValue);
+    state.var(adpcmIndex);
+    state.var(adpcmLoopIndex);
+    state.var(adpcmToggle);
+    state.var(dutyCycles);
+    state.var(noiseValues);
+    state.var(soundCurrent);
+    state.var(soundTimers);
+    state.var(sndCapCurrent);
+    state.var(sndCapTimers);
+    state.var(gbaSoundCntL);
+    state.var(gbaSoundCntH);
+    state.var(gbaSoundCntX);
+    state.var(gbaMainSoundCntL);
+    state.var(gbaMainSoundCntH);
+    state.var(gbaMainSoundCntX);
+    state.var(gbaSoundBias);
+    state.var(soundCnt);
+    state.var(soundSad);
+    state.var(soundTmr);
+    state.var(soundPnt);
+    state.var(soundLen);
+    state.var(mainSoundCnt);
+    state.var(soundBias);
+    state.var(sndCapCnt);
+    state.var(sndCapDad);
+    state.var(sndCapLen);
+}
+
 void Spu::scheduleInit() {
     // Schedule the initial NDS SPU task (this will reschedule itself indefinitely)
     core->schedule(Task(&runSampleTask, 512 * 2));
@@ -55,6 +100,9 @@ void Spu::gbaScheduleInit() {
 }
 
 uint32_t *Spu::getSamples(int count) {
+    TRACE_THREAD("Audio");
+    TRACE_SCOPE("Spu::getSamples");
+
     // Initialize the buffers
     if (bufferSize != count) {
         delete[] bufferIn;
@@ -114,7 +162,15 @@ uint32_t *Spu::getSamples(int count) {
     return out;
 }
 
+float Spu::getBufferFill() {
+    // Get the percentage of the output buffers holding samples, counting a full one waiting to be played
+    if (bufferSize == 0) return 0;
+    return (float)((ready.load() ? bufferSize : 0) + bufferPointer) * 100 / (bufferSize * 2);
+}
+
 void Spu::runGbaSample() {
+    StatsScope statsScope(core->stats, STATS_SPU);
+
     int64_t sampleLeft = 0;
     int64_t sampleRight = 0;
 
@@ -375,9 +431,14 @@ void Spu::runGbaSample() {
     sampleLeft = (sampleLeft - 0x200) << 5;
     sampleRight = (sampleRight - 0x200) << 5;
 
-    if (bufferSize > 0) {
-        // Write the samples to the buffer
-        bufferIn[bufferPointer++] = (sampleRight << 16) | (sampleLeft & 0xFFFF);
+    // Copy the samples to the tap if set, for tools that check the output
+    uint32_t sample = (sampleRight << 16) | (sampleLeft & 0xFFFF);
+    if (sampleTap && !muted)
+        sampleTap->push_back(sample);
+
+    if (bufferSize > 0 && !muted) {
+        // Write the samples to the buffer, unless they're from a frame that won't be played
+        bufferIn[bufferPointer++] = sample;
 
         // Handle a full buffer
         if (bufferPointer == bufferSize)
@@ -389,6 +450,9 @@ void Spu::runGbaSample() {
 }
 
 void Spu::runSample() {
+    PerfScope scope(core->perfCounters, PHASE_SPU);
+    StatsScope statsScope(core->stats, STATS_SPU);
+
     int64_t mixerLeft = 0, mixerRight = 0;
     int64_t channelsLeft[2] = {}, channelsRight[2] = {};
 
@@ -674,9 +738,14 @@ void Spu::runSample() {
     sampleLeft = (sampleLeft - 0x200) << 5;
     sampleRight = (sampleRight - 0x200) << 5;
 
-    if (bufferSize > 0) {
-        // Write the samples to the buffer
-        bufferIn[bufferPointer++] = (sampleRight << 16) | (sampleLeft & 0xFFFF);
+    // Copy the samples to the tap if set, for tools that check the output
+    uint32_t sample = (sampleRight << 16) | (sampleLeft & 0xFFFF);
+    if (sampleTap && !muted)
+        sampleTap->push_back(sample);
+
+    if (bufferSize > 0 && !muted) {
+        // Write the samples to the buffer, unless they're from a frame that won't be played
+        bufferIn[bufferPointer++] = sample;
 
         // Handle a full buffer
         if (bufferPointer == bufferSize)
@@ -688,6 +757,8 @@ void Spu::runSample() {
 }
 
 void Spu::swapBuffers() {
+    TRACE_SCOPE("Spu::swapBuffers");
+
     // Wait until the buffer has been played, keeping the emulator throttled to 60 FPS
     // Synchronizing to the audio eliminites the potential for nasty audio crackles
     if (Settings::getFpsLimiter() == 2) // Accurate
@@ -849,14 +920,12 @@ void Spu::writeGbaMainSoundCntH(uint16_t mask, uint16_t value) {
 
     // Empty FIFO A if requested
     if (value & BIT(11)) {
-        while (!gbaFifoA.empty())
-            gbaFifoA.pop();
+        gbaFifoA.clear();
     }
 
     // Empty FIFO B if requested
     if (value & BIT(15)) {
-        while (!gbaFifoB.empty())
-            gbaFifoB.pop();
+        gbaFifoB.clear();
     }
 }
 
@@ -891,7 +960,7 @@ void Spu::writeGbaWaveRam(int index, uint8_t value) {
 void Spu::writeGbaFifoA(uint32_t mask, uint32_t value) {
     // Push PCM8 data to the GBA sound FIFO A
     for (int i = 0; i < 32; i += 8) {
-        if (gbaFifoA.size() < 32 && (mask & (0xFF << i)))
+        if (!gbaFifoA.full() && (mask & (0xFF << i)))
             gbaFifoA.push(value >> i);
     }
 }
@@ -899,7 +968,7 @@ void Spu::writeGbaFifoA(uint32_t mask, uint32_t value) {
 void Spu::writeGbaFifoB(uint32_t mask, uint32_t value) {
     // Push PCM8 data to the GBA sound FIFO B
     for (int i = 0; i < 32; i += 8) {
-        if (gbaFifoB.size() < 32 && (mask & (0xFF << i)))
+        if (!gbaFifoB.full() && (mask & (0xFF << i)))
             gbaFifoB.push(value >> i);
     }
 }
@@ -5,23 +5,35 @@
 #include <condition_variable>
 #include <cstdint>
 #include <functional>
-#include <queue>
 #include <mutex>
+#include <vector>
+
+#include "fifo.h"
 
 class Core;
 
+class State;
+
 class Spu {
 public:
     Spu(Core *core);
 
     ~Spu();
 
+    void syncState(State &state);
+
     void scheduleInit();
 
     void gbaScheduleInit();
 
     uint32_t *getSamples(int count);
 
+    float getBufferFill();
+
+    void setMuted(bool value) { muted = value; }
+
+    void setSampleTap(std::vector<uint32_t> *tap) { sampleTap = tap; }
+
     void gbaFifoTimer(int timer);
 
     uint8_t readGbaSoundCntL(int channel);
@@ -95,6 +107,8 @@ private:
 
     uint32_t *bufferIn = nullptr, *bufferOut = nullptr;
     int bufferSize = 0, bufferPointer = 0;
+    bool muted = false;
+    std::vector<uint32_t> *sampleTap = nullptr;
 
     std::condition_variable cond1, cond2;
     std::mutex mutex1, mutex2;
@@ -109,7 +123,7 @@ private:
     uint16_t gbaNoiseValue = 0;
 
     uint8_t gbaWaveRam[2][16] = {};
-    std::queue<int8_t> gbaFifoA, gbaFifoB;
+    Fifo<int8_t, 32> gbaFifoA, gbaFifoB;
     int8_t gbaSampleA = 0, gbaSampleB = 0;
 
     uint16_t enabled = 0;
@@ -0,0 +1,58 @@
+#include <algorithm>
+#include <cstring>
+
+#include "state.h"
+
+void State::startSave(bool memory) {
+    // Start writing state from the beginning of the buffer, optionally leaving out main RAM and VRAM
+    saving = true;
+    valid = true;
+    this->memory = memory;
+    size = offset = 0;
+}
+
+void State::startLoad() {
+    // Start reading state from the beginning of the buffer
+    saving = false;
+    valid = true;
+    offset = 0;
+}
+
+void State::setSize(size_t size) {
+    // Resize the state, zeroing any space added past its old end
+    if (data.size() < size) data.resize(size);
+    if (size > this->size) memset(&data[this->size], 0, size - this->size);
+    this->size = size;
+}
+
+uint8_t *State::skip(size_t length) {
+    // Keep blocks 8-byte aligned, so values can be accessed in place
+    offset = (offset + 7) & ~7;
+
+    if (saving) {
+        // Grow the buffer as needed, keeping its capacity between saves
+        if (offset + length > data.size())
+            data.resize(std::max(data.size() * 2, offset + length));
+        size = offset + length;
+    } else if (offset + length > size) {
+        // Stop at the end of the state if it's smaller than expected
+        valid = false;
+        return nullptr;
+    }
+
+    // Return the block's place in the buffer and move past it
+    uint8_t *pointer = &data[offset];
+    offset += length;
+    return pointer;
+}
+
+uint8_t *State::block(void *value, size_t length) {
+    // Copy a block of state to or from the buffer
+    uint8_t *pointer = skip(length);
+    if (!pointer) return nullptr;
+    if (saving)
+        memcpy(pointer, value, length);
+    else
+        memcpy(value, pointer, length);
+    return pointer;
+}
@@ -0,0 +1,46 @@
+#ifndef STATE_H
+#define STATE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Buffer of emulated state, used for rewind and other features that need to go back in time
+// Components list their state once in syncState(), which copies it in whichever direction is set
+class State {
+public:
+    void startSave(bool memory = true);
+
+    void startLoad();
+
+    bool isSaving() { return saving; }
+
+    bool hasMemory() { return memory; }
+
+    bool isValid() { return valid; }
+
+    void invalidate() { valid = false; }
+
+    template<typename T>
+    void var(T &value) { block(&value, sizeof(T)); }
+
+    uint8_t *block(void *value, size_t length);
+
+    uint8_t *skip(size_t length);
+
+    uint8_t *getData() { return data.data(); }
+
+    size_t getSize() { return size; }
+
+    size_t getOffset() { return offset; }
+
+    void setSize(size_t size);
+
+private:
+    std::vector<uint8_t> data;
+    size_t size = 0, offset = 0;
+    bool saving = true, valid = true;
+    bool memory = true; // Whether main RAM and VRAM are included, which rewind tracks separately
+};
+
+#endif // STATE_H
@@ -0,0 +1,103 @@
+#include <cstdio>
+
+#include "stats.h"
+#include "core.h"
+
+#define NDS_CLOCK 33513982 // Scheduler cycles per second in NDS mode
+#define GBA_CLOCK 16777216 // Scheduler cycles per second in GBA mode
+#define STATS_PERIOD 0.5 // Seconds between published snapshots
+
+void Stats::countSlice(uint64_t cycles, bool halted9, bool halted7, uint32_t opcodes9, uint32_t opcodes7) {
+    // Count the opcodes run since the last scheduled task
+    opcodes[0] += opcodes9;
+    opcodes[1] += opcodes7;
+
+    // Count the cycles since the last scheduled task, as halted for each CPU that is halted now
+    // Loading a state can move the cycle count back, in which case the slice is just skipped
+    uint64_t length = (cycles > lastCycles) ? (cycles - lastCycles) : 0;
+    lastCycles = cycles;
+    periodCycles += length;
+    if (halted9) haltedCycles[0] += length;
+    if (halted7) haltedCycles[1] += length;
+}
+
+void Stats::endFrame() {
+    // Publish a new snapshot once the period is over
+    frames++;
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - lastTime).count();
+    if (seconds < STATS_PERIOD) return;
+
+    StatsSnapshot next;
+    next.fps = core->getFps();
+    next.hostFrameTime = seconds * 1000 / frames;
+    next.emuFrameTime = (double)periodCycles * 1000 / (core->isGbaMode() ? GBA_CLOCK : NDS_CLOCK) / frames;
+    next.tasksPerFrame = (double)tasks / frames;
+
+    for (int i = 0; i < 2; i++) {
+        // Get CPU usage from the opcodes run and the cycles spent halted
+        next.mips[i] = opcodes[i] / seconds / 1000000;
+        next.halted[i] = periodCycles ? (double)haltedCycles[i] * 100 / periodCycles : 0;
+        opcodes[i] = 0;
+        haltedCycles[i] = 0;
+    }
+
+    for (int i = 0; i < STATS_PHASE_COUNT; i++)
+        next.phaseTimes[i] = times[i].exchange(0, std::memory_order_relaxed) / 1000000.0 / frames;
+
+    // Get the state of output buffers and other components
+    next.audioFill = core->spu.getBufferFill();
+    next.framesSkipped = framesSkipped;
+    next.framesQueued = core->gpu.getQueuedFrames();
+    next.dldiCacheHits = core->dldi.getCacheHits();
+    next.dldiCacheMisses = core->dldi.getCacheMisses();
+    next.rewindCount = core->rewind.getCount();
+    next.rewindCaptureTime = core->rewind.getCaptureTime() / 1000.0;
+    next.rewindCaptureBytes = core->rewind.getCaptureBytes();
+    publish(next);
+
+    // Start the next period
+    lastTime = now;
+    periodCycles = 0;
+    tasks = 0;
+    frames = 0;
+    framesSkipped = 0;
+}
+
+void Stats::publish(const StatsSnapshot &next) {
+    // Write the snapshot between odd and even sequence numbers, so readers know to retry if they overlap
+    uint32_t seq = sequence.load(std::memory_order_relaxed);
+    sequence.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    snapshot = next;
+    sequence.store(seq + 2, std::memory_order_release);
+}
+
+StatsSnapshot Stats::getSnapshot() {
+    // Copy the last published snapshot, retrying if it changed during the copy
+    while (true) {
+        uint32_t seq = sequence.load(std::memory_order_acquire);
+        if (seq & 1) continue;
+        StatsSnapshot copy = snapshot;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence.load(std::memory_order_relaxed) == seq)
+            return copy;
+    }
+}
+
+std::string Stats::toJson(const StatsSnapshot &snapshot) {
+    // Format a snapshot as a single-line JSON object
+    char buffer[1024];
+    snprintf(buffer, sizeof(buffer),
+             "{\"fps\":%d,\"hostFrameTime\":%.3f,\"emuFrameTime\":%.3f,\"mips\":[%.2f,%.2f],"
+             "\"halted\":[%.1f,%.1f],\"tasksPerFrame\":%.1f,\"gpu2DTime\":%.3f,\"gpu3DTime\":%.3f,"
+             "\"spuTime\":%.3f,\"audioFill\":%.1f,\"framesSkipped\":%u,\"framesQueued\":%u,"
+             "\"dldiCacheHits\":%u,\"dldiCacheMisses\":%u,\"rewindCount\":%zu,"
+             "\"rewindCaptureTime\":%.3f,\"rewindCaptureBytes\":%zu}",
+             snapshot.fps, snapshot.hostFrameTime, snapshot.emuFrameTime, snapshot.mips[0], snapshot.mips[1],
+             snapshot.halted[0], snapshot.halted[1], snapshot.tasksPerFrame, snapshot.phaseTimes[STATS_GPU_2D],
+             snapshot.phaseTimes[STATS_GPU_3D], snapshot.phaseTimes[STATS_SPU], snapshot.audioFill,
+             snapshot.framesSkipped, snapshot.framesQueued, snapshot.dldiCacheHits, snapshot.dldiCacheMisses,
+             snapshot.rewindCount, snapshot.rewindCaptureTime, snapshot.rewindCaptureBytes);
+    return buffer;
+}
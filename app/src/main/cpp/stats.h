@@ -0,0 +1,98 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+class Core;
+
+enum StatsPhase {
+    STATS_GPU_2D, // Gpu2D::drawScanline
+    STATS_GPU_3D, // Gpu3DRenderer rasterization and finishing, summed across threads
+    STATS_SPU, // Spu::runSample
+    STATS_PHASE_COUNT
+};
+
+// Averages over the last stats period, with times in milliseconds per frame unless noted
+struct StatsSnapshot {
+    int fps = 0;
+    double hostFrameTime = 0; // Real time per emulated frame
+    double emuFrameTime = 0; // Emulated time per frame
+    double mips[2] = {}; // Millions of ARM9 and ARM7 opcodes per real second
+    double halted[2] = {}; // Percentage of emulated time each CPU was halted
+    double tasksPerFrame = 0; // Scheduled tasks run per frame
+    double phaseTimes[STATS_PHASE_COUNT] = {};
+    double audioFill = 0; // Percentage of the audio buffers filled at the end of the period
+    uint32_t framesSkipped = 0; // Frames dropped because the queue was full
+    uint32_t framesQueued = 0; // Frames waiting to be displayed at the end of the period
+    uint32_t dldiCacheHits = 0, dldiCacheMisses = 0; // Totals since the core started
+    size_t rewindCount = 0; // Rewind snapshots currently stored
+    double rewindCaptureTime = 0; // Time of the last rewind capture
+    size_t rewindCaptureBytes = 0; // Size of the last rewind capture
+};
+
+// Performance stats gathered on the emulation thread and published a few times per second
+// Any thread can take a snapshot, and retries instead of locking if one is being published
+class Stats {
+public:
+    Stats(Core *core) : core(core), lastTime(std::chrono::steady_clock::now()) {}
+
+    void addTime(StatsPhase phase, uint64_t nanoseconds) { times[phase].fetch_add(nanoseconds, std::memory_order_relaxed); }
+
+    void countTask() { tasks++; }
+
+    void countSlice(uint64_t cycles, bool halted9, bool halted7, uint32_t opcodes9, uint32_t opcodes7);
+
+    void countSkippedFrame() { framesSkipped++; }
+
+    void setPaused(bool value) { paused.store(value, std::memory_order_relaxed); }
+    bool isPaused() { return paused.load(std::memory_order_relaxed); }
+
+    void endFrame();
+
+    StatsSnapshot getSnapshot();
+
+    static std::string toJson(const StatsSnapshot &snapshot);
+
+private:
+    Core *core;
+
+    std::atomic<uint32_t> sequence{0};
+    StatsSnapshot snapshot;
+
+    std::chrono::steady_clock::time_point lastTime;
+    uint64_t lastCycles = 0, periodCycles = 0;
+    uint64_t opcodes[2] = {};
+    uint64_t haltedCycles[2] = {};
+    uint64_t tasks = 0;
+    uint32_t frames = 0;
+    uint32_t framesSkipped = 0;
+    std::atomic<uint64_t> times[STATS_PHASE_COUNT] = {};
+    std::atomic<bool> paused{false}; // Set while running frames that aren't shown, like run-ahead's
+
+    void publish(const StatsSnapshot &next);
+};
+
+// Adds the time spent in the scope to a stats phase, unless the stats were paused when it started
+class StatsScope {
+public:
+    StatsScope(Stats &stats, StatsPhase phase) : stats(stats), phase(phase), counted(!stats.isPaused()) {
+        if (counted) start = std::chrono::steady_clock::now();
+    }
+
+    ~StatsScope() {
+        if (!counted) return;
+        stats.addTime(phase, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count());
+    }
+
+private:
+    Stats &stats;
+    StatsPhase phase;
+    bool counted;
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif // STATS_H
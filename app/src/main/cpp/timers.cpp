@@ -1,58 +1,137 @@
+#include <algorithm>
+
 #include "timers.h"
 #include "core.h"
 
+// Furthest ahead an event is scheduled; later overflows get a checkpoint event instead
+#define MAX_EVENT_CYCLES 0x40000000
+
 Timers::Timers(Core *core, bool cpu) : core(core), cpu(cpu) {
     // Prepare tasks to be used with the scheduler
     for (int i = 0; i < 4; i++)
         overflowTask[i] = std::bind(&Timers::overflow, this, i);
 }
 
-void Timers::resetCycles() {
-    // Adjust timer end cycles for a global cycle reset
-    for (int i = 0; i < 4; i++)
-        endCycles[i] -= core->getGlobalCycles();
+void Timers::syncState(State &state) {
+    // Sync the registers and counting state, which is kept in total cycles so it stays valid
+    state.var(timers);
+    state.var(shifts);
+    state.var(endCycles);
+    state.var(eventCycles);
+    state.var(overflowCycles);
+    state.var(tmCntL);
+    state.var(tmCntH);
 }
 
-void Timers::overflow(int timer) {
-    // Ensure the timer is enabled and the end cycle is correct if not in count-up mode
-    // The end cycle check ensures that if a timer was changed while running, outdated events are ignored
-    if (!(tmCntH[timer] & BIT(7)) ||
-        ((timer == 0 || !(tmCntH[timer] & BIT(2))) && endCycles[timer] != core->getGlobalCycles()))
-        return;
+uint64_t Timers::getOverflowCycles(int timer, uint64_t count) {
+    // Get the cycle of a timer's count-th next overflow, assuming timers are up to date, or -1 if it won't overflow
+    // Huge counts are clamped; the result is still far enough ahead that only a checkpoint gets scheduled
+    if (!(tmCntH[timer] & BIT(7)))
+        return -1;
+    count = std::min<uint64_t>(count, 0xFFFFFFFF);
+
+    // Counting timers overflow once per period after their current end cycle
+    if (isCounting(timer))
+        return endCycles[timer] + (count - 1) * getPeriod(timer);
+
+    // Count-up timers overflow after enough overflows of the previous timer
+    uint64_t ticks = (0x10000 - timers[timer]) + (count - 1) * (0x10000 - tmCntL[timer]);
+    return getOverflowCycles(timer - 1, ticks);
+}
+
+void Timers::update() {
+    uint64_t cycles = core->getTotalCycles();
+    uint64_t carry = 0;
+
+    // Bring all timers up to date, passing overflow counts down the count-up chain
+    for (int i = 0; i < 4; i++) {
+        if (!(tmCntH[i] & BIT(7))) {
+            carry = 0;
+        } else if (isCounting(i)) {
+            // Count the overflows that have passed and move the end cycle to the next one
+            carry = 0;
+            if (cycles >= endCycles[i]) {
+                uint64_t period = getPeriod(i);
+                carry = (cycles - endCycles[i]) / period + 1;
+                endCycles[i] += carry * period;
+            }
+        } else {
+            // Tick the count-up timer by the previous timer's overflows, reloading it on each of its own
+            uint32_t first = 0x10000 - timers[i];
+            if (carry >= first) {
+                uint32_t length = 0x10000 - tmCntL[i];
+                uint64_t extra = carry - first;
+                timers[i] = tmCntL[i] + extra % length;
+                carry = extra / length + 1;
+            } else {
+                timers[i] += carry;
+                carry = 0;
+            }
+        }
+    }
+}
 
-    // Reload the timer and schedule another overflow if not in count-up mode
-    timers[timer] = tmCntL[timer];
-    if (timer == 0 || !(tmCntH[timer] & BIT(2))) {
-        core->schedule(Task(&overflowTask[timer], (0x10000 - timers[timer]) << shifts[timer]));
-        endCycles[timer] = core->getGlobalCycles() + ((0x10000 - timers[timer]) << shifts[timer]);
+void Timers::scheduleEvents() {
+    uint64_t cycles = core->getTotalCycles();
+
+    for (int i = 0; i < 4; i++) {
+        // Only schedule overflows that have an effect: IRQs, and the GBA sound FIFOs on timers 0 and 1
+        uint64_t next = -1;
+        if ((tmCntH[i] & BIT(6)) || (core->isGbaMode() && i < 2))
+            next = getOverflowCycles(i, 1);
+
+        // Skip timers that don't need an event or already have the right one
+        if (next == overflowCycles[i]) continue;
+        overflowCycles[i] = next;
+        if (next == (uint64_t)-1) continue;
+
+        // Schedule the overflow, or a checkpoint to reconsider it if it's too far off
+        eventCycles[i] = std::min<uint64_t>(next, cycles + MAX_EVENT_CYCLES);
+        core->schedule(Task(&overflowTask[i], eventCycles[i] - cycles));
     }
+}
 
-    // Trigger a timer overflow IRQ if enabled
-    if (tmCntH[timer] & BIT(6))
-        core->interpreter[cpu].sendInterrupt(3 + timer);
+void Timers::overflow(int timer) {
+    // Ignore outdated events from before a timer was changed
+    uint64_t cycles = core->getTotalCycles();
+    if (eventCycles[timer] != cycles || overflowCycles[timer] == (uint64_t)-1)
+        return;
 
-    // Trigger a GBA sound FIFO event
-    if (core->isGbaMode() && timer < 2)
-        core->spu.gbaFifoTimer(timer);
+    // Bring the timers up to date, and stop if this was only a checkpoint
+    update();
+    bool overflowed = (overflowCycles[timer] == cycles);
+    overflowCycles[timer] = -1;
+    if (overflowed) {
+        // Trigger a timer overflow IRQ if enabled
+        if (tmCntH[timer] & BIT(6))
+            core->interpreter[cpu].sendInterrupt(3 + timer);
 
-    // If the next timer has count-up timing enabled, tick it now
-    // In count-up timing mode, the timer only ticks when the previous timer overflows
-    if (timer < 3 && (tmCntH[timer + 1] & BIT(2)) && ++timers[timer + 1] == 0)
-        overflow(timer + 1);
+        // Trigger a GBA sound FIFO event
+        if (core->isGbaMode() && timer < 2)
+            core->spu.gbaFifoTimer(timer);
+    }
+
+    // Schedule the next overflow
+    scheduleEvents();
 }
 
 void Timers::writeTmCntL(int timer, uint16_t mask, uint16_t value) {
+    // Bring the timers up to date, since the reload value affects overflows after the current one
+    update();
+
     // Write to one of the TMCNT_L registers
     // This value doesn't affect the current counter, and is instead used as the reload value
     tmCntL[timer] = (tmCntL[timer] & ~mask) | (value & mask);
+    scheduleEvents();
 }
 
 void Timers::writeTmCntH(int timer, uint16_t mask, uint16_t value) {
     bool dirty = false;
 
-    // Update the current timer value if it's running on the scheduler
-    if ((tmCntH[timer] & BIT(7)) && (timer == 0 || !(value & BIT(2))))
-        timers[timer] = 0x10000 - ((endCycles[timer] - core->getGlobalCycles()) >> shifts[timer]);
+    // Save the current timer value if it's counting on its own
+    update();
+    if (isCounting(timer))
+        timers[timer] = readTmCntL(timer);
 
     // Update the timer shift if the prescaler setting was changed
     // The prescaler allows timers to tick at frequencies of f/1, f/64, f/256, or f/1024 (when not in count-up mode)
@@ -73,19 +152,29 @@ void Timers::writeTmCntH(int timer, uint16_t mask, uint16_t value) {
     }
 
     // Write to one of the TMCNT_H registers
+    bool counting = isCounting(timer);
     mask &= 0x00C7;
     tmCntH[timer] = (tmCntH[timer] & ~mask) | (value & mask);
 
-    // Schedule a timer overflow if the timer changed and isn't in count-up mode
-    if (dirty && (tmCntH[timer] & BIT(7)) && (timer == 0 || !(tmCntH[timer] & BIT(2)))) {
-        core->schedule(Task(&overflowTask[timer], (0x10000 - timers[timer]) << shifts[timer]));
-        endCycles[timer] = core->getGlobalCycles() + ((0x10000 - timers[timer]) << shifts[timer]);
-    }
+    // Restart counting from the current value if the timer changed and isn't in count-up mode
+    if ((dirty || !counting) && isCounting(timer))
+        endCycles[timer] = core->getTotalCycles() + ((uint64_t)(0x10000 - timers[timer]) << shifts[timer]);
+
+    // Reschedule overflows, since this can affect the whole count-up chain
+    scheduleEvents();
 }
 
 uint16_t Timers::readTmCntL(int timer) {
-    // Read the current timer value, updating it if it's running on the scheduler
-    if ((tmCntH[timer] & BIT(7)) && (timer == 0 || !(tmCntH[timer] & BIT(2))))
-        timers[timer] = 0x10000 - ((endCycles[timer] - core->getGlobalCycles()) >> shifts[timer]);
-    return timers[timer];
+    // Count-up timers only change on overflows, so bring them up to date
+    if (!isCounting(timer)) {
+        if (tmCntH[timer] & BIT(7)) update();
+        return timers[timer];
+    }
+
+    // Calculate the current value of a counting timer from its next overflow
+    uint64_t cycles = core->getTotalCycles();
+    uint64_t end = endCycles[timer];
+    if (cycles >= end)
+        end += ((cycles - end) / getPeriod(timer) + 1) * getPeriod(timer);
+    return 0x10000 - ((end - cycles) >> shifts[timer]);
 }
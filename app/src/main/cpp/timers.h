@@ -4,13 +4,17 @@
 #include <cstdint>
 #include <functional>
 
+#include "defines.h"
+
 class Core;
 
+class State;
+
 class Timers {
 public:
     Timers(Core *core, bool cpu);
 
-    void resetCycles();
+    void syncState(State &state);
 
     uint16_t readTmCntH(int timer) { return tmCntH[timer]; }
 
@@ -24,15 +28,28 @@ private:
     Core *core;
     bool cpu;
 
+    // Count-up timers hold their value as of the last update; other running timers count in closed form
     uint16_t timers[4] = {};
     uint8_t shifts[4] = {};
-    uint32_t endCycles[4] = {};
+    uint64_t endCycles[4] = {};
+    uint64_t eventCycles[4] = {};
+    uint64_t overflowCycles[4] = {};
 
     uint16_t tmCntL[4] = {};
     uint16_t tmCntH[4] = {};
 
     std::function<void()> overflowTask[4];
 
+    bool isCounting(int timer) { return (tmCntH[timer] & BIT(7)) && (timer == 0 || !(tmCntH[timer] & BIT(2))); }
+
+    uint64_t getPeriod(int timer) { return (uint64_t)(0x10000 - tmCntL[timer]) << shifts[timer]; }
+
+    uint64_t getOverflowCycles(int timer, uint64_t count);
+
+    void update();
+
+    void scheduleEvents();
+
     void overflow(int timer);
 };
 
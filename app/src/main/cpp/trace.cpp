@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "trace.h"
+
+#define EVENT_COUNT 0x10000
+
+std::atomic<Trace::Buffer*> Trace::buffers{nullptr};
+std::atomic<int> Trace::bufferCount{0};
+thread_local Trace::ThreadBuffer Trace::threadBuffer;
+
+Trace::ThreadBuffer::~ThreadBuffer() {
+    // Release the buffer when the thread exits, so a later thread can take its place on the timeline
+    if (buffer)
+        buffer->used.store(false, std::memory_order_release);
+}
+
+Trace::Buffer *Trace::getBuffer(const char *name) {
+    // Reuse a buffer released by an exited thread with the same name, since helper threads are restarted often
+    // Matching names keeps each row of the timeline to one kind of thread
+    for (Buffer *buffer = buffers.load(std::memory_order_acquire); buffer; buffer = buffer->next) {
+        const char *last = buffer->name.load(std::memory_order_relaxed);
+        if ((last != name && (!last || !name || strcmp(last, name))) || buffer->used.load(std::memory_order_relaxed))
+            continue;
+        bool used = false;
+        if (buffer->used.compare_exchange_strong(used, true, std::memory_order_acquire))
+            return buffer;
+    }
+
+    // Create a new buffer and add it to the list otherwise
+    Buffer *buffer = new Buffer();
+    buffer->events = new Event[EVENT_COUNT];
+    buffer->name.store(name, std::memory_order_relaxed);
+    buffer->id = bufferCount.fetch_add(1, std::memory_order_relaxed);
+    buffer->next = buffers.load(std::memory_order_relaxed);
+    while (!buffers.compare_exchange_weak(buffer->next, buffer, std::memory_order_release));
+    return buffer;
+}
+
+void Trace::enter(const char *name) {
+    // End the last event entered on this thread and start a new one, or none if null
+    ThreadBuffer &thread = threadBuffer;
+    uint64_t time = now();
+    if (thread.name) record(thread.name, thread.start, time);
+    thread.name = name;
+    thread.start = time;
+}
+
+void Trace::record(const char *name, uint64_t start, uint64_t end) {
+    // Write an event to this thread's ring, overwriting the oldest once it's full
+    ThreadBuffer &thread = threadBuffer;
+    if (!thread.buffer) thread.buffer = getBuffer(nullptr);
+    Buffer *buffer = thread.buffer;
+    uint64_t count = buffer->count.load(std::memory_order_relaxed);
+    buffer->events[count & (EVENT_COUNT - 1)] = {name, start, end};
+    buffer->count.store(count + 1, std::memory_order_release);
+}
+
+void Trace::setThreadName(const char *name) {
+    // Name this thread's row on the timeline
+    ThreadBuffer &thread = threadBuffer;
+    if (!thread.buffer)
+        thread.buffer = getBuffer(name);
+    else
+        thread.buffer->name.store(name, std::memory_order_relaxed);
+}
+
+bool Trace::dump(const std::string &path) {
+#ifdef TRACE
+    // Copy the recorded events out of each buffer while threads keep writing to them
+    // Events that might have been overwritten during the copy are dropped
+    std::vector<std::pair<Buffer*, std::vector<Event>>> copies;
+    uint64_t base = -1;
+    for (Buffer *buffer = buffers.load(std::memory_order_acquire); buffer; buffer = buffer->next) {
+        uint64_t end = buffer->count.load(std::memory_order_acquire);
+        uint64_t start = (end > EVENT_COUNT) ? (end - EVENT_COUNT) : 0;
+        std::vector<Event> events;
+        for (uint64_t i = start; i < end; i++)
+            events.push_back(buffer->events[i & (EVENT_COUNT - 1)]);
+
+        // The slot after the last count may be mid-write too, so it's counted as lost
+        uint64_t last = buffer->count.load(std::memory_order_acquire) + 1;
+        size_t lost = (last > start + EVENT_COUNT) ? std::min<size_t>(last - start - EVENT_COUNT, events.size()) : 0;
+        events.erase(events.begin(), events.begin() + lost);
+        for (size_t i = 0; i < events.size(); i++)
+            base = std::min(base, events[i].start);
+        copies.push_back({buffer, std::move(events)});
+    }
+
+    // Write the events as complete events in microseconds, with each thread named by metadata
+    FILE *file = fopen(path.c_str(), "w");
+    if (!file) return false;
+    fprintf(file, "{\"traceEvents\":[\n");
+    bool first = true;
+    for (size_t i = 0; i < copies.size(); i++) {
+        Buffer *buffer = copies[i].first;
+        const char *name = buffer->name.load(std::memory_order_relaxed);
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}",
+                first ? "" : ",\n", buffer->id, name ? name : "Thread", buffer->id);
+        first = false;
+
+        for (size_t j = 0; j < copies[i].second.size(); j++) {
+            Event &event = copies[i].second[j];
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    event.name, buffer->id, (event.start - base) / 1000.0, (event.end - event.start) / 1000.0);
+        }
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    return true;
+#else
+    // Nothing is recorded unless tracing is compiled in
+    (void)path;
+    return false;
+#endif
+}
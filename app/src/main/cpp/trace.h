@@ -0,0 +1,83 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Trace markers are compiled out unless TRACE is defined, so they cost nothing in normal builds
+#ifdef TRACE
+#define TRACE_JOIN2(a, b) a##b
+#define TRACE_JOIN(a, b) TRACE_JOIN2(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_JOIN(traceScope, __LINE__)(name)
+#define TRACE_ENTER(name) Trace::enter(name)
+#define TRACE_THREAD(name) Trace::setThreadName(name)
+#else
+#define TRACE_SCOPE(name)
+#define TRACE_ENTER(name)
+#define TRACE_THREAD(name)
+#endif
+
+// Timeline of named events that can be dumped as Chrome trace JSON, for viewing in Perfetto
+// Each thread records into its own ring buffer, so recording never locks or waits on other threads
+class Trace {
+public:
+    static void enter(const char *name);
+
+    static void record(const char *name, uint64_t start, uint64_t end);
+
+    static void setThreadName(const char *name);
+
+    static bool dump(const std::string &path);
+
+    static uint64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+private:
+    Trace() {} // Private to prevent instantiation
+
+    struct Event {
+        const char *name;
+        uint64_t start, end;
+    };
+
+    struct Buffer {
+        Event *events;
+        std::atomic<uint64_t> count{0};
+        std::atomic<bool> used{true};
+        std::atomic<const char*> name{nullptr};
+        int id;
+        Buffer *next;
+    };
+
+    struct ThreadBuffer {
+        Buffer *buffer = nullptr;
+        const char *name = nullptr;
+        uint64_t start = 0;
+
+        ~ThreadBuffer();
+    };
+
+    static std::atomic<Buffer*> buffers;
+    static std::atomic<int> bufferCount;
+    static thread_local ThreadBuffer threadBuffer;
+
+    static Buffer *getBuffer(const char *name);
+};
+
+// Records an event for the lifetime of the scope
+class TraceScope {
+public:
+    TraceScope(const char *name) : name(name), start(Trace::now()) {}
+
+    ~TraceScope() { Trace::record(name, start, Trace::now()); }
+
+private:
+    const char *name;
+    uint64_t start;
+};
+
+#endif // TRACE_H
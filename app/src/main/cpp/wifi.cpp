@@ -1,50 +1,104 @@
 #include <algorithm>
+#include <cstring>
 
 #include "wifi.h"
 #include "core.h"
+#include "settings.h"
 
 #define MS_CYCLES 34418
 
-Wifi::Wifi(Core *core) : core(core) {
+// Milliseconds without WiFi traffic before packet polling stops
+#define IDLE_MS 16
+
+// Most milliseconds to wait between events, keeping the scheduler in range
+#define MAX_TICKS 1000
+
+Wifi::Wifi(Core *core, int id) : core(core) {
     // Set some default BB register values
     bbRegisters[0x00] = 0x6D;
     bbRegisters[0x5D] = 0x01;
     bbRegisters[0x64] = 0xFF;
 
+    // Open a socket to link with cores in other processes if a directory is set
+    if (!Settings::getWifiSocketDir().empty())
+        socketTransport = std::make_unique<WifiSocketTransport>(Settings::getWifiSocketDir(), id);
+
     // Prepare tasks to be used with the scheduler
-    countMsTask = std::bind(&Wifi::countMs, this);
+    eventTask = std::bind(&Wifi::processEvent, this);
+}
+
+void Wifi::syncState(State &state) {
+    // Sync the timing and registers, leaving out links and packets that come from outside the core
+    state.var(scheduled);
+    state.var(tickTime);
+    state.var(eventTime);
+    state.var(activeTime);
+    state.var(bbRegisters);
+    state.var(wModeWep);
+    state.var(wIrf);
+    state.var(wIe);
+    state.var(wMacaddr);
+    state.var(wBssid);
+    state.var(wAidFull);
+    state.var(wRxcnt);
+    state.var(wPowerstate);
+    state.var(wPowerforce);
+    state.var(wRxbufBegin);
+    state.var(wRxbufEnd);
+    state.var(wRxbufWrcsr);
+    state.var(wRxbufWrAddr);
+    state.var(wRxbufRdAddr);
+    state.var(wRxbufReadcsr);
+    state.var(wRxbufGap);
+    state.var(wRxbufGapdisp);
+    state.var(wTxbufLoc);
+    state.var(wBeaconInt);
+    state.var(wTxreqRead);
+    state.var(wUsCountcnt);
+    state.var(wUsComparecnt);
+    state.var(wPreBeacon);
+    state.var(wBeaconCount);
+    state.var(wRxbufCount);
+    state.var(wTxbufWrAddr);
+    state.var(wTxbufCount);
+    state.var(wTxbufGap);
+    state.var(wTxbufGapdisp);
+    state.var(wPostBeacon);
+    state.var(wBbWrite);
+    state.var(wBbRead);
+    state.var(wConfig);
 }
 
 void Wifi::scheduleInit() {
-    // Schedule an initial millisecond tick (this will reschedule itself as needed)
-    core->schedule(Task(&countMsTask, MS_CYCLES));
-    scheduled = true;
+    // Schedule the next event (this will reschedule itself as needed)
+    updateCounters();
+    scheduleEvent();
+}
+
+void Wifi::checkPackets() {
+    // Wake up immediately if packets arrived while polling was idle
+    if (localTransport.hasPending() || (socketTransport && socketTransport->hasPending())) {
+        if (!scheduled || eventTime > core->getTotalCycles() + 1) {
+            eventTime = core->getTotalCycles() + 1;
+            core->schedule(Task(&eventTask, 1));
+            scheduled = true;
+        }
+    }
 }
 
 void Wifi::addConnection(Core *core) {
-    // Add an external core to this one's connection list
-    mutex.lock();
-    connections.push_back(&core->wifi);
-    mutex.unlock();
-
-    // Add this core to the external one's connection list
-    core->wifi.mutex.lock();
-    core->wifi.connections.push_back(this);
-    core->wifi.mutex.unlock();
+    // Link this core with an external one in the same process
+    localTransport.connect(&core->wifi.localTransport);
 }
 
 void Wifi::remConnection(Core *core) {
-    // Remove an external core from this one's connection list
-    mutex.lock();
-    auto position = std::find(connections.begin(), connections.end(), &core->wifi);
-    connections.erase(position);
-    mutex.unlock();
+    // Unlink an external core in the same process from this one
+    localTransport.disconnect(&core->wifi.localTransport);
+}
 
-    // Remove this core from the external one's connection list
-    core->wifi.mutex.lock();
-    position = std::find(core->wifi.connections.begin(), core->wifi.connections.end(), this);
-    core->wifi.connections.erase(position);
-    core->wifi.mutex.unlock();
+uint64_t Wifi::getTimestamp() {
+    // Convert the core's total cycle count to emulated microseconds
+    return core->getTotalCycles() * 1000 / MS_CYCLES;
 }
 
 void Wifi::sendInterrupt(int bit) {
@@ -63,68 +117,155 @@ void Wifi::sendInterrupt(int bit) {
 }
 
 void Wifi::countMs() {
-    // Process any queued packets
-    if (!packets.empty())
-        processPackets();
-
-    if (wUsCountcnt) // Counter enable
-    {
-        // Trigger a pre-beacon interrupt at the pre-beacon timestamp
-        if (wBeaconCount == wPreBeacon)
-            sendInterrupt(15);
-
-        // Decrement the beacon millisecond counter and handle underflows
-        if (--wBeaconCount == 0) {
-            // Trigger a beacon transfer and reload the millisecond counter
-            if ((wTxbufLoc[4] & BIT(15)) && (wTxreqRead & BIT(4)))
-                transfer(4);
-            wBeaconCount = wBeaconInt;
-
-            // Trigger an immediate beacon interrupt if enabled
-            if (wUsComparecnt)
-                sendInterrupt(14);
-        }
+    // Trigger a pre-beacon interrupt at the pre-beacon timestamp
+    if (wBeaconCount == wPreBeacon)
+        sendInterrupt(15);
+
+    // Decrement the beacon millisecond counter and handle underflows
+    if (--wBeaconCount == 0) {
+        // Trigger a beacon transfer and reload the millisecond counter
+        if ((wTxbufLoc[4] & BIT(15)) && (wTxreqRead & BIT(4)))
+            transfer(4);
+        wBeaconCount = wBeaconInt;
+
+        // Trigger an immediate beacon interrupt if enabled
+        if (wUsComparecnt)
+            sendInterrupt(14);
+    }
 
-        // Trigger a post-beacon interrupt when the counter reaches zero
-        if (wPostBeacon && --wPostBeacon == 0)
-            sendInterrupt(13);
+    // Trigger a post-beacon interrupt when the counter reaches zero
+    if (wPostBeacon && --wPostBeacon == 0)
+        sendInterrupt(13);
+}
+
+uint32_t Wifi::ticksToEvent() {
+    // Get the number of milliseconds until the next beacon, pre-beacon, or post-beacon interrupt
+    uint32_t ticks = wBeaconCount ? wBeaconCount : 0x10000;
+    ticks = std::min<uint32_t>(ticks, (uint16_t)(wBeaconCount - wPreBeacon) + 1);
+    if (wPostBeacon)
+        ticks = std::min<uint32_t>(ticks, wPostBeacon);
+    return ticks;
+}
+
+void Wifi::updateCounters() {
+    // Count the milliseconds that have passed since the last update
+    uint32_t ticks = (core->getTotalCycles() - tickTime) / MS_CYCLES;
+    tickTime += (uint64_t)ticks * MS_CYCLES;
+    if (!wUsCountcnt) return;
+
+    while (ticks > 0) {
+        // Decrement the counters in bulk up to the next millisecond with an interrupt
+        uint32_t count = std::min(ticksToEvent() - 1, ticks);
+        wBeaconCount -= count;
+        if (wPostBeacon)
+            wPostBeacon -= count;
+
+        // Handle the interrupting millisecond normally
+        if ((ticks -= count) == 0) break;
+        countMs();
+        ticks--;
     }
+}
 
-    // Reschedule the task as long as something is active
-    if (!connections.empty() || wUsCountcnt)
-        core->schedule(Task(&countMsTask, MS_CYCLES));
-    else
-        scheduled = false;
+void Wifi::scheduleEvent() {
+    // Stop scheduling events when nothing is active
+    if (!isLinked() && !wUsCountcnt)
+        return;
+
+    // Wake up at the next counter interrupt, or every millisecond to poll for packets during traffic
+    uint64_t cycles = core->getTotalCycles();
+    uint32_t ticks = wUsCountcnt ? std::min<uint32_t>(ticksToEvent(), MAX_TICKS) : MAX_TICKS;
+    if (isLinked() && cycles - activeTime < IDLE_MS * MS_CYCLES)
+        ticks = 1;
+
+    // Schedule the event unless an earlier one is already pending
+    uint64_t time = tickTime + (uint64_t)ticks * MS_CYCLES;
+    if (scheduled && eventTime <= time) return;
+    core->schedule(Task(&eventTask, time - cycles));
+    eventTime = time;
+    scheduled = true;
 }
 
-void Wifi::processPackets() {
-    mutex.lock();
+void Wifi::processEvent() {
+    // Ignore events that were replaced by an earlier one
+    if (!scheduled || core->getTotalCycles() < eventTime) return;
+    scheduled = false;
 
-    // Write all queued packets to the circular buffer
-    for (size_t i = 0; i < packets.size(); i++) {
-        uint16_t size = (packets[i][4] + 12) / 2;
+    // Catch up the counters, process any queued packets, and schedule the next event
+    updateCounters();
+    if (isLinked() && processPackets())
+        activeTime = core->getTotalCycles();
+    scheduleEvent();
+}
+
+bool Wifi::processPackets() {
+    uint64_t time = getTimestamp();
+    bool received = false;
 
-        for (size_t j = 0; j < size; j++) {
-            // Write a half-word of the packet to memory
-            core->memory.write<uint16_t>(1, 0x4804000 + wRxbufWrcsr, packets[i][j]);
+    // Receive all packets that are due from cores in this process
+    while (WifiPacket *packet = localTransport.receive(time)) {
+        receivePacket(packet);
+        localTransport.release(packet);
+        received = true;
+    }
 
-            // Increment the circular buffer address
-            wRxbufWrcsr += 2;
-            if ((wRxbufBegin & 0x1FFE) != (wRxbufEnd & 0x1FFE))
-                wRxbufWrcsr = (wRxbufBegin & 0x1FFE) + (wRxbufWrcsr - (wRxbufBegin & 0x1FFE)) %
-                                                       ((wRxbufEnd & 0x1FFE) -
-                                                        (wRxbufBegin & 0x1FFE));
-            wRxbufWrcsr &= 0x1FFE;
+    // Receive all packets that are due from cores in other processes
+    if (!socketTransport) return received;
+    while (WifiPacket *packet = socketTransport->receive(time)) {
+        receivePacket(packet);
+        socketTransport->release(packet);
+        received = true;
+    }
+
+    return received;
+}
+
+void Wifi::receivePacket(WifiPacket *packet) {
+    uint8_t *wifiRam = core->memory.getWifiRam();
+    uint16_t begin = wRxbufBegin & 0x1FFE;
+    uint16_t end = wRxbufEnd & 0x1FFE;
+    uint8_t *data = (uint8_t*)packet->data;
+    size_t size = packet->size & ~1;
+
+    // Write the packet to the circular buffer in WiFi RAM
+    while (size > 0) {
+        if (begin < end && wRxbufWrcsr >= begin && wRxbufWrcsr < end) {
+            // Copy as much as possible up to the end of the buffer, then wrap to the start
+            size_t count = std::min<size_t>(size, end - wRxbufWrcsr);
+            memcpy(&wifiRam[wRxbufWrcsr], data, count);
+            wRxbufWrcsr += count;
+            if (wRxbufWrcsr == end)
+                wRxbufWrcsr = begin;
+            data += count;
+            size -= count;
+            continue;
         }
 
-        delete[] packets[i];
+        // Write a half-word of the packet when the write address is outside of a valid buffer
+        wifiRam[wRxbufWrcsr + 0] = data[0];
+        wifiRam[wRxbufWrcsr + 1] = data[1];
+        data += 2;
+        size -= 2;
+
+        // Increment the circular buffer address
+        wRxbufWrcsr += 2;
+        if (begin != end)
+            wRxbufWrcsr = begin + (wRxbufWrcsr - begin) % (end - begin);
+        wRxbufWrcsr &= 0x1FFE;
+    }
 
-        // Trigger a receive complete interrupt
-        sendInterrupt(0);
+    // Trigger a receive complete interrupt
+    sendInterrupt(0);
+}
+
+WifiPacket *Wifi::allocPacket() {
+    // Find a packet slot that isn't referenced by any receivers
+    for (int i = 0; i < 32; i++) {
+        if (packetPool[i].refs.load(std::memory_order_acquire) == 0)
+            return &packetPool[i];
     }
 
-    packets.clear();
-    mutex.unlock();
+    return nullptr;
 }
 
 void Wifi::transfer(int index) {
@@ -132,25 +273,37 @@ void Wifi::transfer(int index) {
     uint16_t size = core->memory.read<uint16_t>(1, 0x4804000 + address + 0x0A) + 8;
     LOG("Sending packet on channel %d with size 0x%X\n", index, size);
 
-    mutex.lock();
-
-    for (size_t i = 0; i < connections.size(); i++) {
-        // Read the packet from memory
-        uint16_t *data = new uint16_t[size / 2];
-        for (size_t j = 0; j < size; j += 2)
-            data[j / 2] = core->memory.read<uint16_t>(1, 0x4804000 + address + j);
-
-        // Set the packet size in the outgoing header
-        data[4] = size - 12;
-
-        // Add the packet to the queue
-        connections[i]->mutex.lock();
-        connections[i]->packets.push_back(data);
-        connections[i]->mutex.unlock();
+    // Poll for replies every millisecond after sending
+    activeTime = core->getTotalCycles();
+
+    // Pick up peers in other processes that appeared since the last frame, so they get this packet
+    updatePeers();
+    if (isLinked()) {
+        if (WifiPacket *packet = allocPacket()) {
+            // Read the packet from WiFi RAM once, to be shared by all receivers
+            packet->size = std::min<uint16_t>(size, 0x2000);
+            if (address + packet->size <= 0x2000) {
+                memcpy(packet->data, &core->memory.getWifiRam()[address], packet->size);
+            } else {
+                for (size_t j = 0; j < packet->size; j += 2)
+                    packet->data[j / 2] = core->memory.read<uint16_t>(1, 0x4804000 + address + j);
+            }
+
+            // Set the packet size in the outgoing header and stamp it with the send time
+            packet->data[4] = size - 12;
+            packet->timestamp = getTimestamp();
+
+            // Pass the packet to each transport, holding a reference until they've taken their own
+            packet->refs.store(1, std::memory_order_relaxed);
+            localTransport.send(packet);
+            if (socketTransport)
+                socketTransport->send(packet);
+            packet->refs.fetch_sub(1, std::memory_order_release);
+        } else {
+            LOG("Dropping WiFi packet because all packet slots are in use\n");
+        }
     }
 
-    mutex.unlock();
-
     // Clear the enable flag for non-beacons
     if (index != 4)
         wTxbufLoc[index] &= ~BIT(15);
@@ -326,7 +479,9 @@ void Wifi::writeWBeaconInt(uint16_t mask, uint16_t value) {
     wBeaconInt = (wBeaconInt & ~mask) | (value & mask);
 
     // Reload the beacon millisecond counter
+    updateCounters();
     wBeaconCount = wBeaconInt;
+    scheduleEvent();
 }
 
 void Wifi::writeWTxreqReset(uint16_t mask, uint16_t value) {
@@ -349,8 +504,10 @@ void Wifi::writeWTxreqSet(uint16_t mask, uint16_t value) {
 
 void Wifi::writeWUsCountcnt(uint16_t mask, uint16_t value) {
     // Write to the W_US_COUNTCNT register
+    updateCounters();
     mask &= 0x0001;
     wUsCountcnt = (wUsCountcnt & ~mask) | (value & mask);
+    scheduleEvent();
 }
 
 void Wifi::writeWUsComparecnt(uint16_t mask, uint16_t value) {
@@ -365,12 +522,16 @@ void Wifi::writeWUsComparecnt(uint16_t mask, uint16_t value) {
 
 void Wifi::writeWPreBeacon(uint16_t mask, uint16_t value) {
     // Write to the W_PRE_BEACON register
+    updateCounters();
     wPreBeacon = (wPreBeacon & ~mask) | (value & mask);
+    scheduleEvent();
 }
 
 void Wifi::writeWBeaconCount(uint16_t mask, uint16_t value) {
     // Write to the W_BEACON_COUNT register
+    updateCounters();
     wBeaconCount = (wBeaconCount & ~mask) | (value & mask);
+    scheduleEvent();
 }
 
 void Wifi::writeWConfig(int index, uint16_t mask, uint16_t value) {
@@ -388,7 +549,9 @@ void Wifi::writeWConfig(int index, uint16_t mask, uint16_t value) {
 
 void Wifi::writeWPostBeacon(uint16_t mask, uint16_t value) {
     // Write to the W_POST_BEACON register
+    updateCounters();
     wPostBeacon = (wPostBeacon & ~mask) | (value & mask);
+    scheduleEvent();
 }
 
 void Wifi::writeWBbCnt(uint16_t mask, uint16_t value) {
@@ -3,19 +3,31 @@
 
 #include <cstdint>
 #include <functional>
-#include <mutex>
-#include <vector>
+#include <memory>
+
+#include "wifi_transport.h"
 
 class Core;
 
+class State;
+
 class Wifi {
 public:
-    Wifi(Core *core);
+    Wifi(Core *core, int id);
 
-    bool shouldSchedule() { return (!connections.empty() || wUsCountcnt) && !scheduled; }
+    void syncState(State &state);
+
+    bool shouldSchedule() { return (isLinked() || wUsCountcnt) && !scheduled; }
 
     void scheduleInit();
 
+    void checkPackets();
+
+    void updatePeers() { if (socketTransport) socketTransport->updatePeers(); }
+
+    // Only count as linked when there are peers, so events can go idle without them
+    bool isLinked() { return localTransport.isActive() || (socketTransport && socketTransport->isActive()); }
+
     void addConnection(Core *core);
 
     void remConnection(Core *core);
@@ -76,11 +88,11 @@ public:
 
     uint16_t readWPreBeacon() { return wPreBeacon; }
 
-    uint16_t readWBeaconCount() { return wBeaconCount; }
+    uint16_t readWBeaconCount() { updateCounters(); return wBeaconCount; }
 
     uint16_t readWConfig(int index) { return wConfig[index]; }
 
-    uint16_t readWPostBeacon() { return wPostBeacon; }
+    uint16_t readWPostBeacon() { updateCounters(); return wPostBeacon; }
 
     uint16_t readWBbRead() { return wBbRead; }
 
@@ -159,10 +171,13 @@ public:
 private:
     Core *core;
 
-    std::vector<Wifi *> connections;
-    std::vector<uint16_t *> packets;
-    std::mutex mutex;
+    WifiPacket packetPool[32] = {};
+    WifiLocalTransport localTransport;
+    std::unique_ptr<WifiSocketTransport> socketTransport;
     bool scheduled = false;
+    uint64_t tickTime = 0;
+    uint64_t eventTime = 0;
+    uint64_t activeTime = 0;
 
     uint8_t bbRegisters[0x100] = {};
 
@@ -206,13 +221,27 @@ private:
                     0x0016, 0x0016, 0x162C, 0x0204, 0x0058
             };
 
-    std::function<void()> countMsTask;
+    std::function<void()> eventTask;
+
+    uint64_t getTimestamp();
 
     void sendInterrupt(int bit);
 
     void countMs();
 
-    void processPackets();
+    uint32_t ticksToEvent();
+
+    void updateCounters();
+
+    void scheduleEvent();
+
+    void processEvent();
+
+    bool processPackets();
+
+    void receivePacket(WifiPacket *packet);
+
+    WifiPacket *allocPacket();
 
     void transfer(int index);
 };
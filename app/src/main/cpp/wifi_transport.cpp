@@ -0,0 +1,301 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "wifi_transport.h"
+#include "defines.h"
+
+// How far ahead of the receiver a packet can be stamped before it's held back, in microseconds
+#define MAX_AHEAD 2000
+
+// Size of the header sent with each packet over a socket
+#define SOCKET_HEADER (sizeof(uint64_t) + sizeof(uint16_t))
+
+bool WifiQueue::push(WifiPacket *packet) {
+    // Add a packet to the ring if there's space
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) == 64) return false;
+    packets[t & 63] = packet;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+}
+
+WifiPacket *WifiQueue::peek() {
+    // Get the next packet in the ring without taking it, or return null if it's empty
+    uint32_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) return nullptr;
+    return packets[h & 63];
+}
+
+WifiPacket *WifiQueue::pop() {
+    // Take the next packet from the ring, or return null if it's empty
+    WifiPacket *packet = peek();
+    if (packet) head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    return packet;
+}
+
+bool WifiTransport::isDue(WifiPacket *packet, uint64_t time, int64_t &skew) {
+    // Hold packets stamped a little ahead of the receiver so instances stay loosely in sync
+    // Packets far ahead come from an instance with a different time base, so shift that peer's timestamps back
+    // to the limit; the shift only grows, so the peer's packets are still delivered in timestamp order
+    int64_t timestamp = (int64_t)packet->timestamp - skew;
+    if (timestamp > (int64_t)time + MAX_AHEAD) {
+        skew += timestamp - ((int64_t)time + MAX_AHEAD);
+        timestamp = time + MAX_AHEAD;
+    }
+    return timestamp <= (int64_t)time;
+}
+
+WifiLocalTransport::~WifiLocalTransport() {
+    // Disconnect from any remaining peers, taking each one under the lock since they can disconnect concurrently
+    while (true) {
+        mutex.lock();
+        if (connections.empty()) {
+            mutex.unlock();
+            return;
+        }
+        WifiLocalTransport *peer = connections.back().peer;
+        mutex.unlock();
+        disconnect(peer);
+    }
+}
+
+void WifiLocalTransport::connect(WifiLocalTransport *peer) {
+    // Create a queue for each direction between the two transports
+    std::shared_ptr<WifiQueue> out = std::make_shared<WifiQueue>();
+    std::shared_ptr<WifiQueue> in = std::make_shared<WifiQueue>();
+
+    // Add the peer to this transport's connection list
+    mutex.lock();
+    connections.push_back({peer, out, in, 0});
+    mutex.unlock();
+
+    // Add this transport to the peer's connection list
+    peer->mutex.lock();
+    peer->connections.push_back({this, in, out, 0});
+    peer->mutex.unlock();
+}
+
+void WifiLocalTransport::disconnect(WifiLocalTransport *peer) {
+    std::lock(mutex, peer->mutex);
+
+    // Find the connection on each side, doing nothing if the two already disconnected
+    auto position = std::find_if(connections.begin(), connections.end(),
+                                 [&](Connection &c) { return c.peer == peer; });
+    auto peerPosition = std::find_if(peer->connections.begin(), peer->connections.end(),
+                                     [&](Connection &c) { return c.peer == this; });
+    if (position == connections.end() || peerPosition == peer->connections.end()) {
+        peer->mutex.unlock();
+        mutex.unlock();
+        return;
+    }
+
+    // Remove the peer from this transport's connection list, releasing packets it sent
+    while (WifiPacket *packet = position->rxQueue->pop())
+        packet->refs.fetch_sub(1, std::memory_order_release);
+    connections.erase(position);
+
+    // Remove this transport from the peer's connection list, releasing packets sent to it
+    while (WifiPacket *packet = peerPosition->rxQueue->pop())
+        packet->refs.fetch_sub(1, std::memory_order_release);
+    peer->connections.erase(peerPosition);
+
+    peer->mutex.unlock();
+    mutex.unlock();
+}
+
+bool WifiLocalTransport::hasPending() {
+    // Check each peer's queue for packets
+    std::lock_guard<std::mutex> guard(mutex);
+    for (size_t i = 0; i < connections.size(); i++) {
+        if (connections[i].rxQueue->peek())
+            return true;
+    }
+    return false;
+}
+
+void WifiLocalTransport::send(WifiPacket *packet) {
+    // Add the packet to each peer's queue, dropping it for peers that are too far behind
+    mutex.lock();
+    for (size_t i = 0; i < connections.size(); i++) {
+        packet->refs.fetch_add(1, std::memory_order_relaxed);
+        if (!connections[i].txQueue->push(packet))
+            packet->refs.fetch_sub(1, std::memory_order_relaxed);
+    }
+    mutex.unlock();
+}
+
+WifiPacket *WifiLocalTransport::receive(uint64_t time) {
+    // Take the first due packet from any peer
+    mutex.lock();
+    for (size_t i = 0; i < connections.size(); i++) {
+        WifiPacket *packet = connections[i].rxQueue->peek();
+        if (packet && isDue(packet, time, connections[i].skew)) {
+            connections[i].rxQueue->pop();
+            mutex.unlock();
+            return packet;
+        }
+    }
+    mutex.unlock();
+    return nullptr;
+}
+
+void WifiLocalTransport::release(WifiPacket *packet) {
+    // Drop this receiver's reference so the sender can reuse the packet
+    packet->refs.fetch_sub(1, std::memory_order_release);
+}
+
+WifiSocketTransport::WifiSocketTransport(const std::string &directory, int id) : directory(directory) {
+    // Name the socket uniquely for this process and core
+    path = directory + "/dees-wifi-" + std::to_string(getpid()) + "-" + std::to_string(id) + ".sock";
+
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        LOG("WiFi socket path is too long: %s\n", path.c_str());
+        return;
+    }
+    strcpy(addr.sun_path, path.c_str());
+
+    // Create a non-blocking datagram socket and bind it in the shared directory
+    socketFd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (socketFd < 0) return;
+    fcntl(socketFd, F_SETFL, fcntl(socketFd, F_GETFL) | O_NONBLOCK);
+    unlink(path.c_str());
+    if (bind(socketFd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        LOG("Failed to bind WiFi socket: %s\n", path.c_str());
+        close(socketFd);
+        socketFd = -1;
+        return;
+    }
+
+    // Watch the directory for instances coming and going, then look for the ones already there
+    // The watch is set up first so no instance is missed in between
+    watchFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watchFd >= 0 && inotify_add_watch(watchFd, directory.c_str(),
+            IN_CREATE | IN_DELETE | IN_MOVED_TO | IN_MOVED_FROM) < 0) {
+        close(watchFd);
+        watchFd = -1;
+    }
+    findPeers();
+}
+
+WifiSocketTransport::~WifiSocketTransport() {
+    // Close and remove the socket
+    if (watchFd >= 0) close(watchFd);
+    if (socketFd < 0) return;
+    close(socketFd);
+    unlink(path.c_str());
+}
+
+void WifiSocketTransport::findPeers() {
+    // Look for sockets of other instances in the shared directory
+    peers.clear();
+    if (DIR *dir = opendir(directory.c_str())) {
+        while (struct dirent *entry = readdir(dir)) {
+            std::string name = directory + "/" + entry->d_name;
+            if (strncmp(entry->d_name, "dees-wifi-", 10) == 0 && name != path)
+                peers.push_back(name);
+        }
+        closedir(dir);
+    }
+}
+
+void WifiSocketTransport::updatePeers() {
+    // Without a directory watch, fall back to rescanning the directory periodically
+    if (watchFd < 0) {
+        if (updateCount++ % 64 == 0)
+            findPeers();
+        return;
+    }
+
+    // Apply sockets created and removed since the last check, which is a single failed read if there were none
+    alignas(struct inotify_event) char buffer[4096];
+    bool overflow = false;
+    ssize_t size;
+    while ((size = read(watchFd, buffer, sizeof(buffer))) > 0) {
+        for (ssize_t i = 0; i < size;) {
+            struct inotify_event *event = (struct inotify_event*)&buffer[i];
+            i += sizeof(struct inotify_event) + event->len;
+            overflow |= (event->mask & IN_Q_OVERFLOW) != 0;
+            if (event->len == 0 || strncmp(event->name, "dees-wifi-", 10) != 0)
+                continue;
+
+            std::string name = directory + "/" + event->name;
+            auto position = std::find(peers.begin(), peers.end(), name);
+            if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                if (position == peers.end() && name != path)
+                    peers.push_back(name);
+            } else if (position != peers.end()) {
+                peers.erase(position);
+                skews.erase(name);
+            }
+        }
+    }
+
+    // Rescan if events were lost
+    if (overflow)
+        findPeers();
+}
+
+bool WifiSocketTransport::hasPending() {
+    // Check for a held packet or a datagram waiting on the socket
+    uint8_t byte;
+    return pending || (socketFd >= 0 && recv(socketFd, &byte, 1, MSG_PEEK | MSG_DONTWAIT) >= 0);
+}
+
+void WifiSocketTransport::send(WifiPacket *packet) {
+    // Serialize the packet with its timestamp and size
+    uint8_t buffer[SOCKET_HEADER + sizeof(packet->data)];
+    memcpy(&buffer[0], &packet->timestamp, sizeof(uint64_t));
+    memcpy(&buffer[sizeof(uint64_t)], &packet->size, sizeof(uint16_t));
+    memcpy(&buffer[SOCKET_HEADER], packet->data, packet->size);
+
+    // Send a copy to every peer; the packet isn't referenced after this
+    for (size_t i = 0; i < peers.size();) {
+        struct sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, peers[i].c_str(), sizeof(addr.sun_path) - 1);
+        if (sendto(socketFd, buffer, SOCKET_HEADER + packet->size, 0, (struct sockaddr*)&addr, sizeof(addr)) < 0 &&
+                (errno == ECONNREFUSED || errno == ENOENT)) {
+            // Drop peers whose sockets are no longer bound, like ones left behind by an instance that crashed
+            // Other errors, like a full receive queue, only lose this packet
+            skews.erase(peers[i]);
+            peers.erase(peers.begin() + i);
+            continue;
+        }
+        i++;
+    }
+}
+
+WifiPacket *WifiSocketTransport::receive(uint64_t time) {
+    // Read the next datagram if one isn't already waiting
+    if (!pending) {
+        uint8_t buffer[SOCKET_HEADER + sizeof(received.data)];
+        struct sockaddr_un addr = {};
+        socklen_t length = sizeof(addr);
+        ssize_t size = recvfrom(socketFd, buffer, sizeof(buffer), MSG_DONTWAIT, (struct sockaddr*)&addr, &length);
+        if (size < (ssize_t)SOCKET_HEADER) return nullptr;
+        receivedFrom = (length > offsetof(struct sockaddr_un, sun_path)) ? addr.sun_path : "";
+
+        memcpy(&received.timestamp, &buffer[0], sizeof(uint64_t));
+        memcpy(&received.size, &buffer[sizeof(uint64_t)], sizeof(uint16_t));
+        received.size = std::min<size_t>(received.size, size - SOCKET_HEADER);
+        memcpy(received.data, &buffer[SOCKET_HEADER], received.size);
+        pending = true;
+    }
+
+    return isDue(&received, time, skews[receivedFrom]) ? &received : nullptr;
+}
+
+void WifiSocketTransport::release(WifiPacket*) {
+    // Allow the next datagram to be read
+    pending = false;
+}
@@ -0,0 +1,122 @@
+#ifndef WIFI_TRANSPORT_H
+#define WIFI_TRANSPORT_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct WifiPacket {
+    std::atomic<int> refs;
+    uint64_t timestamp; // Emulated microseconds when the packet was sent
+    uint16_t size;
+    uint16_t data[0x1000];
+};
+
+class WifiQueue {
+public:
+    bool push(WifiPacket *packet);
+
+    WifiPacket *peek();
+
+    WifiPacket *pop();
+
+private:
+    // Single-producer, single-consumer ring of packets from one core to another
+    WifiPacket *packets[64] = {};
+    std::atomic<uint32_t> head{0}, tail{0};
+};
+
+class WifiTransport {
+public:
+    virtual ~WifiTransport() {}
+
+    // Check if there are any peers to exchange packets with
+    virtual bool isActive() = 0;
+
+    // Check if there are received packets waiting, without taking them
+    virtual bool hasPending() = 0;
+
+    // Send a packet to all peers; the transport takes a reference for each one that holds onto it
+    virtual void send(WifiPacket *packet) = 0;
+
+    // Get the next received packet sent no later than the given time, or null if there isn't one
+    virtual WifiPacket *receive(uint64_t time) = 0;
+
+    // Finish with a packet returned by receive()
+    virtual void release(WifiPacket *packet) = 0;
+
+protected:
+    static bool isDue(WifiPacket *packet, uint64_t time, int64_t &skew);
+};
+
+class WifiLocalTransport : public WifiTransport {
+public:
+    ~WifiLocalTransport();
+
+    void connect(WifiLocalTransport *peer);
+
+    void disconnect(WifiLocalTransport *peer);
+
+    bool isActive() { return !connections.empty(); }
+
+    bool hasPending();
+
+    void send(WifiPacket *packet);
+
+    WifiPacket *receive(uint64_t time);
+
+    void release(WifiPacket *packet);
+
+private:
+    struct Connection {
+        WifiLocalTransport *peer;
+        std::shared_ptr<WifiQueue> txQueue; // Packets from this core, consumed by the peer
+        std::shared_ptr<WifiQueue> rxQueue; // Packets from the peer, consumed by this core
+        int64_t skew; // Microseconds to shift the peer's timestamps back by
+    };
+
+    // The mutex only guards the connection list; packets are passed without locking
+    std::vector<Connection> connections;
+    std::mutex mutex;
+};
+
+class WifiSocketTransport : public WifiTransport {
+public:
+    WifiSocketTransport(const std::string &directory, int id);
+
+    ~WifiSocketTransport();
+
+    bool isActive() { return !peers.empty(); }
+
+    bool hasPending();
+
+    void send(WifiPacket *packet);
+
+    WifiPacket *receive(uint64_t time);
+
+    void release(WifiPacket *packet);
+
+    void updatePeers();
+
+private:
+    std::string directory;
+    std::string path;
+    int socketFd = -1;
+    int watchFd = -1;
+
+    std::vector<std::string> peers;
+    std::unordered_map<std::string, int64_t> skews; // Timestamp shifts by sender socket path
+    uint32_t updateCount = 0;
+
+    WifiPacket received = {};
+    std::string receivedFrom;
+    bool pending = false;
+
+    void findPeers();
+};
+
+#endif // WIFI_TRANSPORT_H
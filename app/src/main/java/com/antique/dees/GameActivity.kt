@@ -8,6 +8,7 @@ import android.view.KeyEvent
 import android.view.MotionEvent
 import android.view.View
 import android.view.WindowInsets
+import android.widget.Toast
 import androidx.activity.ComponentActivity
 import androidx.activity.OnBackPressedCallback
 import androidx.annotation.ColorInt
@@ -21,6 +22,9 @@ class GameActivity : ComponentActivity() {
 
     private var running: Boolean = false
 
+    // Set while the rewind button is held, which is read by the core thread
+    @Volatile private var rewinding: Boolean = false
+
     private lateinit var core: Thread
 
     private lateinit var layout: ConstraintLayout
@@ -182,6 +186,8 @@ class GameActivity : ComponentActivity() {
 
                     KeyEvent.KEYCODE_BUTTON_L1 -> pressKey(9)
                     KeyEvent.KEYCODE_BUTTON_R1 -> pressKey(8)
+
+                    KeyEvent.KEYCODE_BUTTON_L2 -> rewinding = true
                 }
 
                 return true
@@ -214,6 +220,8 @@ class GameActivity : ComponentActivity() {
 
                     KeyEvent.KEYCODE_BUTTON_L1 -> releaseKey(9)
                     KeyEvent.KEYCODE_BUTTON_R1 -> releaseKey(8)
+
+                    KeyEvent.KEYCODE_BUTTON_L2 -> rewinding = false
                 }
 
                 return true
@@ -260,7 +268,11 @@ class GameActivity : ComponentActivity() {
         }
 
         // Write the save file and pause rendering
-        writeSave()
+        if (!writeSave())
+            Toast.makeText(this, "Failed to write SD card changes", Toast.LENGTH_LONG).show()
+
+        // Write any traces that are enabled
+        writeTrace()
     }
 
     private fun resumeCore() {
@@ -269,8 +281,14 @@ class GameActivity : ComponentActivity() {
 
         core = object : Thread() {
             override fun run() {
-                while (running)
-                    runFrame()
+                while (running) {
+                    // While rewinding, step back a snapshot before each frame so the game plays backwards
+                    // Wait instead once there's nothing left to step back to
+                    if (!rewinding || rewindStepBack())
+                        runFrame()
+                    else
+                        sleep(16)
+                }
             }
         }
 
@@ -280,9 +298,12 @@ class GameActivity : ComponentActivity() {
 
     private external fun restartCore()
     private external fun runFrame()
+    private external fun rewindStepBack(): Boolean
     private external fun startAudio()
     private external fun stopAudio()
-    private external fun writeSave()
+    private external fun writeSave(): Boolean
+    private external fun writeTrace(): Boolean
+    external fun getStats(): String
     private external fun pressKey(key: Int)
     private external fun releaseKey(key: Int)
 }
\ No newline at end of file